@@ -112,47 +112,19 @@ _assuan_read_from_server (assuan_context_t ctx, int *okay, int *off)
 
 
 
-/**
- * assuan_transact:
- * @ctx: The Assuan context
- * @command: Command line to be send to the server
- * @data_cb: Callback function for data lines
- * @data_cb_arg: first argument passed to @data_cb
- * @inquire_cb: Callback function for a inquire response
- * @inquire_cb_arg: first argument passed to @inquire_cb
- * @status_cb: Callback function for a status response
- * @status_cb_arg: first argument passed to @status_cb
- * 
- * FIXME: Write documentation
- * 
- * Return value: 0 on success or error code.  The error code may be
- * the one one returned by the server in error lines or from the
- * callback functions.  Take care: When a callback returns an error
- * this function returns immediately with an error and thus the caller
- * will altter return an Assuan error (write erro in most cases).
- **/
-assuan_error_t
-assuan_transact (assuan_context_t ctx,
-                 const char *command,
-                 int (*data_cb)(void *, const void *, size_t),
-                 void *data_cb_arg,
-                 int (*inquire_cb)(void*, const char *),
-                 void *inquire_cb_arg,
-                 int (*status_cb)(void*, const char *),
-                 void *status_cb_arg)
+/* Read the response to a command from the server, passing data,
+   inquiries and status lines to the callbacks in CMD.  If DISCARD is
+   true, the callbacks are not used; data and status lines are
+   ignored and inquiries are canceled.  */
+static assuan_error_t
+read_response (assuan_context_t ctx, const assuan_pipelined_cmd_t *cmd,
+               int discard)
 {
   assuan_error_t rc;
   int okay, off;
   char *line;
   int linelen;
 
-  rc = assuan_write_line (ctx, command);
-  if (rc)
-    return rc;
-
-  if (*command == '#' || !*command)
-    return 0; /* Don't expect a response for a comment line.  */
-
  again:
   rc = _assuan_read_from_server (ctx, &okay, &off);
   if (rc)
@@ -169,9 +141,16 @@ assuan_transact (assuan_context_t ctx,
       else if (rc > 0 && rc <= 405)
         rc = _assuan_error (rc);
     }
+  else if (discard)
+    {
+      if (okay == 3)
+        rc = assuan_write_line (ctx, "CAN");
+      if (!rc && okay != 1)
+        goto again;
+    }
   else if (okay == 2)
     {
-      if (!data_cb)
+      if (!cmd->data_cb)
         rc = _assuan_error (ASSUAN_No_Data_Callback);
       else 
         {
@@ -190,14 +169,14 @@ assuan_transact (assuan_context_t ctx,
                 *d++ = *s++;
             }
           *d = 0; /* add a hidden string terminator */
-          rc = data_cb (data_cb_arg, line, d - line);
+          rc = cmd->data_cb (cmd->data_cb_arg, line, d - line);
           if (!rc)
             goto again;
         }
     }
   else if (okay == 3)
     {
-      if (!inquire_cb)
+      if (!cmd->inquire_cb)
         {
           assuan_write_line (ctx, "END"); /* get out of inquire mode */
           _assuan_read_from_server (ctx, &okay, &off); /* dummy read */
@@ -205,7 +184,7 @@ assuan_transact (assuan_context_t ctx,
         }
       else
         {
-          rc = inquire_cb (inquire_cb_arg, line);
+          rc = cmd->inquire_cb (cmd->inquire_cb_arg, line);
           if (!rc)
             rc = assuan_send_data (ctx, NULL, 0); /* flush and send END */
           if (!rc)
@@ -214,18 +193,18 @@ assuan_transact (assuan_context_t ctx,
     }
   else if (okay == 4)
     {
-      if (status_cb)
-        rc = status_cb (status_cb_arg, line);
+      if (cmd->status_cb)
+        rc = cmd->status_cb (cmd->status_cb_arg, line);
       if (!rc)
         goto again;
     }
   else if (okay == 5)
     {
-      if (!data_cb)
+      if (!cmd->data_cb)
         rc = _assuan_error (ASSUAN_No_Data_Callback);
       else 
         {
-          rc = data_cb (data_cb_arg, NULL, 0);
+          rc = cmd->data_cb (cmd->data_cb_arg, NULL, 0);
           if (!rc)
             goto again;
         }
@@ -234,3 +213,101 @@ assuan_transact (assuan_context_t ctx,
   return rc;
 }
 
+
+/**
+ * assuan_transact:
+ * @ctx: The Assuan context
+ * @command: Command line to be send to the server
+ * @data_cb: Callback function for data lines
+ * @data_cb_arg: first argument passed to @data_cb
+ * @inquire_cb: Callback function for a inquire response
+ * @inquire_cb_arg: first argument passed to @inquire_cb
+ * @status_cb: Callback function for a status response
+ * @status_cb_arg: first argument passed to @status_cb
+ * 
+ * FIXME: Write documentation
+ * 
+ * Return value: 0 on success or error code.  The error code may be
+ * the one one returned by the server in error lines or from the
+ * callback functions.  Take care: When a callback returns an error
+ * this function returns immediately with an error and thus the caller
+ * will altter return an Assuan error (write erro in most cases).
+ **/
+assuan_error_t
+assuan_transact (assuan_context_t ctx,
+                 const char *command,
+                 int (*data_cb)(void *, const void *, size_t),
+                 void *data_cb_arg,
+                 int (*inquire_cb)(void*, const char *),
+                 void *inquire_cb_arg,
+                 int (*status_cb)(void*, const char *),
+                 void *status_cb_arg)
+{
+  assuan_pipelined_cmd_t cmd;
+  assuan_error_t rc;
+
+  rc = assuan_write_line (ctx, command);
+  if (rc)
+    return rc;
+
+  if (*command == '#' || !*command)
+    return 0; /* Don't expect a response for a comment line.  */
+
+  cmd.command = command;
+  cmd.data_cb = data_cb;
+  cmd.data_cb_arg = data_cb_arg;
+  cmd.inquire_cb = inquire_cb;
+  cmd.inquire_cb_arg = inquire_cb_arg;
+  cmd.status_cb = status_cb;
+  cmd.status_cb_arg = status_cb_arg;
+
+  return read_response (ctx, &cmd, 0);
+}
+
+
+/**
+ * assuan_transact_pipelined:
+ * @ctx: The Assuan context
+ * @cmds: Commands to be send to the server, along with their callbacks
+ * @ncmds: Number of commands in @cmds
+ * 
+ * Like assuan_transact, but writes all commands to the server before
+ * reading any response; the responses are then read in order.  This
+ * saves a round trip per command.  Comment lines are not allowed.
+ * 
+ * Return value: 0 on success or the error code of the first command
+ * failing.  Once a command failed, the responses to the following
+ * commands are read but ignored and their inquiries are canceled, so
+ * that the connection stays usable.  The same caveat about callbacks
+ * returning errors as for assuan_transact applies.
+ **/
+assuan_error_t
+assuan_transact_pipelined (assuan_context_t ctx,
+                           const assuan_pipelined_cmd_t *cmds, int ncmds)
+{
+  assuan_error_t rc, rc2;
+  int i;
+
+  for (i = 0; i < ncmds; i++)
+    {
+      if (*cmds[i].command == '#' || !*cmds[i].command)
+        return _assuan_error (ASSUAN_Invalid_Value);
+    }
+
+  for (i = 0; i < ncmds; i++)
+    {
+      rc = assuan_write_line (ctx, cmds[i].command);
+      if (rc)
+        return rc;
+    }
+
+  rc = 0;
+  for (i = 0; i < ncmds; i++)
+    {
+      rc2 = read_response (ctx, &cmds[i], rc != 0);
+      if (!rc)
+        rc = rc2;
+    }
+
+  return rc;
+}
@@ -292,6 +292,8 @@ pid_t _assuan_waitpid (pid_t pid, int *status, int options);
 ssize_t _assuan_simple_read (assuan_context_t ctx, void *buffer, size_t size);
 ssize_t _assuan_simple_write (assuan_context_t ctx, const void *buffer,
 			      size_t size);
+ssize_t _assuan_simple_send (assuan_context_t ctx, const void *buffer,
+			     size_t size);
 ssize_t _assuan_io_read (assuan_fd_t fd, void *buffer, size_t size);
 ssize_t _assuan_io_write (assuan_fd_t fd, const void *buffer, size_t size);
 #ifdef HAVE_W32_SYSTEM
@@ -546,19 +546,18 @@ assuan_process_done (assuan_context_t ctx, int rc)
           const char *text = ctx->err_no == rc? ctx->err_str:NULL;
 	  
 #if defined(HAVE_W32_SYSTEM)
-          unsigned int source, code;
+          unsigned int source;
           char ebuf[50];
           const char *esrc;
 	  
           source = ((rc >> 24) & 0xff);
-          code = (rc & 0x00ffffff);
           if (source
               && !_assuan_gpg_strerror_r (rc, ebuf, sizeof ebuf)
               && (esrc=_assuan_gpg_strsource (rc)))
             {
               /* Assume this is an libgpg-error.  */
               sprintf (errline, "ERR %d %.50s <%.30s>%s%.100s",
-                       code, ebuf, esrc,
+                       rc, ebuf, esrc,
                        text? " - ":"", text?text:"");
             }
           else
@@ -573,7 +572,7 @@ assuan_process_done (assuan_context_t ctx, int rc)
              weak attribute properly but it works with the weak
              pragma. */
 
-          unsigned int source, code;
+          unsigned int source;
 
           int gpg_strerror_r (unsigned int err, char *buf, size_t buflen)
             __attribute__ ((weak));
@@ -585,7 +584,6 @@ assuan_process_done (assuan_context_t ctx, int rc)
 #endif
 
           source = ((rc >> 24) & 0xff);
-          code = (rc & 0x00ffffff);
           if (source && gpg_strsource && gpg_strerror_r)
             {
               /* Assume this is an libgpg-error. */
@@ -593,7 +591,7 @@ assuan_process_done (assuan_context_t ctx, int rc)
 	      
               gpg_strerror_r (rc, ebuf, sizeof ebuf );
               sprintf (errline, "ERR %d %.50s <%.30s>%s%.100s",
-                       code,
+                       rc,
                        ebuf,
                        gpg_strsource (rc),
                        text? " - ":"", text?text:"");
@@ -177,6 +177,26 @@ _assuan_simple_write (assuan_context_t ctx, const void *buffer, size_t size)
   return do_io_write (ctx->outbound.fd, buffer, size);
 }
 
+/* Write to the socket of a context made by assuan_socket_connect.  We
+   are used from within PAM modules and must not raise SIGPIPE in the
+   application if the peer has gone away.  */
+ssize_t
+_assuan_simple_send (assuan_context_t ctx, const void *buffer, size_t size)
+{
+#if !defined(HAVE_W32_SYSTEM) && defined(MSG_NOSIGNAL)
+  ssize_t retval;
+  
+  if (_assuan_io_hooks.write_hook
+      && _assuan_io_hooks.write_hook (ctx, ctx->outbound.fd, 
+                                      buffer, size, &retval) == 1)
+    return retval;
+
+  return send (ctx->outbound.fd, buffer, size, MSG_NOSIGNAL);
+#else
+  return _assuan_simple_write (ctx, buffer, size);
+#endif
+}
+
 
 #ifdef HAVE_W32_SYSTEM
 int
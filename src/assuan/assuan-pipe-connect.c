@@ -35,6 +35,16 @@
 #else
 #include <windows.h>
 #endif
+#ifdef __linux__
+#include <stdint.h>
+#include <sys/syscall.h>
+#endif
+#if defined(HAVE_POSIX_SPAWN) \
+    && defined(HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP) \
+    && !defined(_ASSUAN_USE_DOUBLE_FORK)
+#define USE_POSIX_SPAWN 1
+#include <spawn.h>
+#endif
 
 #include "assuan-defs.h"
 
@@ -173,6 +183,244 @@ initial_handshake (assuan_context_t *ctx)
 }
 
 
+#ifndef HAVE_W32_SYSTEM
+/* Maximum number of file descriptors besides stdin, stdout and stderr
+   close_all_fds can keep open without resorting to the slow path.  */
+#define MAX_KEEP_FDS 16
+
+/* Close all file descriptors from 3 on, except for those in the
+   ascending list KEEPS of length NKEEPS, using close_range.  Returns
+   0 on success, -1 if close_range is not available.  */
+static int
+close_fds_range (const int *keeps, int nkeeps)
+{
+#if defined(HAVE_CLOSE_RANGE) || defined(SYS_close_range)
+  unsigned int lo = 3;
+  int i, rc;
+
+  for (i = 0; i <= nkeeps; i++)
+    {
+      unsigned int hi = i < nkeeps ? (unsigned int)keeps[i] - 1 : ~0U;
+
+      if (hi >= lo)
+        {
+#ifdef HAVE_CLOSE_RANGE
+          rc = close_range (lo, hi, 0);
+#else
+          rc = syscall (SYS_close_range, lo, hi, 0);
+#endif
+          if (rc)
+            return -1;
+        }
+      if (i < nkeeps)
+        lo = keeps[i] + 1;
+    }
+  return 0;
+#else
+  (void)keeps;
+  (void)nkeeps;
+  return -1;
+#endif
+}
+
+/* Close all file descriptors from 3 on, except for those in the
+   ascending list KEEPS of length NKEEPS, by enumerating
+   /proc/self/fd.  Returns 0 on success, -1 if this is not
+   possible.  */
+static int
+close_fds_proc (const int *keeps, int nkeeps)
+{
+#if defined(__linux__) && defined(SYS_getdents64)
+  struct linux_dirent64
+  {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+  } *d;
+  char buf[1024];
+  const char *s;
+  int dfd, fd, i, closed;
+  long n, off;
+
+  /* This runs after fork, thus use the system call directly instead
+     of opendir, which allocates memory.  */
+  dfd = open ("/proc/self/fd", O_RDONLY | O_DIRECTORY);
+  if (dfd == -1)
+    return -1;
+
+  do
+    {
+      closed = 0;
+      while ((n = syscall (SYS_getdents64, dfd, buf, sizeof (buf))) > 0)
+        for (off = 0; off < n; off += d->d_reclen)
+          {
+            d = (struct linux_dirent64 *)(buf + off);
+            if (*d->d_name < '0' || *d->d_name > '9')
+              continue;
+            for (fd = 0, s = d->d_name; *s >= '0' && *s <= '9'; s++)
+              fd = fd * 10 + *s - '0';
+            if (fd <= STDERR_FILENO || fd == dfd)
+              continue;
+            for (i = 0; i < nkeeps && keeps[i] != fd; i++)
+              ;
+            if (i == nkeeps)
+              {
+                close (fd);
+                closed = 1;
+              }
+          }
+      /* Closing descriptors while reading the directory may skip
+         entries, thus rescan until nothing is left to close.  */
+      if (n < 0 || (closed && lseek (dfd, 0, SEEK_SET)))
+        {
+          close (dfd);
+          return -1;
+        }
+    }
+  while (closed);
+
+  close (dfd);
+  return 0;
+#else
+  (void)keeps;
+  (void)nkeeps;
+  return -1;
+#endif
+}
+
+/* Close all file descriptors except for stdin, stdout, stderr, KEEP
+   (if not -1) and those in FD_CHILD_LIST.  This is used in the child
+   after fork.  Looping up to sysconf (_SC_OPEN_MAX) is used only as a
+   last resort, since the limit may be huge.  */
+static void
+close_all_fds (int keep, int *fd_child_list)
+{
+  int keeps[MAX_KEEP_FDS];
+  int nkeeps = 0;
+  int i, j, n, fd;
+  int *fdp;
+
+  /* Collect the descriptors to keep in ascending order.  */
+  for (fdp = fd_child_list, fd = keep; ; fd = *fdp++)
+    {
+      if (fd > STDERR_FILENO)
+        {
+          for (i = 0; i < nkeeps && keeps[i] < fd; i++)
+            ;
+          if (i == nkeeps || keeps[i] != fd)
+            {
+              if (nkeeps == MAX_KEEP_FDS)
+                goto slow;
+              for (j = nkeeps++; j > i; j--)
+                keeps[j] = keeps[j - 1];
+              keeps[i] = fd;
+            }
+        }
+      if (!fdp || *fdp == -1)
+        break;
+    }
+
+  if (!close_fds_range (keeps, nkeeps) || !close_fds_proc (keeps, nkeeps))
+    return;
+
+ slow:
+  n = sysconf (_SC_OPEN_MAX);
+  if (n < 0)
+    n = MAX_OPEN_FDS;
+  for (i=0; i < n; i++)
+    {
+      if ( i == STDIN_FILENO || i == STDOUT_FILENO
+           || i == STDERR_FILENO || i == keep)
+        continue;
+      fdp = fd_child_list;
+      if (fdp)
+        {
+          while (*fdp != -1 && *fdp != i)
+            fdp++;
+        }
+
+      if (!(fdp && *fdp != -1))
+        close(i);
+    }
+}
+#endif /*!HAVE_W32_SYSTEM*/
+
+
+#ifdef USE_POSIX_SPAWN
+/* Start the server NAME with arguments ARGV through posix_spawn,
+   connecting its stdin to WP[0] and its stdout to RP[1], like the
+   fork based code in pipe_connect_unix does.  This is considerably
+   cheaper than fork for large processes.  It can only be used if no
+   descriptors besides stdin, stdout and stderr are to be passed to
+   the child.  Returns 0 on success and stores the pid of the server
+   at R_PID, an errno value otherwise.  */
+static int
+spawn_server (pid_t *r_pid, const char *name, const char *const argv[],
+              int *fd_child_list, int rp[2], int wp[2],
+              const char *mypidstr)
+{
+  extern char **environ;
+  posix_spawn_file_actions_t actions;
+  const char *pidvar = "_assuan_pipe_connect_pid=";
+  const char *connvar = "_assuan_connection_fd=";
+  char **envp, *pidenv;
+  int keep_stderr;
+  int *fdp;
+  int i, n, rc;
+
+  keep_stderr = 0;
+  for (fdp = fd_child_list; fdp && *fdp != -1; fdp++)
+    if (*fdp == STDERR_FILENO)
+      keep_stderr = 1;
+
+  /* Prepare the environment: we pass our pid to the server, but never
+     a connection fd variable when using a simple pipe.  */
+  for (n = 0; environ[n]; n++)
+    ;
+  envp = xtrymalloc ((n + 2) * sizeof *envp);
+  pidenv = xtrymalloc (strlen (pidvar) + strlen (mypidstr) + 1);
+  if (!envp || !pidenv)
+    {
+      rc = errno;
+      xfree (envp);
+      xfree (pidenv);
+      return rc;
+    }
+  strcpy (stpcpy (pidenv, pidvar), mypidstr);
+  for (i = n = 0; environ[i]; i++)
+    if (strncmp (environ[i], pidvar, strlen (pidvar))
+        && strncmp (environ[i], connvar, strlen (connvar)))
+      envp[n++] = environ[i];
+  envp[n++] = pidenv;
+  envp[n] = NULL;
+
+  rc = posix_spawn_file_actions_init (&actions);
+  if (rc)
+    goto leave;
+  rc = posix_spawn_file_actions_adddup2 (&actions, rp[1], STDOUT_FILENO);
+  if (!rc)
+    rc = posix_spawn_file_actions_adddup2 (&actions, wp[0], STDIN_FILENO);
+  if (!rc && !keep_stderr)
+    rc = posix_spawn_file_actions_addopen (&actions, STDERR_FILENO,
+                                           "/dev/null", O_WRONLY, 0);
+  if (!rc)
+    rc = posix_spawn_file_actions_addclosefrom_np (&actions,
+                                                   STDERR_FILENO + 1);
+  if (!rc)
+    rc = posix_spawn (r_pid, name, &actions, NULL,
+                      (char *const *)argv, envp);
+  posix_spawn_file_actions_destroy (&actions);
+
+ leave:
+  xfree (envp);
+  xfree (pidenv);
+  return rc;
+}
+#endif /*USE_POSIX_SPAWN*/
+
+
 #ifndef HAVE_W32_SYSTEM
 #define pipe_connect pipe_connect_unix
 /* Unix version of the pipe connection code.  We use an extra macro to
@@ -223,6 +471,39 @@ pipe_connect_unix (assuan_context_t *ctx,
   (*ctx)->deinit_handler = do_deinit;
   (*ctx)->finish_handler = do_finish;
 
+#ifdef USE_POSIX_SPAWN
+  if (!atfork)
+    {
+      int *fdp;
+
+      for (fdp = fd_child_list; fdp && *fdp != -1; fdp++)
+        if (*fdp > STDERR_FILENO)
+          break;
+      if (!fdp || *fdp == -1)
+        {
+          int rc;
+
+          rc = spawn_server (&(*ctx)->pid, name, argv, fd_child_list,
+                             rp, wp, mypidstr);
+          if (rc)
+            {
+              _assuan_log_printf ("can't spawn `%s': %s\n",
+                                  name, strerror (rc));
+              close (rp[0]);
+              close (rp[1]);
+              close (wp[0]);
+              close (wp[1]);
+              _assuan_release_context (*ctx);
+              *ctx = NULL;
+              return _assuan_error (ASSUAN_Connect_Failed);
+            }
+          close (rp[1]);
+          close (wp[0]);
+          return initial_handshake (ctx);
+        }
+    }
+#endif /*USE_POSIX_SPAWN*/
+
   /* FIXME: For GPGME we should better use _gpgme_io_spawn.  The PID
      stored here is actually soon useless.  */
   (*ctx)->pid = fork ();
@@ -244,7 +525,6 @@ pipe_connect_unix (assuan_context_t *ctx,
       if ((pid = fork ()) == 0)
 #endif
 	{
-          int i, n;
           char errbuf[512];
           int *fdp;
           
@@ -299,24 +579,7 @@ pipe_connect_unix (assuan_context_t *ctx,
 
           /* Close all files which will not be duped and are not in the
              fd_child_list. */
-          n = sysconf (_SC_OPEN_MAX);
-          if (n < 0)
-            n = MAX_OPEN_FDS;
-          for (i=0; i < n; i++)
-            {
-              if ( i == STDIN_FILENO || i == STDOUT_FILENO
-                   || i == STDERR_FILENO)
-                continue;
-              fdp = fd_child_list;
-              if (fdp)
-                {
-                  while (*fdp != -1 && *fdp != i)
-                    fdp++;
-                }
-
-              if (!(fdp && *fdp != -1))
-                close(i);
-            }
+          close_all_fds (-1, fd_child_list);
           errno = 0;
 
           /* We store our parents pid in the environment so that the
@@ -422,7 +685,7 @@ socketpair_connect (assuan_context_t *ctx,
       if ((pid = fork ()) == 0)
 #endif
 	{
-          int fd, i, n;
+          int fd;
           char errbuf[512];
           int *fdp;
           
@@ -467,24 +730,7 @@ socketpair_connect (assuan_context_t *ctx,
 
           /* Close all files which will not be duped, are not in the
              fd_child_list and are not the connection fd. */
-          n = sysconf (_SC_OPEN_MAX);
-          if (n < 0)
-            n = MAX_OPEN_FDS;
-          for (i=0; i < n; i++)
-            {
-              if ( i == STDIN_FILENO || i == STDOUT_FILENO
-                   || i == STDERR_FILENO || i == fds[1])
-                continue;
-              fdp = fd_child_list;
-              if (fdp)
-                {
-                  while (*fdp != -1 && *fdp != i)
-                    fdp++;
-                }
-
-              if (!(fdp && *fdp != -1))
-                close(i);
-            }
+          close_all_fds (fds[1], fd_child_list);
           errno = 0;
 
           /* We store our parents pid in the environment so that the
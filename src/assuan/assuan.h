@@ -118,6 +118,7 @@
 #define assuan_get_pid _ASSUAN_PREFIX(assuan_get_pid)
 #define assuan_get_peercred _ASSUAN_PREFIX(assuan_get_peercred)
 #define assuan_transact _ASSUAN_PREFIX(assuan_transact)
+#define assuan_transact_pipelined _ASSUAN_PREFIX(assuan_transact_pipelined)
 #define assuan_inquire _ASSUAN_PREFIX(assuan_inquire)
 #define assuan_inquire_ext _ASSUAN_PREFIX(assuan_inquire_ext)
 #define assuan_read_line _ASSUAN_PREFIX(assuan_read_line)
@@ -167,6 +168,7 @@
   _ASSUAN_PREFIX(_assuan_register_std_commands)
 #define _assuan_simple_read _ASSUAN_PREFIX(_assuan_simple_read)
 #define _assuan_simple_write _ASSUAN_PREFIX(_assuan_simple_write)
+#define _assuan_simple_send _ASSUAN_PREFIX(_assuan_simple_send)
 #define _assuan_io_read _ASSUAN_PREFIX(_assuan_io_read)
 #define _assuan_io_write _ASSUAN_PREFIX(_assuan_io_write)
 #define _assuan_io_hooks _ASSUAN_PREFIX(_assuan_io_hooks)
@@ -551,6 +553,23 @@ assuan_transact (assuan_context_t ctx,
                  assuan_error_t (*status_cb)(void*, const char *),
                  void *status_cb_arg);
 
+/* A command for assuan_transact_pipelined along with the callbacks
+   for its response, see assuan_transact.  */
+typedef struct
+{
+  const char *command;
+  assuan_error_t (*data_cb)(void *, const void *, size_t);
+  void *data_cb_arg;
+  assuan_error_t (*inquire_cb)(void*, const char *);
+  void *inquire_cb_arg;
+  assuan_error_t (*status_cb)(void*, const char *);
+  void *status_cb_arg;
+} assuan_pipelined_cmd_t;
+
+assuan_error_t
+assuan_transact_pipelined (assuan_context_t ctx,
+                           const assuan_pipelined_cmd_t *cmds, int ncmds);
+
 
 /*-- assuan-inquire.c --*/
 assuan_error_t assuan_inquire (assuan_context_t ctx, const char *keyword,
@@ -23,6 +23,7 @@
 #include <gcrypt.h>
 
 #include <stdlib.h>
+#include <string.h>
 
 #define PAM_SM_AUTH
 #include <security/pam_modules.h>
@@ -35,6 +36,7 @@
 #include "util/support.h"
 #include "auth-support/ctx.h"
 #include "auth-support/wait-for-card.h"
+#include "auth-support/phase.h"
 
 #include "usersdb.h"
 #include "key-lookup.h"
@@ -82,8 +84,12 @@ auth_method_localdb_auth_do (poldi_ctx_t ctx,
   gpg_error_t err;
   char *card_username;
   const char *username;
+  char **accounts;
+  uint64_t start;
+  int i;
 
   card_username = NULL;
+  accounts = NULL;
 
   challenge = NULL;
   response = NULL;
@@ -94,14 +100,32 @@ auth_method_localdb_auth_do (poldi_ctx_t ctx,
    * Process authentication request.
    */
 
+  /* Look up the accounts associated with the card's serialno; this
+     single lookup serves for figuring out the username as well as for
+     verifying it.  */
+  start = stats_now ();
+  err = usersdb_lookup_accounts (ctx->cardinfo.serialno, &accounts,
+				 ctx->loghandle);
+  phase_record (ctx, STATS_PHASE_USERSDB_LOOKUP, start);
+  if (username_desired && gcry_err_code (err) == GPG_ERR_NOT_FOUND)
+    /* Reported below.  */
+    err = 0;
+  if (err)
+    goto out;
+
   if (!username_desired)
     {
       /* We didn't receive a username from PAM, therefore we need to
 	 figure it out somehow. We use the card's serialno for looking
 	 up an account.  */
 
-      err = usersdb_lookup_by_serialno (ctx->cardinfo.serialno, &card_username);
-      if (gcry_err_code (err) == GPG_ERR_AMBIGUOUS_NAME)
+      if (!accounts[1])
+	{
+	  card_username = xtrystrdup (accounts[0]);
+	  if (!card_username)
+	    err = gpg_error_from_syserror ();
+	}
+      else
 	/* Given serialno is associated with more than one account =>
 	   ask the user for desired identity.  */
 	err = conv_ask (ctx->conv, 0, &card_username,
@@ -122,10 +146,12 @@ auth_method_localdb_auth_do (poldi_ctx_t ctx,
     conv_tell (ctx->conv,
 	       _("Trying authentication as user `%s'..."), username);
 
-  /* Verify (again) that the given account is associated with the
-     serial number.  */
-  err = usersdb_check (ctx->cardinfo.serialno, username);
-  if (err)
+  /* Verify that the given account is associated with the serial
+     number.  */
+  for (i = 0; accounts && accounts[i]; i++)
+    if (!strcmp (accounts[i], username))
+      break;
+  if (!(accounts && accounts[i]))
     {
       if (ctx->debug)
 	log_msg_debug (ctx->loghandle,
@@ -139,7 +165,9 @@ auth_method_localdb_auth_do (poldi_ctx_t ctx,
     }
 
   /* Retrieve key belonging to card.  */
+  start = stats_now ();
   err = key_lookup_by_serialno (ctx, ctx->cardinfo.serialno, &key);
+  phase_record (ctx, STATS_PHASE_KEY_LOOKUP, start);
   if (err)
     goto out;
 
@@ -154,9 +182,11 @@ auth_method_localdb_auth_do (poldi_ctx_t ctx,
     }
 
   /* Let card sign the challenge.  */
+  start = stats_now ();
   err = scd_pksign (ctx->scd, "OPENPGP.3",
 		    challenge, challenge_n,
 		    &response, &response_n);
+  phase_record (ctx, STATS_PHASE_PKSIGN, start);
   if (err)
     {
       log_msg_error (ctx->loghandle,
@@ -166,7 +196,9 @@ auth_method_localdb_auth_do (poldi_ctx_t ctx,
     }
 
   /* Verify response.  */
+  start = stats_now ();
   err = challenge_verify (key, challenge, challenge_n, response, response_n);
+  phase_record (ctx, STATS_PHASE_VERIFY, start);
   if (err)
     {
       log_msg_error (ctx->loghandle, "failed to verify challenge");
@@ -182,6 +214,7 @@ auth_method_localdb_auth_do (poldi_ctx_t ctx,
 
   /* Release resources.  */
   gcry_sexp_release (key);
+  char_vector_free (accounts);
 
   challenge_release (challenge);
   xfree (response);
@@ -224,5 +257,7 @@ struct auth_method_s auth_method_localdb =
     auth_method_localdb_auth_as,
     NULL,
     NULL,
-    NULL
+    NULL,
+    NULL,
+    SCD_ATTR_SERIALNO
   };
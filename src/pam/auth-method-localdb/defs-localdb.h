@@ -25,6 +25,15 @@
 #define POLDI_LOCALDB_DIRECTORY POLDI_CONF_DIRECTORY    "/localdb"
 
 #define POLDI_USERS_DB_FILE     POLDI_LOCALDB_DIRECTORY "/users"
+#define POLDI_USERS_INDEX_FILE  POLDI_LOCALDB_DIRECTORY "/users.db"
 #define POLDI_KEY_DIRECTORY     POLDI_LOCALDB_DIRECTORY "/keys"
+#define POLDI_KEYRING_FILE      POLDI_LOCALDB_DIRECTORY "/keyring"
+
+/* The keyring is a constant database (see util/cdb.h) containing keys
+   in canonical S-Expression format, indexed by card serial number and
+   by keygrip (as hex string).  */
+#define KEYRING_TABLE_SERIALNO 0
+#define KEYRING_TABLE_KEYGRIP  1
+#define KEYRING_TABLES         2
 
 #endif
@@ -22,12 +22,17 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
 #include <gpg-error.h>
 #include <gcrypt.h>
 
 #include "util/support.h"
 #include "util/filenames.h"
+#include "util/cdb.h"
 #include "key-lookup.h"
 #include "defs-localdb.h"
 
@@ -43,18 +48,220 @@ key_filename_construct (char **filename, const char *serialno)
   return make_filename (filename, POLDI_KEY_DIRECTORY, serialno, NULL);
 }
 
+
+
+/*
+ * Key cache.  PAM modules are often loaded by long-lived processes,
+ * which authenticate the same few users over and over again.
+ * Therefore parsed keys are kept in a small, process-wide LRU cache,
+ * which is shared by all threads.  Entries are validated against the
+ * identity of the key file (device, inode, modification time and
+ * size) on every lookup.
+ */
+
+/* Number of keys to cache.  */
+#define KEY_CACHE_SIZE 16
+
+struct key_cache_entry
+{
+  char *serialno;		/* NULL if entry is unused.  */
+  struct cdb_source source;	/* Identity of the key file.  */
+  gcry_sexp_t key;
+  unsigned long last_used;
+};
+
+static struct key_cache_entry key_cache[KEY_CACHE_SIZE];
+static unsigned long key_cache_clock;
+static pthread_mutex_t key_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Look up the key for SERIALNO, read from a file with identity
+   SOURCE, in the key cache.  On success, a copy of the key is stored
+   in *KEY.  Returns GPG_ERR_NOT_FOUND in case there is no valid
+   entry, other error codes on failure.  */
+static gpg_error_t
+key_cache_lookup (const char *serialno, const struct cdb_source *source,
+		  gcry_sexp_t *key)
+{
+  gpg_error_t err;
+  int i;
+
+  err = gpg_error (GPG_ERR_NOT_FOUND);
+
+  pthread_mutex_lock (&key_cache_lock);
+  for (i = 0; i < KEY_CACHE_SIZE; i++)
+    if (key_cache[i].serialno
+	&& ! strcmp (key_cache[i].serialno, serialno))
+      {
+	if (cdb_source_equal (&key_cache[i].source, source))
+	  {
+	    /* Callers own the returned key, hand out a copy.  */
+	    err = gcry_sexp_build (key, NULL, "%S", key_cache[i].key);
+	    if (! err)
+	      key_cache[i].last_used = ++key_cache_clock;
+	  }
+	break;
+      }
+  pthread_mutex_unlock (&key_cache_lock);
+
+  return err;
+}
+
+/* Store a copy of KEY for SERIALNO, read from a file with identity
+   SOURCE, in the key cache, replacing an outdated entry for SERIALNO
+   or the least recently used entry.  Failure is not fatal, the key is
+   simply not cached then.  */
+static void
+key_cache_insert (const char *serialno, const struct cdb_source *source,
+		  gcry_sexp_t key)
+{
+  struct key_cache_entry *entry;
+  gcry_sexp_t key_copy;
+  char *serialno_copy;
+  int i;
+
+  if (gcry_sexp_build (&key_copy, NULL, "%S", key))
+    return;
+  serialno_copy = xtrystrdup (serialno);
+  if (! serialno_copy)
+    {
+      gcry_sexp_release (key_copy);
+      return;
+    }
+
+  pthread_mutex_lock (&key_cache_lock);
+  entry = &key_cache[0];
+  for (i = 0; i < KEY_CACHE_SIZE; i++)
+    {
+      if (key_cache[i].serialno
+	  && ! strcmp (key_cache[i].serialno, serialno))
+	{
+	  entry = &key_cache[i];
+	  break;
+	}
+      if (! key_cache[i].serialno)
+	{
+	  if (entry->serialno)
+	    entry = &key_cache[i];
+	}
+      else if (entry->serialno
+	       && key_cache[i].last_used < entry->last_used)
+	entry = &key_cache[i];
+    }
+
+  xfree (entry->serialno);
+  gcry_sexp_release (entry->key);
+  entry->serialno = serialno_copy;
+  entry->source = *source;
+  entry->key = key_copy;
+  entry->last_used = ++key_cache_clock;
+  pthread_mutex_unlock (&key_cache_lock);
+}
+
+
+
+/*
+ * Keyring.  Instead of the key directory, keys may be stored in a
+ * single keyring file, which is created by poldi-keyring.  The
+ * keyring is kept mapped for the lifetime of the process and reopened
+ * whenever the file is replaced.
+ */
+
+static struct cdb keyring;
+static int keyring_is_open;
+static struct cdb_source keyring_source;
+static pthread_mutex_t keyring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Look up the key belonging to the card specified by SERIALNO in the
+   keyring.  Returns GPG_ERR_NOT_FOUND in case there is no keyring or
+   it does not contain a key for SERIALNO, other error codes on
+   failure.  */
+static gpg_error_t
+keyring_lookup (poldi_ctx_t ctx, const char *serialno, gcry_sexp_t *key)
+{
+  struct cdb_source source;
+  struct cdb_find find;
+  struct stat statbuf;
+  const char *data;
+  size_t datalen;
+  gpg_error_t err;
+
+  if (stat (POLDI_KEYRING_FILE, &statbuf))
+    {
+      if (errno == ENOENT)
+	return gpg_error (GPG_ERR_NOT_FOUND);
+      err = gpg_error_from_syserror ();
+      log_msg_error (ctx->loghandle,
+		     "failed to access keyring `%s': %s",
+		     POLDI_KEYRING_FILE, gpg_strerror (err));
+      return err;
+    }
+  cdb_source_from_stat (&source, &statbuf);
+
+  pthread_mutex_lock (&keyring_lock);
+
+  if (keyring_is_open && ! cdb_source_equal (&keyring_source, &source))
+    {
+      /* Keyring has been replaced.  */
+      cdb_close (&keyring);
+      keyring_is_open = 0;
+    }
+
+  if (! keyring_is_open)
+    {
+      err = cdb_open (&keyring, POLDI_KEYRING_FILE);
+      if (! err && keyring.ntables != KEYRING_TABLES)
+	{
+	  cdb_close (&keyring);
+	  err = gpg_error (GPG_ERR_INV_DATA);
+	}
+      if (err)
+	{
+	  log_msg_error (ctx->loghandle,
+			 "failed to open keyring `%s': %s",
+			 POLDI_KEYRING_FILE, gpg_strerror (err));
+	  goto out;
+	}
+      keyring_source = source;
+      keyring_is_open = 1;
+    }
+
+  cdb_findstart (&find, &keyring, KEYRING_TABLE_SERIALNO,
+		 serialno, strlen (serialno));
+  err = cdb_findnext (&find, &data, &datalen);
+  if (! err)
+    err = gcry_sexp_new (key, data, datalen, 0);
+  if (err && gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    log_msg_error (ctx->loghandle,
+		   "failed to retrieve key for serial number `%s' "
+		   "from keyring `%s': %s",
+		   serialno, POLDI_KEYRING_FILE, gpg_strerror (err));
+
+ out:
+
+  pthread_mutex_unlock (&keyring_lock);
+
+  return err;
+}
+
+
+
 /* Lookup the key belonging to the card specified by SERIALNO.
    Returns a proper error code.  */
 gpg_error_t
 key_lookup_by_serialno (poldi_ctx_t ctx, const char *serialno, gcry_sexp_t *key)
 {
+  struct cdb_source source;
+  struct stat statbuf;
   gcry_sexp_t key_sexp;
-  char *key_string;
   char *key_path;
   gpg_error_t err;
 
   key_path = NULL;
-  key_string = NULL;
+
+  /* Prefer the keyring, fall back to the key directory.  */
+  err = keyring_lookup (ctx, serialno, key);
+  if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    goto out;
 
   err = key_filename_construct (&key_path, serialno);
   if (err)
@@ -66,33 +273,47 @@ key_lookup_by_serialno (poldi_ctx_t ctx, const char *serialno, gcry_sexp_t *key)
       goto out;
     }
 
-  err = file_to_string (key_path, &key_string);
-  if ((! err) && (! key_string))
-    err = gpg_error (GPG_ERR_NO_PUBKEY);
-  if (err)
+  /* Stat the key file before reading it; in case it is modified in
+     between, the cache entry is merely invalidated early.  */
+  if (stat (key_path, &statbuf))
     {
+      err = gpg_error_from_syserror ();
       log_msg_error (ctx->loghandle,
 		     "failed to retrieve key from key file `%s': %s\n",
 		     key_path, gpg_strerror (err));
       goto out;
     }
+  cdb_source_from_stat (&source, &statbuf);
+
+  err = key_cache_lookup (serialno, &source, key);
+  if (! err)
+    {
+      if (ctx->debug)
+	log_msg_debug (ctx->loghandle,
+		       "using cached key for serial number `%s'", serialno);
+      goto out;
+    }
+  else if (gpg_err_code (err) != GPG_ERR_NOT_FOUND)
+    goto out;
 
-  err = string_to_sexp (&key_sexp, key_string);
+  err = file_to_sexp (key_path, &key_sexp);
+  if (gpg_err_code (err) == GPG_ERR_NO_DATA)
+    err = gpg_error (GPG_ERR_NO_PUBKEY);
   if (err)
     {
       log_msg_error (ctx->loghandle,
-		     "failed to convert key "
-		     "from `%s' into S-Expression: %s\n",
+		     "failed to retrieve key from key file `%s': %s\n",
 		     key_path, gpg_strerror (err));
       goto out;
     }
 
+  key_cache_insert (serialno, &source, key_sexp);
+
   *key = key_sexp;
 
  out:
 
   xfree (key_path);
-  xfree (key_string);
 
   return err;
 }
@@ -23,12 +23,23 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
 
 #include <gcrypt.h>
 
+#include "util/cdb.h"
+#include "util/support.h"
 #include "usersdb.h"
 #include "defs-localdb.h"
 
+/* The users database index is a constant database containing two
+   tables: the first maps serial numbers to usernames, the second maps
+   usernames to serial numbers.  */
+#define USERSDB_TABLE_SERIALNO 0
+#define USERSDB_TABLE_USERNAME 1
+#define USERSDB_TABLES         2
+
 
 
 /* This is the type for callbacks functions, which need to be passed
@@ -42,16 +53,16 @@
 typedef int (*usersdb_cb_t) (const char *serialno, const char *username,
 			     void *opaque);
 
-/* This functions processes the users database.  For each read pair of
-   a card serial number and a account, the callback function specified
-   as (CB, OPAQUE) is called.  Depending on CB's return code,
-   processing is continued or aborted.  */
+/* This functions processes the users database, which has been opened
+   as the stream USERSDB.  For each read pair of a card serial number
+   and a account, the callback function specified as (CB, OPAQUE) is
+   called.  Depending on CB's return code, processing is continued or
+   aborted.  */
 static gpg_error_t
-usersdb_process (usersdb_cb_t cb, void *opaque)
+usersdb_process_stream (FILE *usersdb, usersdb_cb_t cb, void *opaque)
 {
   const char *delimiters = "\t\n ";
   gpg_error_t err;
-  FILE *usersdb;
   char *line;
   char *line_serialno;
   char *line_username;
@@ -65,14 +76,6 @@ usersdb_process (usersdb_cb_t cb, void *opaque)
   line = NULL;
   err = 0;
 
-  /* Open users database.  */
-  usersdb = fopen (POLDI_USERS_DB_FILE, "r");
-  if (! usersdb)
-    {
-      err = gpg_error_from_syserror ();
-      goto out;
-    }
-
   /* Process lines.  */
   while (1)
     {
@@ -125,13 +128,241 @@ usersdb_process (usersdb_cb_t cb, void *opaque)
 
  out:
 
-  if (usersdb)
-    fclose (usersdb);
   free (line);			/* Allocated by getline, thus standard
 				   free. */
   return err;
 }
 
+/* This functions processes the users database.  For each read pair of
+   a card serial number and a account, the callback function specified
+   as (CB, OPAQUE) is called.  Depending on CB's return code,
+   processing is continued or aborted.  */
+static gpg_error_t
+usersdb_process (usersdb_cb_t cb, void *opaque)
+{
+  gpg_error_t err;
+  FILE *usersdb;
+
+  /* Open users database.  */
+  usersdb = fopen (POLDI_USERS_DB_FILE, "r");
+  if (! usersdb)
+    return gpg_error_from_syserror ();
+
+  err = usersdb_process_stream (usersdb, cb, opaque);
+
+  fclose (usersdb);
+
+  return err;
+}
+
+
+
+/*
+ * Users database index.  Looking up entries in the plain text users
+ * database requires a full scan of the file, therefore we maintain a
+ * compiled index of it (see util/cdb.h).  The index records the
+ * identity of the users file it has been built from and is rebuilt
+ * whenever the users file changes.
+ *
+ * Alternatively, the administrator may install a database compiled
+ * by poldi-usersdb; such a database is marked with the
+ * USERSDB_COMPILED flag and used as long as the users file has not
+ * been modified after the database file (or the users file does not
+ * exist at all).  Only the modification times are compared, so that
+ * a database compiled on one host can be installed on many others.
+ */
+
+/* Type for opaque callback argument of usersdb_compile_cb.  */
+struct compile_parm_s
+{
+  cdb_make_t make;
+  gpg_error_t err;
+};
+
+/* Callback function, adds a single entry to the database under
+   construction.  */
+static int
+usersdb_compile_cb (const char *serialno, const char *username,
+		    void *opaque)
+{
+  struct compile_parm_s *parm = opaque;
+
+  if (! (serialno || username))
+    /* Finalizing.  */
+    return 0;
+
+  parm->err = cdb_make_add (parm->make, USERSDB_TABLE_SERIALNO,
+			    serialno, strlen (serialno),
+			    username, strlen (username));
+  if (! parm->err)
+    parm->err = cdb_make_add (parm->make, USERSDB_TABLE_USERNAME,
+			      username, strlen (username),
+			      serialno, strlen (serialno));
+
+  return !!parm->err;
+}
+
+/* Compile the users database USERS_FILE into the database file
+   DB_FILE, marking it with FLAGS.  Returns proper error code.  */
+gpg_error_t
+usersdb_compile (const char *users_file, const char *db_file,
+		 unsigned int flags)
+{
+  struct compile_parm_s parm = { NULL, 0 };
+  struct cdb_source source;
+  struct stat statbuf;
+  gpg_error_t err;
+  FILE *usersdb;
+
+  usersdb = fopen (users_file, "r");
+  if (! usersdb)
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+
+  /* Record the identity of the file we actually read.  */
+  if (fstat (fileno (usersdb), &statbuf))
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+  cdb_source_from_stat (&source, &statbuf);
+
+  err = cdb_make_start (&parm.make, db_file, USERSDB_TABLES);
+  if (err)
+    goto out;
+
+  cdb_make_set_info (parm.make, flags, &source);
+
+  err = usersdb_process_stream (usersdb, usersdb_compile_cb, &parm);
+  if (! err)
+    err = parm.err;
+  if (err)
+    cdb_make_abort (parm.make);
+  else
+    err = cdb_make_finish (parm.make);
+
+ out:
+
+  if (usersdb)
+    fclose (usersdb);
+
+  return err;
+}
+
+/* Open the index of the users database in DB, rebuilding it if it is
+   missing or out of date.  Returns proper error code; in case of an
+   error, the caller is expected to fall back to processing the plain
+   users database.  Problems the administrator should know about are
+   logged through LOGHANDLE.  */
+static gpg_error_t
+usersdb_index_open (struct cdb *db, log_handle_t loghandle)
+{
+  /* Only complain once per process about an outdated database.  */
+  static int outdated_logged;
+
+  struct cdb_source source;
+  struct stat statbuf;
+  gpg_error_t err;
+  int have_source;
+  int tries;
+
+  for (tries = 0; tries < 2; tries++)
+    {
+      have_source = !stat (POLDI_USERS_DB_FILE, &statbuf);
+      if (! have_source && errno != ENOENT)
+	return gpg_error_from_syserror ();
+      if (have_source)
+	cdb_source_from_stat (&source, &statbuf);
+
+      err = cdb_open (db, POLDI_USERS_INDEX_FILE);
+      if (! err)
+	{
+	  if (db->ntables == USERSDB_TABLES && (db->flags & USERSDB_COMPILED))
+	    {
+	      /* Database installed by the administrator, never
+		 overwrite it.  */
+	      if (! have_source || source.mtime <= db->file.mtime)
+		return 0;
+	      cdb_close (db);
+	      if (! outdated_logged)
+		{
+		  outdated_logged = 1;
+		  log_msg_error (loghandle, "users database `%s' is newer "
+				 "than the compiled database `%s', reading "
+				 "the former; run poldi-usersdb",
+				 POLDI_USERS_DB_FILE, POLDI_USERS_INDEX_FILE);
+		}
+	      return gpg_error (GPG_ERR_INV_DATA);
+	    }
+	  else if (db->ntables == USERSDB_TABLES && have_source
+		   && cdb_source_equal (&db->source, &source))
+	    /* Index is up to date.  */
+	    return 0;
+	  cdb_close (db);
+	}
+
+      if (! have_source)
+	return gpg_error (GPG_ERR_ENOENT);
+
+      if (tries)
+	/* The users database changed while rebuilding the index.  */
+	break;
+
+      /* Index missing or stale, rebuild it.  This fails in case we
+	 lack write access to the localdb directory.  */
+      err = usersdb_compile (POLDI_USERS_DB_FILE, POLDI_USERS_INDEX_FILE, 0);
+      if (err)
+	return err;
+    }
+
+  return gpg_error (GPG_ERR_INV_DATA);
+}
+
+/* Process those entries of the users database, whose key in table
+   TABLE (serial number or username) equals KEY; the callback is
+   invoked like from usersdb_process().  The index is used if
+   possible, otherwise the whole users database is processed - callers
+   are expected to check each entry.  LOGHANDLE may be NULL.  */
+static gpg_error_t
+usersdb_query (unsigned int table, const char *key,
+	       usersdb_cb_t cb, void *opaque, log_handle_t loghandle)
+{
+  struct cdb_find find;
+  struct cdb db;
+  const char *value;
+  gpg_error_t err;
+  int cb_ret;
+
+  err = usersdb_index_open (&db, loghandle);
+  if (err)
+    /* No usable index, do it the slow way.  */
+    return usersdb_process (cb, opaque);
+
+  cdb_findstart (&find, &db, table, key, strlen (key));
+  while (! (err = cdb_findnext (&find, &value, NULL)))
+    {
+      if (table == USERSDB_TABLE_SERIALNO)
+	cb_ret = (*cb) (key, value, opaque);
+      else
+	cb_ret = (*cb) (value, key, opaque);
+      if (cb_ret)
+	/* Callback functions wants us to stop.  */
+	break;
+    }
+  if (gpg_err_code (err) == GPG_ERR_NOT_FOUND)
+    err = 0;
+
+  if (! err)
+    /* Finalize.  */
+    (*cb) (NULL, NULL, opaque);
+
+  cdb_close (&db);
+
+  return err;
+}
+
 
 
 /*
@@ -184,7 +415,8 @@ usersdb_check (const char *serialno, const char *username)
   struct check_cb_s ctx = { serialno, username, 0 };
   gpg_error_t err;
 
-  err = usersdb_process (usersdb_check_cb, &ctx);
+  err = usersdb_query (USERSDB_TABLE_SERIALNO, serialno,
+		       usersdb_check_cb, &ctx, NULL);
   if (! err)
     {
       /* Now we have a result in CTX.  */
@@ -291,7 +523,8 @@ usersdb_lookup_by_serialno (const char *serialno, char **username)
   assert (serialno);
   assert (username);
 
-  err = usersdb_process (usersdb_lookup_cb, &ctx);
+  err = usersdb_query (USERSDB_TABLE_SERIALNO, serialno,
+		       usersdb_lookup_cb, &ctx, NULL);
   if (err)
     goto out;
 
@@ -340,7 +573,8 @@ usersdb_lookup_by_username (const char *username, char **serialno)
   assert (username);
   assert (serialno);
 
-  err = usersdb_process (usersdb_lookup_cb, &ctx);
+  err = usersdb_query (USERSDB_TABLE_USERNAME, username,
+		       usersdb_lookup_cb, &ctx, NULL);
   if (err)
     goto out;
 
@@ -375,4 +609,99 @@ usersdb_lookup_by_username (const char *username, char **serialno)
   return err;
 }
 
+
+
+/*
+ * Implementation of "usersdb_lookup_accounts" function, which
+ * collects all accounts associated with a serial number in a single
+ * pass over the users database.
+ */
+
+/* Type for opaque callback argument.  */
+typedef struct accounts_cb_s
+{
+  const char *serialno;
+  char **accounts;		/* NULL-terminated vector.  */
+  size_t n;			/* Number of accounts in vector.  */
+  size_t size;			/* Allocated size of vector.  */
+  gpg_error_t err;
+} *accounts_cb_t;
+
+/* Callback function.  */
+static int
+usersdb_accounts_cb (const char *serialno, const char *username,
+		     void *opaque)
+{
+  accounts_cb_t ctx = opaque;
+  char **accounts;
+  size_t i;
+
+  if (! (serialno || username))
+    /* Finalizing.  */
+    return 0;
+
+  if (strcmp (ctx->serialno, serialno))
+    return 0;
+
+  /* Ignore duplicate entries.  */
+  for (i = 0; i < ctx->n; i++)
+    if (! strcmp (ctx->accounts[i], username))
+      return 0;
+
+  if (ctx->n + 1 >= ctx->size)
+    {
+      accounts = xtryrealloc (ctx->accounts,
+			      sizeof (*accounts) * (ctx->size + 4));
+      if (! accounts)
+	{
+	  ctx->err = gpg_error_from_syserror ();
+	  return 1;
+	}
+      ctx->accounts = accounts;
+      ctx->size += 4;
+    }
+
+  ctx->accounts[ctx->n] = xtrystrdup (username);
+  if (! ctx->accounts[ctx->n])
+    {
+      ctx->err = gpg_error_from_syserror ();
+      return 1;
+    }
+  ctx->accounts[++ctx->n] = NULL;
+
+  return 0;
+}
+
+/* This function looks up all accounts associated with the serial
+   number SERIALNO.  On success, the accounts are stored as newly
+   allocated, NULL-terminated vector in *ACCOUNTS, which is to be
+   released with char_vector_free().  Returns GPG_ERR_NOT_FOUND in
+   case SERIALNO is not associated with any account, other error codes
+   on failure.  Problems with the database are logged through
+   LOGHANDLE.  */
+gpg_error_t
+usersdb_lookup_accounts (const char *serialno, char ***accounts,
+			 log_handle_t loghandle)
+{
+  struct accounts_cb_s ctx = { serialno, NULL, 0, 0, 0 };
+  gpg_error_t err;
+
+  assert (serialno);
+  assert (accounts);
+
+  err = usersdb_query (USERSDB_TABLE_SERIALNO, serialno,
+		       usersdb_accounts_cb, &ctx, loghandle);
+  if (! err)
+    err = ctx.err;
+  if (! err && ! ctx.n)
+    err = gpg_error (GPG_ERR_NOT_FOUND);
+
+  if (err)
+    char_vector_free (ctx.accounts);
+  else
+    *accounts = ctx.accounts;
+
+  return err;
+}
+
 /* END */
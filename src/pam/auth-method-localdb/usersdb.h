@@ -22,6 +22,12 @@
 
 #include <poldi.h>
 
+#include "util/simplelog.h"
+
+/* Flag marking a users database compiled by poldi-usersdb, as opposed
+   to the index maintained automatically by Poldi.  */
+#define USERSDB_COMPILED 1
+
 /* This functions figures out wether the provided (SERIALNO, USERNAME)
    pair is contained in the users database.  */
 gpg_error_t usersdb_check (const char *serialno, const char *username);
@@ -40,4 +46,20 @@ gpg_error_t usersdb_lookup_by_serialno (const char *serialno, char **username);
    error code.  */
 gpg_error_t usersdb_lookup_by_username (const char *username, char **serialno);
 
+/* This function looks up all accounts associated with the serial
+   number SERIALNO.  On success, the accounts are stored as newly
+   allocated, NULL-terminated vector in *ACCOUNTS, which is to be
+   released with char_vector_free().  Returns GPG_ERR_NOT_FOUND in
+   case SERIALNO is not associated with any account, other error codes
+   on failure.  Problems with the database are logged through
+   LOGHANDLE.  */
+gpg_error_t usersdb_lookup_accounts (const char *serialno, char ***accounts,
+				     log_handle_t loghandle);
+
+/* This function compiles the plain text users database USERS_FILE
+   into the constant database DB_FILE, which is marked with FLAGS.
+   DB_FILE is replaced atomically.  Returns proper error code.  */
+gpg_error_t usersdb_compile (const char *users_file, const char *db_file,
+			     unsigned int flags);
+
 #endif /* INCLUDED_USERSDB_H */
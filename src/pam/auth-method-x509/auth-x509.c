@@ -20,6 +20,8 @@
 #include <poldi.h>
 
 #include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>		/* FIXME, so far only required for
 				   old ksba.h. */
 #include <ksba.h>
@@ -29,11 +31,13 @@
 
 #include "scd/scd.h"
 #include "dirmngr.h"
+#include "cert-cache.h"
 #include "conv.h"
 #include "util/util.h"
 #include "util/support.h"
 #include "auth-support/ctx.h"
 #include "auth-support/getpin-cb.h"
+#include "auth-support/phase.h"
 #include "auth-methods.h"
 #include "util/defs.h"
 #include "util/simplelog.h"
@@ -45,6 +49,12 @@ struct x509_ctx_s
 {
   char *x509_domain;
   char *dirmngr_socket;
+  char *cert_cache_dir;		/* NULL means POLDI_CERT_CACHE_DIRECTORY.  */
+  unsigned int cert_cache_ttl;	/* Zero disables the certificate
+				   cache.  */
+  unsigned int cert_cache_size;
+  unsigned int validation_cache_ttl; /* Zero disables caching of
+					validation results.  */
 };
 
 typedef struct x509_ctx_s *x509_ctx_t;
@@ -64,6 +74,10 @@ auth_method_x509_init (void **opaque)
     {
       cookie->x509_domain = NULL;
       cookie->dirmngr_socket = NULL;
+      cookie->cert_cache_dir = NULL;
+      cookie->cert_cache_ttl = 24 * 60 * 60;
+      cookie->cert_cache_size = 256;
+      cookie->validation_cache_ttl = 0;
       err = 0;
     }
 
@@ -83,6 +97,7 @@ auth_method_x509_deinit (void *opaque)
     {
       xfree (cookie->x509_domain);
       xfree (cookie->dirmngr_socket);
+      xfree (cookie->cert_cache_dir);
       xfree (opaque);
     }
 }
@@ -92,7 +107,11 @@ enum opt_ids
   {
     opt_none,
     opt_dirmngr_socket,
-    opt_x509_domain
+    opt_x509_domain,
+    opt_cert_cache_dir,
+    opt_cert_cache_ttl,
+    opt_cert_cache_size,
+    opt_validation_cache_ttl
   };
 
 /* Option specifications. */
@@ -102,9 +121,19 @@ static simpleparse_opt_spec_t x509_opt_specs[] =
       0, SIMPLEPARSE_ARG_REQUIRED, 0, N_("Specify local socket for dirmngr access") },
     { opt_x509_domain, "x509-domain",
       0, SIMPLEPARSE_ARG_REQUIRED, 0, N_("Specify X509 domain for this host") },
+    { opt_cert_cache_dir, "cert-cache-dir",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, N_("Specify directory for caching certificates") },
+    { opt_cert_cache_ttl, "cert-cache-ttl",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, N_("Specify lifetime of cached certificates in seconds") },
+    { opt_cert_cache_size, "cert-cache-size",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, N_("Specify maximum number of cached certificates") },
+    { opt_validation_cache_ttl, "validation-cache-ttl",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, N_("Specify lifetime of cached validation results in seconds") },
     { 0 }
   };
 
+#include "auth-x509-opthash.h"
+
 /* Callback for simpleparse, implements x509-specific options. */
 static gpg_error_t
 auth_method_x509_parsecb (void *opaque, simpleparse_opt_spec_t spec, const char *arg)
@@ -113,9 +142,12 @@ auth_method_x509_parsecb (void *opaque, simpleparse_opt_spec_t spec, const char
   x509_ctx_t x509_ctx = cookie->method_ctx;
   poldi_ctx_t ctx = cookie->poldi_ctx;
   gpg_err_code_t err = GPG_ERR_NO_ERROR;
+  unsigned long value;
+  char *end;
 
-  if (!strcmp (spec.long_opt, "x509-domain"))
+  switch (spec.id)
     {
+    case opt_x509_domain:
       x509_ctx->x509_domain = xtrystrdup (arg);
       if (!x509_ctx->x509_domain)
 	{
@@ -125,9 +157,9 @@ auth_method_x509_parsecb (void *opaque, simpleparse_opt_spec_t spec, const char
 			 strlen (arg), strerror (errno));
 	  err = gpg_error_from_syserror ();
 	}
-    }
-  else if (!strcmp (spec.long_opt, "dirmngr-socket"))
-    {
+      break;
+
+    case opt_dirmngr_socket:
       x509_ctx->dirmngr_socket = xtrystrdup (arg);
       if (!x509_ctx->dirmngr_socket)
 	{
@@ -137,6 +169,42 @@ auth_method_x509_parsecb (void *opaque, simpleparse_opt_spec_t spec, const char
 			 strlen (arg), strerror (errno));
 	  err = gpg_error_from_syserror ();
 	}
+      break;
+
+    case opt_cert_cache_dir:
+      xfree (x509_ctx->cert_cache_dir);
+      x509_ctx->cert_cache_dir = xtrystrdup (arg);
+      if (!x509_ctx->cert_cache_dir)
+	{
+	  log_msg_error (ctx->loghandle,
+			 "failed to duplicate %s (length: %i): %s",
+			 "cert-cache-dir option string",
+			 strlen (arg), strerror (errno));
+	  err = gpg_error_from_syserror ();
+	}
+      break;
+
+    case opt_cert_cache_ttl:
+    case opt_cert_cache_size:
+    case opt_validation_cache_ttl:
+      errno = 0;
+      value = strtoul (arg, &end, 10);
+      if (!*arg || *end || errno || value > UINT_MAX)
+	{
+	  log_msg_error (ctx->loghandle,
+			 "invalid value '%s' for option %s", arg, spec.long_opt);
+	  err = GPG_ERR_INV_VALUE;
+	}
+      else if (spec.id == opt_cert_cache_ttl)
+	x509_ctx->cert_cache_ttl = value;
+      else if (spec.id == opt_cert_cache_size)
+	x509_ctx->cert_cache_size = value;
+      else
+	x509_ctx->validation_cache_ttl = value;
+      break;
+
+    default:
+      break;
     }
 
   return gpg_error (err);
@@ -412,13 +480,105 @@ extract_username_from_cert (poldi_ctx_t ctx, ksba_cert_t cert,
   return err;
 }
 
+/* Lookup the certificate identified by URL in the certificate cache;
+   on a miss look it up through the dirmngr connection identified by
+   DIRMNGR and add it to the cache.  CTX is the Poldi context, COOKIE
+   the x509 method cookie to use.  Stores the certificate in
+   *CERTIFICATE and returns proper error code.  */
+static gpg_error_t
+lookup_cert_cached (poldi_ctx_t ctx, x509_ctx_t cookie,
+		    dirmngr_ctx_t dirmngr, const char *url,
+		    ksba_cert_t *certificate)
+{
+  const unsigned char *fpr;
+  const char *dir;
+  gpg_error_t err, rc;
+
+  if (!cookie->cert_cache_ttl || !cookie->cert_cache_size)
+    return dirmngr_lookup_url (dirmngr, url, certificate);
+
+  /* The key fingerprint is part of the cache key, so that a card
+     which got a new key does not get the certificate of its old
+     key.  */
+  fpr = ctx->cardinfo.fpr3valid ? (unsigned char *) ctx->cardinfo.fpr3 : NULL;
+  dir = cookie->cert_cache_dir ? cookie->cert_cache_dir : POLDI_CERT_CACHE_DIRECTORY;
+
+  err = cert_cache_lookup (dir, cookie->cert_cache_ttl, url, fpr,
+			   certificate, ctx->loghandle);
+  if (!err)
+    {
+      if (ctx->debug)
+	log_msg_debug (ctx->loghandle, "certificate cache hit for '%s'", url);
+      return 0;
+    }
+  if (ctx->debug)
+    log_msg_debug (ctx->loghandle, "certificate cache miss for '%s'", url);
+
+  err = dirmngr_lookup_url (dirmngr, url, certificate);
+  if (err)
+    return err;
+
+  /* Failing to update the cache does not affect the
+     authentication.  */
+  rc = cert_cache_store (dir, cookie->cert_cache_size, url, fpr,
+			 *certificate, ctx->loghandle);
+  if (rc && ctx->debug)
+    log_msg_debug (ctx->loghandle,
+		   "failed to store certificate in cache directory '%s': %s",
+		   dir, gpg_strerror (rc));
+
+  return 0;
+}
+
+/* Validate the certificate CERT through the dirmngr connection
+   identified by DIRMNGR, unless a successful validation not older
+   than the configured maximum age is recorded in the certificate
+   cache.  Only successful validations are recorded.  CTX is the Poldi
+   context, COOKIE the x509 method cookie to use.  Returns zero if
+   CERT is valid, an error code otherwise.  */
+static gpg_error_t
+validate_cert_cached (poldi_ctx_t ctx, x509_ctx_t cookie,
+		      dirmngr_ctx_t dirmngr, ksba_cert_t cert)
+{
+  const char *dir;
+  gpg_error_t err, rc;
+
+  if (!cookie->validation_cache_ttl || !cookie->cert_cache_size)
+    return dirmngr_validate (dirmngr, cert);
+
+  dir = cookie->cert_cache_dir ? cookie->cert_cache_dir : POLDI_CERT_CACHE_DIRECTORY;
+
+  if (!cert_cache_lookup_valid (dir, cookie->validation_cache_ttl,
+				cert, ctx->loghandle))
+    return 0;
+
+  err = dirmngr_validate (dirmngr, cert);
+  if (err)
+    {
+      /* Make sure that an outdated record of a successful validation
+	 does not survive.  */
+      cert_cache_forget_valid (dir, cert);
+      return err;
+    }
+
+  rc = cert_cache_store_valid (dir, cookie->cert_cache_size,
+			       cert, ctx->loghandle);
+  if (rc && ctx->debug)
+    log_msg_debug (ctx->loghandle,
+		   "failed to store validation result in cache directory '%s': %s",
+		   dir, gpg_strerror (rc));
+
+  return 0;
+}
+
 /* Lookup the certificate identified by URL (supported schemes are
    "ldap://" and "file://") through the dirmngr connection identified
    by DIRMNGR and store the certificate in *CERTIFICATE. CTX is the
-   Poldi context to use. Returns proper error code. */
+   Poldi context, COOKIE the x509 method cookie to use. Returns proper
+   error code. */
 static gpg_error_t
-lookup_cert (poldi_ctx_t ctx, dirmngr_ctx_t dirmngr, const char *url,
-	     ksba_cert_t *certificate)
+lookup_cert (poldi_ctx_t ctx, x509_ctx_t cookie, dirmngr_ctx_t dirmngr,
+	     const char *url, ksba_cert_t *certificate)
 {
   ksba_cert_t cert;
   gpg_error_t err;
@@ -433,7 +593,7 @@ lookup_cert (poldi_ctx_t ctx, dirmngr_ctx_t dirmngr, const char *url,
     }
 
   if (strncmp (url, "ldap://", 7) == 0)
-    err = dirmngr_lookup_url (dirmngr, url, &cert);
+    err = lookup_cert_cached (ctx, cookie, dirmngr, url, &cert);
   else if (strncmp (ctx->cardinfo.pubkey_url, "file://", 7) == 0)
     err = lookup_cert_from_file (ctx->cardinfo.pubkey_url + 7, &cert);
   else
@@ -457,6 +617,82 @@ lookup_cert (poldi_ctx_t ctx, dirmngr_ctx_t dirmngr, const char *url,
 
 
 
+/* The certificate of the card is looked up and validated in a
+   thread of its own, while the card signs the challenge, which
+   usually includes waiting for the user to enter the PIN.  This
+   hides the Dirmngr latency.  */
+struct cert_job
+{
+  poldi_ctx_t ctx;
+  x509_ctx_t cookie;
+  ksba_cert_t cert;		/* Result.  */
+  gpg_error_t err;		/* Result.  */
+};
+
+/* Look up and validate the certificate of the card for the
+   certificate job OPAQUE.  The results are stored in the job.  */
+static void *
+cert_job_run (void *opaque)
+{
+  struct cert_job *job = opaque;
+  poldi_ctx_t ctx = job->ctx;
+  dirmngr_ctx_t dirmngr;
+  ksba_cert_t cert;
+  gpg_error_t err;
+  uint64_t start;
+
+  dirmngr = NULL;
+  cert = NULL;
+
+  /*** Connect to Dirmngr. ***/
+
+  err = dirmngr_connect (&dirmngr, job->cookie->dirmngr_socket,
+			 DIRMNGR_FLAG_POOL, ctx->loghandle);
+  if (err)
+    goto out;
+
+  if (ctx->debug)
+    log_msg_debug (ctx->loghandle,
+		   "public key url is '%s'", ctx->cardinfo.pubkey_url);
+
+  /*** Fetch certificate. ***/
+
+  start = stats_now ();
+  err = lookup_cert (ctx, job->cookie, dirmngr, ctx->cardinfo.pubkey_url, &cert);
+  phase_record (ctx, STATS_PHASE_CERT_LOOKUP, start);
+  if (err)
+    {
+      log_msg_error (ctx->loghandle,
+		     "failed to look up certificate `%s': %s",
+		     ctx->cardinfo.pubkey_url, gpg_strerror (err));
+      goto out;
+    }
+
+  /*** Valide cert. ***/
+
+  /* FIXME: implement mechanism which allows for specifying the
+     issuer? -mo */
+
+  start = stats_now ();
+  err = validate_cert_cached (ctx, job->cookie, dirmngr, cert);
+  phase_record (ctx, STATS_PHASE_CERT_VALIDATE, start);
+
+ out:
+
+  dirmngr_disconnect (dirmngr);
+
+  if (err)
+    {
+      ksba_cert_release (cert);
+      cert = NULL;
+    }
+
+  job->cert = cert;
+  job->err = err;
+
+  return NULL;
+}
+
 /* Entry point for the x509 authentication method. Returns TRUE (1) if
    authentication succeeded and FALSE (0) otherwise. */
 static int
@@ -470,14 +706,20 @@ auth_method_x509_auth_do (poldi_ctx_t ctx, x509_ctx_t cookie,
   size_t response_n;
   gpg_error_t err;
   char *card_username;
-  ksba_cert_t cert;
-  dirmngr_ctx_t dirmngr;
+  struct cert_job job;
+  pthread_t thread;
+  int thread_running;
+  uint64_t start;
+  int ret;
 
-  dirmngr = NULL;
   challenge = NULL;
   response = NULL;
   card_username = NULL;
-  cert = NULL;
+  job.ctx = ctx;
+  job.cookie = cookie;
+  job.cert = NULL;
+  job.err = 0;
+  thread_running = 0;
   err = 0;
 
   /*** Sanity checks. ***/
@@ -490,45 +732,62 @@ auth_method_x509_auth_do (poldi_ctx_t ctx, x509_ctx_t cookie,
       goto out;
     }
 
-  /*** Connect to Dirmngr. ***/
+  /*** Generate challenge. ***/
 
-  err = dirmngr_connect (&dirmngr, cookie->dirmngr_socket, 0, ctx->loghandle);
+  err = challenge_generate (&challenge, &challenge_n);
   if (err)
-    goto out;
+    {
+      log_msg_error (ctx->loghandle, "failed to generate challenge: %s",
+		     gpg_strerror (err));
+      goto out;
+    }
 
-  // /*** Receive card info. ***/
+  /*** Fetch and validate certificate. ***/
 
-  if (ctx->debug)
-    log_msg_debug (ctx->loghandle,
-		   "public key url is '%s'", ctx->cardinfo.pubkey_url);
+  ret = pthread_create (&thread, NULL, cert_job_run, &job);
+  if (ret)
+    {
+      /* Do it the sequential way.  */
+      if (ctx->debug)
+	log_msg_debug (ctx->loghandle,
+		       "failed to create thread for certificate lookup: %s",
+		       strerror (ret));
+      cert_job_run (&job);
+    }
+  else
+    thread_running = 1;
 
-  /*** Fetch certificate. ***/
+  /*** Let card sign the challenge. ***/
 
-  err = lookup_cert (ctx, dirmngr, ctx->cardinfo.pubkey_url, &cert);
+  start = stats_now ();
+  err = scd_pksign (ctx->scd, "OPENPGP.3",
+		    challenge, challenge_n,
+		    &response, &response_n);
+  phase_record (ctx, STATS_PHASE_PKSIGN, start);
   if (err)
     {
       log_msg_error (ctx->loghandle,
-		     "failed to look up certificate `%s': %s",
-		     ctx->cardinfo.pubkey_url, gpg_strerror (err));
+		     "failed to retrieve challenge signature from card: %s",
+		     gpg_strerror (err));
       goto out;
     }
 
-  /*** Valide cert. ***/
-
-  /* FIXME: implement mechanism which allows for specifying the
-     issuer? -mo */
-
-  err = dirmngr_validate (dirmngr, cert);
+  if (thread_running)
+    {
+      pthread_join (thread, NULL);
+      thread_running = 0;
+    }
+  err = job.err;
   if (err)
     goto out;
 
   /*** Check username. ***/
 
-  err = extract_username_from_cert (ctx, cert, cookie->x509_domain, &card_username);
+  err = extract_username_from_cert (ctx, job.cert, cookie->x509_domain,
+				    &card_username);
   if (err)
     goto out;
 
-
   if (username_desired)
     {
       /* Application wants us to authenticate the user as
@@ -543,33 +802,13 @@ auth_method_x509_auth_do (poldi_ctx_t ctx, x509_ctx_t cookie,
 	}
     }
 
-  /*** Generate challenge. ***/
-
-  err = challenge_generate (&challenge, &challenge_n);
-  if (err)
-    {
-      log_msg_error (ctx->loghandle, "failed to generate challenge: %s",
-		     gpg_strerror (err));
-      goto out;
-    }
-
-  /*** Let card sign the challenge. ***/
-  err = scd_pksign (ctx->scd, "OPENPGP.3",
-		    challenge, challenge_n,
-		    &response, &response_n);
-  if (err)
-    {
-      log_msg_error (ctx->loghandle,
-		     "failed to retrieve challenge signature from card: %s",
-		     gpg_strerror (err));
-      goto out;
-    }
-
   /*** Verify challenge signature against certificate. ***/
 
-  err = verify_challenge_sig (ctx, cert,
+  start = stats_now ();
+  err = verify_challenge_sig (ctx, job.cert,
 			      challenge, challenge_n,
 			      response, response_n);
+  phase_record (ctx, STATS_PHASE_VERIFY, start);
   if (err)
     {
       log_msg_error (ctx->loghandle, "failed to verify challenge signature");
@@ -584,8 +823,11 @@ auth_method_x509_auth_do (poldi_ctx_t ctx, x509_ctx_t cookie,
  out:
 
   /* Release resources.  */
-  dirmngr_disconnect (dirmngr);
-  ksba_cert_release (cert);
+  if (thread_running)
+    pthread_join (thread, NULL);
+  ksba_cert_release (job.cert);
+  challenge_release (challenge);
+  xfree (response);
 
   if (err)
     xfree (card_username);
@@ -629,6 +871,8 @@ struct auth_method_s auth_method_x509 =
     auth_method_x509_auth,
     auth_method_x509_auth_as,
     x509_opt_specs,
+    &x509_opt_specs_hash,
     auth_method_x509_parsecb,
-    POLDI_CONF_DIRECTORY "/" "poldi-x509.conf"
+    POLDI_CONF_DIRECTORY "/" "poldi-x509.conf",
+    SCD_ATTR_SERIALNO | SCD_ATTR_PUBKEY_URL | SCD_ATTR_KEY_FPR
   };
@@ -0,0 +1,580 @@
+/* cert-cache.c - On-disk certificate cache for Poldi
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <poldi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <gcrypt.h>
+#include <ksba.h>
+
+#include "cert-cache.h"
+#include "util/util.h"
+
+#ifndef O_NOFOLLOW
+# define O_NOFOLLOW 0
+#endif
+
+/* Length of the hex encoded cache key.  */
+#define KEY_LEN (2 * 20)
+
+/* Suffix of entries recording a successful validation.  */
+#define VALID_SUFFIX ".valid"
+
+/* Maximum length of the name of a cache entry.  */
+#define NAME_LEN (KEY_LEN + sizeof (VALID_SUFFIX) - 1)
+
+/* Certificates larger than this are neither cached nor read from
+   the cache.  */
+#define MAX_CERT_SIZE (64 * 1024)
+
+/* Prefix of temporary files, see write_entry().  */
+#define TMP_PREFIX "tmp-"
+
+/* Temporary files older than this many seconds are leftovers of
+   writers which died before renaming them into place.  */
+#define TMP_MAX_AGE (60 * 60)
+
+/* A cache entry, as collected for expiry.  */
+struct cache_entry
+{
+  char name[NAME_LEN + 1];
+  time_t mtime;
+};
+
+/* Number of validation cache hits and misses in this process.  */
+static unsigned long valid_hits, valid_misses;
+static pthread_mutex_t valid_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Store the name of the cache entry for the certificate identified
+   by URL and FPR in NAME, which must have room for NAME_LEN + 1
+   bytes.  Returns proper error code.  */
+static gpg_error_t
+cert_entry_name (const char *url, const unsigned char *fpr, char *name)
+{
+  unsigned char digest[20];
+  gcry_md_hd_t md;
+  gpg_error_t err;
+
+  err = gcry_md_open (&md, GCRY_MD_SHA1, 0);
+  if (err)
+    return err;
+
+  /* The URL is terminated by a nul byte, so that no pair of URL and
+     fingerprint may be mistaken for another one.  */
+  gcry_md_write (md, url, strlen (url) + 1);
+  if (fpr)
+    gcry_md_write (md, fpr, 20);
+  memcpy (digest, gcry_md_read (md, GCRY_MD_SHA1), sizeof (digest));
+  gcry_md_close (md);
+
+  bin2hex (digest, sizeof (digest), name);
+
+  return 0;
+}
+
+/* Store the name of the entry recording a successful validation of
+   CERT in NAME, which must have room for NAME_LEN + 1 bytes.  The
+   name is derived from the fingerprint of CERT.  Returns proper error
+   code.  */
+static gpg_error_t
+valid_entry_name (ksba_cert_t cert, char *name)
+{
+  unsigned char digest[20];
+  const unsigned char *image;
+  size_t image_n;
+
+  image = ksba_cert_get_image (cert, &image_n);
+  if (!image || !image_n)
+    return gpg_error (GPG_ERR_INV_CERT_OBJ);
+
+  gcry_md_hash_buffer (GCRY_MD_SHA1, digest, image, image_n);
+  bin2hex (digest, sizeof (digest), name);
+  strcpy (name + KEY_LEN, VALID_SUFFIX);
+
+  return 0;
+}
+
+/* Return true if NAME looks like the name of a cache entry.  */
+static int
+entry_name_p (const char *name)
+{
+  int i;
+
+  for (i = 0; i < KEY_LEN; i++)
+    if (!hexdigitp (name + i))
+      return 0;
+
+  return !name[i] || !strcmp (name + i, VALID_SUFFIX);
+}
+
+/* Return true if NAME looks like the name of a temporary file.  */
+static int
+tmp_name_p (const char *name)
+{
+  return (!strncmp (name, TMP_PREFIX, strlen (TMP_PREFIX))
+	  && strlen (name) == strlen (TMP_PREFIX) + 6);
+}
+
+/* Store the newly allocated path of the cache entry NAME in DIRECTORY
+   in *PATH.  Returns proper error code.  */
+static gpg_error_t
+entry_path (const char *directory, const char *name, char **path)
+{
+  char *p;
+
+  p = xtrymalloc (strlen (directory) + 1 + strlen (name) + 1);
+  if (!p)
+    return gpg_error_from_syserror ();
+  sprintf (p, "%s/%s", directory, name);
+
+  *path = p;
+
+  return 0;
+}
+
+/* Open the cache entry NAME in DIRECTORY for reading, provided that
+   it is not older than TTL seconds.  Stores the file descriptor in
+   *FD and its status in *ST.  Returns GPG_ERR_NOT_FOUND if there is
+   no usable entry.  */
+static gpg_error_t
+open_entry (const char *directory, const char *name, unsigned int ttl,
+	    int *fd, struct stat *st, log_handle_t loghandle)
+{
+  gpg_error_t err;
+  char *path;
+  time_t now;
+  int d;
+
+  path = NULL;
+  d = -1;
+
+  err = entry_path (directory, name, &path);
+  if (err)
+    goto out;
+
+  d = open (path, O_RDONLY | O_NOFOLLOW);
+  if (d == -1)
+    {
+      err = gpg_error (GPG_ERR_NOT_FOUND);
+      goto out;
+    }
+
+  if (fstat (d, st))
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+
+  /* Only trust entries which could have been written by us or by
+     root.  */
+  if (!S_ISREG (st->st_mode)
+      || (st->st_uid != geteuid () && st->st_uid != 0)
+      || (st->st_mode & (S_IWGRP | S_IWOTH)))
+    {
+      log_msg_debug (loghandle,
+		     "ignoring certificate cache entry `%s': bad ownership or mode",
+		     path);
+      err = gpg_error (GPG_ERR_NOT_FOUND);
+      goto out;
+    }
+
+  /* An entry from the future cannot be aged, e.g. after the clock
+     has been set back.  */
+  now = time (NULL);
+  if (st->st_mtime > now || now - st->st_mtime >= ttl)
+    {
+      log_msg_debug (loghandle,
+		     "certificate cache entry `%s' has expired", path);
+      err = gpg_error (GPG_ERR_NOT_FOUND);
+      goto out;
+    }
+
+  *fd = d;
+
+ out:
+
+  if (err && d != -1)
+    close (d);
+  xfree (path);
+
+  return err;
+}
+
+gpg_error_t
+cert_cache_lookup (const char *directory, unsigned int ttl,
+		   const char *url, const unsigned char *fpr,
+		   ksba_cert_t *cert, log_handle_t loghandle)
+{
+  char name[NAME_LEN + 1];
+  unsigned char *data;
+  struct stat st;
+  ksba_cert_t c;
+  gpg_error_t err;
+  ssize_t ret;
+  size_t n;
+  int fd;
+
+  data = NULL;
+  c = NULL;
+  fd = -1;
+
+  err = cert_entry_name (url, fpr, name);
+  if (err)
+    goto out;
+
+  err = open_entry (directory, name, ttl, &fd, &st, loghandle);
+  if (err)
+    goto out;
+
+  if (!st.st_size || st.st_size > MAX_CERT_SIZE)
+    {
+      err = gpg_error (GPG_ERR_NOT_FOUND);
+      goto out;
+    }
+
+  data = xtrymalloc (st.st_size);
+  if (!data)
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+
+  for (n = 0; n < (size_t) st.st_size; n += ret)
+    {
+      ret = read (fd, data + n, st.st_size - n);
+      if (ret == -1 && errno == EINTR)
+	ret = 0;
+      else if (ret == -1)
+	{
+	  err = gpg_error_from_syserror ();
+	  goto out;
+	}
+      else if (ret == 0)
+	break;
+    }
+
+  err = ksba_cert_new (&c);
+  if (err)
+    goto out;
+
+  /* Entries are replaced atomically, thus a short or damaged entry
+     is a leftover of a crash; it is simply treated as a miss.  */
+  if (n != (size_t) st.st_size || ksba_cert_init_from_mem (c, data, n))
+    {
+      log_msg_debug (loghandle,
+		     "ignoring damaged certificate cache entry `%s'", name);
+      err = gpg_error (GPG_ERR_NOT_FOUND);
+      goto out;
+    }
+
+  *cert = c;
+
+ out:
+
+  if (err)
+    ksba_cert_release (c);
+  if (fd != -1)
+    close (fd);
+  xfree (data);
+
+  return err;
+}
+
+/* Compare cache entries by modification time, oldest first.  */
+static int
+entry_cmp (const void *a, const void *b)
+{
+  const struct cache_entry *ea = a;
+  const struct cache_entry *eb = b;
+
+  return (ea->mtime > eb->mtime) - (ea->mtime < eb->mtime);
+}
+
+/* Remove the oldest entries from the cache directory DIRECTORY until
+   at most SIZE entries remain.  Stale temporary files are removed as
+   well.  Returns proper error code.  */
+static gpg_error_t
+expire_entries (const char *directory, unsigned int size,
+		log_handle_t loghandle)
+{
+  struct cache_entry *entries, *tmp;
+  size_t entries_n, entries_size;
+  struct dirent *dirent;
+  struct stat st;
+  gpg_error_t err;
+  time_t now;
+  DIR *dir;
+  size_t i;
+
+  entries = NULL;
+  entries_n = entries_size = 0;
+  err = 0;
+
+  dir = opendir (directory);
+  if (!dir)
+    return gpg_error_from_syserror ();
+
+  now = time (NULL);
+  while ((dirent = readdir (dir)))
+    {
+      if (tmp_name_p (dirent->d_name))
+	{
+	  /* Recent temporary files may still be written to.  */
+	  if (!fstatat (dirfd (dir), dirent->d_name, &st, AT_SYMLINK_NOFOLLOW)
+	      && S_ISREG (st.st_mode) && st.st_mtime <= now - TMP_MAX_AGE
+	      && unlinkat (dirfd (dir), dirent->d_name, 0) && errno != ENOENT)
+	    log_msg_debug (loghandle,
+			   "failed to remove temporary file `%s': %s",
+			   dirent->d_name, strerror (errno));
+	  continue;
+	}
+      if (!entry_name_p (dirent->d_name))
+	continue;
+      if (fstatat (dirfd (dir), dirent->d_name, &st, AT_SYMLINK_NOFOLLOW))
+	continue;
+
+      if (entries_n == entries_size)
+	{
+	  entries_size = entries_size ? 2 * entries_size : 64;
+	  tmp = xtryrealloc (entries, entries_size * sizeof (*entries));
+	  if (!tmp)
+	    {
+	      err = gpg_error_from_syserror ();
+	      goto out;
+	    }
+	  entries = tmp;
+	}
+
+      strcpy (entries[entries_n].name, dirent->d_name);
+      entries[entries_n].mtime = st.st_mtime;
+      entries_n++;
+    }
+
+  if (entries_n <= size)
+    goto out;
+
+  qsort (entries, entries_n, sizeof (*entries), entry_cmp);
+  for (i = 0; i < entries_n - size; i++)
+    {
+      if (unlinkat (dirfd (dir), entries[i].name, 0) && errno != ENOENT)
+	log_msg_debug (loghandle,
+		       "failed to remove certificate cache entry `%s': %s",
+		       entries[i].name, strerror (errno));
+    }
+
+ out:
+
+  closedir (dir);
+  xfree (entries);
+
+  return err;
+}
+
+/* Write DATA/DATA_N to the cache entry NAME in DIRECTORY, replacing
+   an existing entry atomically.  Afterwards, expire entries so that at
+   most SIZE entries remain.  Returns proper error code.  */
+static gpg_error_t
+write_entry (const char *directory, unsigned int size, const char *name,
+	     const void *data, size_t data_n, log_handle_t loghandle)
+{
+  char *path, *tmppath;
+  gpg_error_t err;
+  ssize_t ret;
+  int created;
+  size_t n;
+  int fd;
+
+  path = tmppath = NULL;
+  created = 0;
+  fd = -1;
+
+  err = entry_path (directory, name, &path);
+  if (err)
+    goto out;
+
+  if (mkdir (directory, 0755) && errno != EEXIST)
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+
+  /* The new entry is written to a temporary file in the same
+     directory and renamed into place afterwards, so that concurrent
+     lookups either see the old or the new entry.  */
+  tmppath = xtrymalloc (strlen (directory) + 12);
+  if (!tmppath)
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+  sprintf (tmppath, "%s/" TMP_PREFIX "XXXXXX", directory);
+
+  fd = mkstemp (tmppath);
+  if (fd == -1)
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+  created = 1;
+
+  if (fchmod (fd, 0644))
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+
+  for (n = 0; n < data_n; n += ret)
+    {
+      ret = write (fd, (const char *) data + n, data_n - n);
+      if (ret == -1 && errno == EINTR)
+	ret = 0;
+      else if (ret == -1)
+	{
+	  err = gpg_error_from_syserror ();
+	  goto out;
+	}
+    }
+
+  if (close (fd))
+    {
+      fd = -1;
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+  fd = -1;
+
+  if (rename (tmppath, path))
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+  created = 0;
+
+  log_msg_debug (loghandle, "stored certificate cache entry `%s'", path);
+
+  err = expire_entries (directory, size, loghandle);
+
+ out:
+
+  if (fd != -1)
+    close (fd);
+  if (created)
+    unlink (tmppath);
+  xfree (tmppath);
+  xfree (path);
+
+  return err;
+}
+
+gpg_error_t
+cert_cache_store (const char *directory, unsigned int size,
+		  const char *url, const unsigned char *fpr,
+		  ksba_cert_t cert, log_handle_t loghandle)
+{
+  char name[NAME_LEN + 1];
+  const unsigned char *image;
+  size_t image_n;
+  gpg_error_t err;
+
+  image = ksba_cert_get_image (cert, &image_n);
+  if (!image || !image_n || image_n > MAX_CERT_SIZE)
+    return gpg_error (GPG_ERR_INV_CERT_OBJ);
+
+  err = cert_entry_name (url, fpr, name);
+  if (err)
+    return err;
+
+  return write_entry (directory, size, name, image, image_n, loghandle);
+}
+
+
+
+/* Validation results.  A successful validation of a certificate is
+   recorded as an empty entry, whose modification time is the time of
+   the validation.  Failed validations are never recorded.  */
+
+gpg_error_t
+cert_cache_lookup_valid (const char *directory, unsigned int ttl,
+			 ksba_cert_t cert, log_handle_t loghandle)
+{
+  char name[NAME_LEN + 1];
+  unsigned long hits, misses;
+  struct stat st;
+  gpg_error_t err;
+  int fd;
+
+  *name = 0;
+  err = valid_entry_name (cert, name);
+  if (!err)
+    err = open_entry (directory, name, ttl, &fd, &st, loghandle);
+  if (!err)
+    close (fd);
+
+  pthread_mutex_lock (&valid_stats_lock);
+  if (err)
+    valid_misses++;
+  else
+    valid_hits++;
+  hits = valid_hits;
+  misses = valid_misses;
+  pthread_mutex_unlock (&valid_stats_lock);
+
+  log_msg_debug (loghandle, "validation cache %s for `%s' (hits: %lu, misses: %lu)",
+		 err ? "miss" : "hit", name, hits, misses);
+
+  return err;
+}
+
+gpg_error_t
+cert_cache_store_valid (const char *directory, unsigned int size,
+			ksba_cert_t cert, log_handle_t loghandle)
+{
+  char name[NAME_LEN + 1];
+  gpg_error_t err;
+
+  err = valid_entry_name (cert, name);
+  if (err)
+    return err;
+
+  return write_entry (directory, size, name, NULL, 0, loghandle);
+}
+
+void
+cert_cache_forget_valid (const char *directory, ksba_cert_t cert)
+{
+  char name[NAME_LEN + 1];
+  char *path;
+
+  if (valid_entry_name (cert, name) || entry_path (directory, name, &path))
+    return;
+
+  unlink (path);
+  xfree (path);
+}
@@ -0,0 +1,67 @@
+/* cert-cache.h - On-disk certificate cache for Poldi
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#ifndef CERT_CACHE_H
+#define CERT_CACHE_H
+
+#include <gpg-error.h>
+#include <stdio.h>
+#include <ksba.h>
+
+#include "util/simplelog.h"
+
+/* Cached certificates are identified by the public key URL stored on
+   the card together with the fingerprint of the card's
+   authentication key (20 bytes, may be NULL).  Each certificate is
+   stored in DIRECTORY in a file of its own, named after the SHA1 hash
+   of this pair.  */
+
+/* Look up the certificate for URL and FPR in the cache directory
+   DIRECTORY.  Entries older than TTL seconds are ignored.  On success
+   the certificate is stored in *CERT.  Returns GPG_ERR_NOT_FOUND if
+   no usable entry exists.  */
+gpg_error_t cert_cache_lookup (const char *directory, unsigned int ttl,
+			       const char *url, const unsigned char *fpr,
+			       ksba_cert_t *cert, log_handle_t loghandle);
+
+/* Store CERT for URL and FPR in the cache directory DIRECTORY,
+   replacing an existing entry atomically.  If the cache holds more
+   than SIZE entries afterwards, the oldest ones are removed.  Returns
+   proper error code.  */
+gpg_error_t cert_cache_store (const char *directory, unsigned int size,
+			      const char *url, const unsigned char *fpr,
+			      ksba_cert_t cert, log_handle_t loghandle);
+
+/* Return zero if a successful validation of CERT, not older than
+   TTL seconds, is recorded in the cache directory DIRECTORY and
+   GPG_ERR_NOT_FOUND otherwise.  */
+gpg_error_t cert_cache_lookup_valid (const char *directory, unsigned int ttl,
+				     ksba_cert_t cert, log_handle_t loghandle);
+
+/* Record a successful validation of CERT in the cache directory
+   DIRECTORY, expiring entries as for cert_cache_store.  Returns
+   proper error code.  */
+gpg_error_t cert_cache_store_valid (const char *directory, unsigned int size,
+				    ksba_cert_t cert, log_handle_t loghandle);
+
+/* Remove a recorded validation of CERT from the cache directory
+   DIRECTORY.  */
+void cert_cache_forget_valid (const char *directory, ksba_cert_t cert);
+
+#endif
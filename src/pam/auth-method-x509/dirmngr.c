@@ -27,9 +27,11 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h> 
+#include <fcntl.h>
 #include <time.h>
 #include <assert.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include <gcrypt.h>
 #include <ksba.h>
@@ -49,6 +51,10 @@ struct dirmngr_ctx_s
   assuan_context_t assuan;	/* Assuan context for accessing
 				   dirmngr. */
   log_handle_t log_handle;	/* Handle for logging messages. */
+  char *sock;			/* Socket name, if the connection
+				   may be pooled. */
+  int broken;			/* True if the connection must not be
+				   reused. */
 };
 
 /* This structure is used for passing data to the "data callback"
@@ -66,6 +72,171 @@ struct lookup_parm_s {
 static struct dirmngr_ctx_s dirmngr_ctx_init; /* For initialization
 						 purpose. */
 
+/* Close the dirmngr connection associated with CTX and release all
+   related resources, regardless of pooling.  */
+static void
+dirmngr_release (dirmngr_ctx_t ctx)
+{
+  if (ctx->assuan)
+    assuan_disconnect (ctx->assuan);
+  xfree (ctx->sock);
+  xfree (ctx);
+}
+
+/* Release CTX, which has been inherited through fork, without talking
+   to dirmngr: the connection still belongs to the parent, only our
+   copy of its descriptor is closed.  */
+static void
+dirmngr_abandon (dirmngr_ctx_t ctx)
+{
+  if (ctx->assuan)
+    assuan_deinit_server (ctx->assuan);
+  xfree (ctx->sock);
+  xfree (ctx);
+}
+
+
+
+/*
+ * Connection pool.  Processes which authenticate many users keep
+ * idle dirmngr connections around instead of connecting for every
+ * authentication.  Pooled connections are checked with a NOP before
+ * they are handed out again and closed after having been idle for
+ * DIRMNGR_POOL_IDLE seconds.
+ */
+
+/* Maximum number of idle connections.  */
+#define DIRMNGR_POOL_SIZE 4
+
+/* Maximum idle time of a pooled connection in seconds.  */
+#define DIRMNGR_POOL_IDLE 60
+
+struct dirmngr_pool_entry
+{
+  dirmngr_ctx_t ctx;		/* NULL if entry is unused.  */
+  time_t idle_since;
+  pid_t pid;			/* Process which owns the connection.  */
+};
+
+static struct dirmngr_pool_entry dirmngr_pool[DIRMNGR_POOL_SIZE];
+static pthread_mutex_t dirmngr_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Remove expired connections from the pool and store them in EXPIRED,
+   which must have room for DIRMNGR_POOL_SIZE entries.  Returns the
+   number of expired connections.  Must be called with the pool
+   locked.  */
+static int
+dirmngr_pool_expire (dirmngr_ctx_t *expired)
+{
+  time_t now = time (NULL);
+  int i, n;
+
+  for (i = n = 0; i < DIRMNGR_POOL_SIZE; i++)
+    {
+      if (!dirmngr_pool[i].ctx)
+	continue;
+
+      if (dirmngr_pool[i].pid != getpid ())
+	{
+	  /* Inherited through fork; the connection belongs to the
+	     parent, thus it must not be used or shut down here.  */
+	  dirmngr_abandon (dirmngr_pool[i].ctx);
+	  dirmngr_pool[i].ctx = NULL;
+	}
+      else if (now - dirmngr_pool[i].idle_since >= DIRMNGR_POOL_IDLE)
+	{
+	  expired[n++] = dirmngr_pool[i].ctx;
+	  dirmngr_pool[i].ctx = NULL;
+	}
+    }
+
+  return n;
+}
+
+/* Take an idle connection to the socket SOCK out of the pool.
+   Returns NULL if there is none.  */
+static dirmngr_ctx_t
+dirmngr_pool_get (const char *sock)
+{
+  dirmngr_ctx_t expired[DIRMNGR_POOL_SIZE];
+  dirmngr_ctx_t ctx;
+  int i, n;
+
+  ctx = NULL;
+
+  pthread_mutex_lock (&dirmngr_pool_lock);
+  n = dirmngr_pool_expire (expired);
+  for (i = 0; i < DIRMNGR_POOL_SIZE; i++)
+    if (dirmngr_pool[i].ctx && !strcmp (dirmngr_pool[i].ctx->sock, sock))
+      {
+	ctx = dirmngr_pool[i].ctx;
+	dirmngr_pool[i].ctx = NULL;
+	break;
+      }
+  pthread_mutex_unlock (&dirmngr_pool_lock);
+
+  for (i = 0; i < n; i++)
+    dirmngr_release (expired[i]);
+
+  return ctx;
+}
+
+/* Put the idle connection CTX into the pool, replacing the connection
+   which has been idle for the longest time if the pool is full.  */
+static void
+dirmngr_pool_put (dirmngr_ctx_t ctx)
+{
+  dirmngr_ctx_t expired[DIRMNGR_POOL_SIZE + 1];
+  struct dirmngr_pool_entry *entry;
+  int i, n;
+
+  ctx->log_handle = NULL;
+
+  pthread_mutex_lock (&dirmngr_pool_lock);
+  n = dirmngr_pool_expire (expired);
+  entry = &dirmngr_pool[0];
+  for (i = 0; i < DIRMNGR_POOL_SIZE; i++)
+    {
+      if (!dirmngr_pool[i].ctx)
+	{
+	  entry = &dirmngr_pool[i];
+	  break;
+	}
+      if (dirmngr_pool[i].idle_since < entry->idle_since)
+	entry = &dirmngr_pool[i];
+    }
+  if (entry->ctx)
+    expired[n++] = entry->ctx;
+  entry->ctx = ctx;
+  entry->idle_since = time (NULL);
+  entry->pid = getpid ();
+  pthread_mutex_unlock (&dirmngr_pool_lock);
+
+  for (i = 0; i < n; i++)
+    dirmngr_release (expired[i]);
+}
+
+#ifdef __GNUC__
+/* Close pooled connections when the PAM module gets unloaded.  */
+static void __attribute__ ((destructor))
+dirmngr_pool_cleanup (void)
+{
+  int i;
+
+  for (i = 0; i < DIRMNGR_POOL_SIZE; i++)
+    if (dirmngr_pool[i].ctx)
+      {
+	if (dirmngr_pool[i].pid == getpid ())
+	  dirmngr_release (dirmngr_pool[i].ctx);
+	else
+	  dirmngr_abandon (dirmngr_pool[i].ctx);
+	dirmngr_pool[i].ctx = NULL;
+      }
+}
+#endif
+
+
+
 /* Connect to a running dirmngr through the local socket named by
    SOCK, using LOG_HANDLE as logging handle and flags FLAGS. The new
    context is stored in *CTX.  Returns proper error code. */
@@ -76,7 +247,32 @@ dirmngr_connect (dirmngr_ctx_t *ctx,
 		 log_handle_t log_handle)
 {
   dirmngr_ctx_t context;
+  assuan_fd_t fds[2];
   gpg_error_t err;
+  int i, n;
+
+  if (flags & DIRMNGR_FLAG_POOL)
+    {
+      /* Try idle connections first, discarding those which do not
+	 answer properly anymore.  */
+      while ((context = dirmngr_pool_get (sock)))
+	{
+	  context->log_handle = log_handle;
+	  err = assuan_transact (context->assuan, "NOP",
+				 NULL, NULL, NULL, NULL, NULL, NULL);
+	  if (!err)
+	    {
+	      log_msg_debug (log_handle, "reusing pooled dirmngr connection");
+	      *ctx = context;
+	      return 0;
+	    }
+
+	  log_msg_debug (log_handle,
+			 "discarding pooled dirmngr connection: %s",
+			 gpg_strerror (err));
+	  dirmngr_release (context);
+	}
+    }
 
   /* Allocate.  */
   context = xtrymalloc (sizeof (*context));
@@ -94,9 +290,20 @@ dirmngr_connect (dirmngr_ctx_t *ctx,
   if (err)
     goto out;
 
+  /* Pooled connections outlive the authentication, so they must not
+     leak into programs executed later on.  */
+  n = assuan_get_active_fds (context->assuan, 0, fds, DIM (fds));
+  for (i = 0; i < n; i++)
+    fcntl (fds[i], F_SETFD, fcntl (fds[i], F_GETFD) | FD_CLOEXEC);
+
   /* Install logging handle in new context. */
   context->log_handle = log_handle;
 
+  /* Without a copy of the socket name, the connection is simply not
+     pooled.  */
+  if (flags & DIRMNGR_FLAG_POOL)
+    context->sock = xtrystrdup (sock);
+
   *ctx = context;
 
  out:
@@ -114,14 +321,15 @@ dirmngr_disconnect (dirmngr_ctx_t ctx)
 {
   if (ctx)
     {
-      if (ctx->assuan)
-	assuan_disconnect (ctx->assuan);
-      xfree (ctx);
+      if (ctx->sock && ctx->assuan && !ctx->broken)
+	dirmngr_pool_put (ctx);
+      else
+	dirmngr_release (ctx);
     }
 }
 
 
-
+
 
 /* Communication structure for the certificate inquire callback. For
    the assuan VALIDATE command. */
@@ -149,13 +357,11 @@ inq_cert (void *opaque, const char *line)
 	   || (!strncmp (line, "SENDISSUERCERT", 14) && (line[14] == ' ' || !line[14])))
     {
       /* We don't support this but dirmngr might ask for it.  So
-	 simply ignore it by sending back an empty value. */
+	 simply ignore it by sending back an empty value; the END
+	 terminating it is sent by assuan_transact, sending it here
+	 as well would leave a stray END on the connection. */
       log_msg_debug (parm->ctx->log_handle, "ignored inquiry from dirmngr: `%s'", line);
-      err = assuan_send_data (parm->ctx->assuan, NULL, 0);
-      if (err)
-	log_msg_error (parm->ctx->log_handle,
-		       "failed to send back empty value to dirmngr: %s",
-		       gpg_strerror (err));
+      err = 0;
     }
   else
     {
@@ -167,9 +373,26 @@ inq_cert (void *opaque, const char *line)
          change in future. */
     }
 
+  if (err)
+    /* The inquiry has been aborted.  */
+    parm->ctx->broken = 1;
+
   return err;
 }
 
+/* Return true if ERR, as returned by assuan_transact, means that the
+   connection is gone or out of sync, as opposed to an error reported
+   by dirmngr, after which the connection can still be used.
+   libassuan maps codes below 100 in ERR lines to ASSUAN_Server_Fault,
+   thus smaller codes come from libassuan itself.  */
+static int
+connection_error_p (gpg_error_t err)
+{
+  return ((int) err < 100
+	  || err == ASSUAN_Line_Too_Long
+	  || err == ASSUAN_Line_Not_Terminated);
+}
+
 /* Validate the certificate CERT through the dirmngr context
    CTX. Returns zero in case the certificate is considered valid, an
    appropriate error code otherwise. */
@@ -204,6 +427,10 @@ dirmngr_validate (dirmngr_ctx_t ctx, ksba_cert_t cert)
   err = assuan_transact (ctx->assuan, "VALIDATE", NULL, NULL,
 			 inq_cert, &parm,
 			 NULL, NULL);
+  if (err && connection_error_p (err))
+    /* Do not reuse the connection in case the transaction has been
+       aborted.  */
+    ctx->broken = 1;
  out:
 
   return err;
@@ -316,7 +543,13 @@ dirmngr_lookup_url (dirmngr_ctx_t ctx,
   err = assuan_transact (ctx->assuan, line, lookup_cb, &parm,
 			 NULL, NULL, NULL, NULL);
   if (err)
-    goto out;
+    {
+      /* Do not reuse the connection in case the transaction has been
+	 aborted.  */
+      if (connection_error_p (err))
+	ctx->broken = 1;
+      goto out;
+    }
   if (parm.err)
     {
       err = parm.err;
@@ -29,6 +29,11 @@
 /* Handle for accessing the dirmngr. */
 typedef struct dirmngr_ctx_s *dirmngr_ctx_t;
 
+/* Flag for dirmngr_connect: take an idle connection from the
+   process-wide connection pool, if possible, and return the
+   connection to the pool on dirmngr_disconnect.  */
+#define DIRMNGR_FLAG_POOL 1
+
 /* Connect to a running dirmngr through the local socket named by
    SOCK, using LOG_HANDLE as logging handle and flags FLAGS. The new
    context is stored in *CTX.  Returns proper error code. */
@@ -38,7 +43,8 @@ gpg_error_t dirmngr_connect (dirmngr_ctx_t *ctx,
 			     log_handle_t log_handle);
 
 /* Close the dirmngr connection associated with CTX and release all
-   related resources. */
+   related resources.  Pooled connections are kept open for reuse,
+   unless a transaction failed on them. */
 void dirmngr_disconnect (dirmngr_ctx_t ctx);
 
 /* Retrieve the certificate stored under the url URL through the
@@ -68,8 +68,12 @@ struct auth_method_s
   auth_method_func_auth_t func_auth;
   auth_method_func_auth_as_t func_auth_as;
   simpleparse_opt_spec_t *opt_specs;
+  const simpleparse_opt_hash_t *opt_hash; /* Perfect hash for OPT_SPECS
+					     or NULL.  */
   simpleparse_parse_cb_t parsecb;
   const char *config;
+  unsigned int card_attributes;	/* SCD_ATTR_* flags of the card
+				   attributes the method needs.  */
 };
 
 typedef struct auth_method_s *auth_method_t;
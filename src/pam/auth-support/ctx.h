@@ -25,6 +25,7 @@
 
 #include <util/simplelog.h>
 #include <util/simpleparse.h>
+#include <util/stats.h>
 
 #include "scd/scd.h"
 #include "auth-support/conv.h"
@@ -53,6 +54,8 @@ struct poldi_ctx_s
   /* Options. */
 
   char *logfile;
+  int log_async;		/* Write log messages through a
+				   background thread.  */
   log_handle_t loghandle;	/* Our handle for simplelog.  */
   simpleparse_handle_t parsehandle; /* Handle for simpleparse.  */
   int auth_method;		/* The ID of the authentication method
@@ -68,6 +71,12 @@ struct poldi_ctx_s
   int quiet;			/* Be more quiet during PAM
 				   conversation with user. */
   int use_agent;		/* Use gpg-agent to connect scdaemon.  */
+  unsigned int wait_timeout;	/* Seconds to wait for card insertion,
+				   zero means forever.  */
+  char *stats_file;		/* Statistics file, NULL for the
+				   default.  */
+  stats_t stats;		/* Handle for recording statistics,
+				   NULL if disabled.  */
 
   /* Scdaemon. */
   char *scdaemon_program;	/* Path of Scdaemon program to execute.  */
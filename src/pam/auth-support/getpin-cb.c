@@ -42,6 +42,7 @@
 #include "auth-support/conv.h"
 
 #include "ctx.h"
+#include "phase.h"
 
 #include "getpin-cb.h"
 
@@ -221,11 +222,15 @@ getpin_cb (void *opaque, const char *info, char *buf, size_t maxbuf)
     {
       /* BUF being non-zero means we are not using a keypad.  */
 
+      uint64_t start = stats_now ();
+
       if (info_frobbed)
 	err = query_user (ctx, info_frobbed, buf, maxbuf);
       else
 	/* Use string which is more user friendly. */
 	err = query_user (ctx, _("Please enter the PIN:"), buf, maxbuf);
+
+      phase_record (ctx, STATS_PHASE_PIN_ENTRY, start);
     }
   else
     {
@@ -0,0 +1,41 @@
+/* phase.c - Recording of authentication phases (Poldi)
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <poldi.h>
+
+#include <stdio.h>
+
+#include "util/simplelog.h"
+#include "util/stats.h"
+#include "phase.h"
+
+void
+phase_record (poldi_ctx_t ctx, enum stats_phase phase, uint64_t start)
+{
+  char duration[32];
+
+  stats_record (ctx->stats, phase, start);
+
+  snprintf (duration, sizeof (duration), "%llu",
+	    (unsigned long long) (stats_now () - start));
+  log_event (ctx->loghandle, LOG_LEVEL_INFO, "phase",
+	     "phase", stats_phase_name (phase),
+	     "duration_us", duration,
+	     NULL);
+}
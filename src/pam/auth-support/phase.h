@@ -0,0 +1,34 @@
+/* phase.h - Recording of authentication phases (Poldi)
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#ifndef PHASE_H
+#define PHASE_H
+
+#include <stdint.h>
+
+#include <util/stats.h>
+
+#include "ctx.h"
+
+/* Record that PHASE of the authentication in CTX took the time since
+   START, as returned by stats_now: in the statistics file and, for
+   structured log formats, as a "phase" event in the log.  */
+void phase_record (poldi_ctx_t ctx, enum stats_phase phase, uint64_t start);
+
+#endif
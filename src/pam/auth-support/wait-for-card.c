@@ -20,28 +20,187 @@
 #include <config.h>
 
 #include <gpg-error.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "scd.h"
+#include "wait-for-card.h"
 
-
 
-/* Wait for insertion of a card in slot specified by SLOT,
-   communication with the user through the PAM conversation function
-   CONV.
+
+/* Card presence is polled with an interval growing from
+   WAIT_INTERVAL_MIN to WAIT_INTERVAL_MAX milliseconds.  If scdaemon
+   notifies us about card status changes through
+   WAIT_EVENT_SIGNAL, we recheck immediately instead.  */
+#define WAIT_INTERVAL_MIN 100
+#define WAIT_INTERVAL_MAX 500
+#define WAIT_EVENT_SIGNAL SIGUSR2
+
+/* The disposition of signals is process-wide, only one waiter at a
+   time can use event notifications; EVENT_LOCK protects the
+   following variables.  */
+static pthread_mutex_t event_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The write end of the pipe the signal handler writes to, -1 if
+   none.  */
+static volatile sig_atomic_t event_fd = -1;
+
+/* The read end of that pipe.  */
+static int event_fd_read = -1;
+
+/* The disposition of WAIT_EVENT_SIGNAL before we installed ours.  */
+static struct sigaction event_old_action;
+
+/* The scdaemon connection which could not be told to stop sending
+   WAIT_EVENT_SIGNAL, or NULL.  Our handler stays installed as a no-op
+   until it has been disconnected.  There is at most one, since
+   event_start() refuses to run while our handler is installed.  */
+static scd_context_t event_stale_ctx;
+
+/* Signal handler for WAIT_EVENT_SIGNAL.  Since the signal may be
+   delivered to any thread of the process, it wakes up the waiter
+   through a pipe.  */
+static void
+event_handler (int signo)
+{
+  int saved_errno = errno;
+  int fd = event_fd;
+  ssize_t n;
+
+  (void) signo;
+
+  if (fd != -1)
+    {
+      /* If the pipe is full, the waiter will wake up anyway.  */
+      n = write (fd, "", 1);
+      (void) n;
+    }
+
+  errno = saved_errno;
+}
+
+/* Try to set up event notifications for card status changes through
+   CTX.  Returns true on success, in which case event_stop() has to
+   be called later.  */
+static int
+event_start (scd_context_t ctx)
+{
+  struct sigaction sa;
+  int fds[2];
+
+  if (pthread_mutex_trylock (&event_lock))
+    /* Someone else is waiting already.  */
+    return 0;
+
+  /* Do not interfere with an application using the signal
+     itself.  */
+  if (sigaction (WAIT_EVENT_SIGNAL, NULL, &event_old_action)
+      || (event_old_action.sa_flags & SA_SIGINFO)
+      || (event_old_action.sa_handler != SIG_DFL
+	  && event_old_action.sa_handler != SIG_IGN))
+    goto fail;
+
+  if (pipe (fds))
+    goto fail;
+  fcntl (fds[0], F_SETFL, O_NONBLOCK);
+  fcntl (fds[1], F_SETFL, O_NONBLOCK);
+  fcntl (fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl (fds[1], F_SETFD, FD_CLOEXEC);
+  event_fd_read = fds[0];
+  event_fd = fds[1];
+
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = event_handler;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset (&sa.sa_mask);
+  if (sigaction (WAIT_EVENT_SIGNAL, &sa, NULL))
+    goto fail_pipe;
+
+  if (scd_set_event_signal (ctx, WAIT_EVENT_SIGNAL))
+    {
+      sigaction (WAIT_EVENT_SIGNAL, &event_old_action, NULL);
+      goto fail_pipe;
+    }
+
+  return 1;
+
+ fail_pipe:
+  close (fds[0]);
+  close (fds[1]);
+  event_fd = -1;
+  event_fd_read = -1;
+ fail:
+  pthread_mutex_unlock (&event_lock);
+  return 0;
+}
+
+/* Disable event notifications set up by event_start() for CTX.  */
+static void
+event_stop (scd_context_t ctx)
+{
+  int fd;
+
+  if (!scd_set_event_signal (ctx, 0))
+    sigaction (WAIT_EVENT_SIGNAL, &event_old_action, NULL);
+  else
+    /* scdaemon may still send the signal, which would terminate the
+       process by default.  Keep our handler, which does nothing
+       without the pipe, until scdaemon is gone.  */
+    event_stale_ctx = ctx;
+
+  fd = event_fd;
+  event_fd = -1;
+  close (fd);
+  close (event_fd_read);
+  event_fd_read = -1;
+
+  pthread_mutex_unlock (&event_lock);
+}
+
+/* Drain the event pipe.  */
+static void
+event_clear (void)
+{
+  char buf[64];
+
+  while (read (event_fd_read, buf, sizeof (buf)) > 0)
+    ;
+}
+
+/* Return the current time in milliseconds.  */
+static unsigned long long
+now_ms (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+/* Wait for insertion of a card, communicating with scdaemon through
+   CTX.  If TIMEOUT is not zero, give up after TIMEOUT seconds.
 
    Returns proper error code.  */
 gpg_error_t
 wait_for_card (scd_context_t ctx, unsigned int timeout)
 {
-  gpg_error_t err;		/* <- rc?  */
-  time_t t0;
-  time_t t;
-
-  if (timeout)
-    time (&t0);
+  unsigned long long deadline;
+  unsigned long long t;
+  struct pollfd pfd;
+  gpg_error_t err;
+  int interval;
+  int events;
+  int delay;
 
-  err = 0;
+  deadline = timeout ? now_ms () + timeout * 1000ULL : 0;
+  interval = WAIT_INTERVAL_MIN;
+  events = 0;
 
   while (1)
     {
@@ -50,43 +209,80 @@ wait_for_card (scd_context_t ctx, unsigned int timeout)
       if (err == 0)
 	/* Card present!  */
 	break;
-      else if (gpg_err_code (err) == GPG_ERR_CARD_NOT_PRESENT)
+      else if (gpg_err_code (err) != GPG_ERR_CARD_NOT_PRESENT)
+	/* Unexpected different error -> stop waiting and propagate
+	   error upwards.  */
+	break;
+
+      /* Card not present.  */
 
+      /* FIXME: are there error codes besides
+	 GPG_ERR_CARD_NOT_PRESENT, which can be thrown in case a
+	 smartcard is not currently inserted?  */
+
+      /* Ask for notifications only now; a card being present right
+	 away is the common case.  */
+      if (!events)
+	events = event_start (ctx) ? 1 : -1;
+
+      delay = interval;
+      if (deadline)
 	{
-	  /* Card not present.  */
-
-	  /* FIXME: are there error codes besides
-	     GPG_ERR_CARD_NOT_PRESENT, which can be thrown in case a
-	     smartcard is not currently inserted?  */
-
-#ifdef HAVE_NANOSLEEP      
-	  {
-	    /* Wait 500ms.  */
-	    struct timespec augenblick;
-
-	    augenblick.tv_sec = 0;
-	    augenblick.tv_nsec = 500000000;
-	    nanosleep (&augenblick, NULL);
-	  }
-#else
-	  sleep (1);
-#endif
-
-	  if (timeout)
+	  t = now_ms ();
+	  if (t >= deadline)
 	    {
-	      time (&t);
-	      if ((t - t0) > timeout)
-		{
-		  err = GPG_ERR_CARD_NOT_PRESENT;
-		  break;
-		}
+	      err = gpg_error (GPG_ERR_CARD_NOT_PRESENT);
+	      break;
+	    }
+	  if (deadline - t < (unsigned long long) delay)
+	    delay = deadline - t;
+	}
+
+      if (events > 0)
+	{
+	  pfd.fd = event_fd_read;
+	  pfd.events = POLLIN;
+	  if (poll (&pfd, 1, delay) > 0)
+	    {
+	      /* Card status changed, check right away.  */
+	      event_clear ();
+	      interval = WAIT_INTERVAL_MIN;
+	      continue;
 	    }
 	}
       else
-	/* Unexpected different error -> stop waiting and propagate
-	   error upwards.  */
-	break;
+	poll (NULL, 0, delay);
+
+      interval += interval / 2;
+      if (interval > WAIT_INTERVAL_MAX)
+	interval = WAIT_INTERVAL_MAX;
     }
 
+  if (events > 0)
+    event_stop (ctx);
+
   return err;
 }
+
+/* Disconnect from scdaemon through CTX, which may have been used for
+   waiting for a card.  */
+void
+wait_for_card_disconnect (scd_context_t ctx)
+{
+  int stale;
+
+  pthread_mutex_lock (&event_lock);
+  stale = ctx && ctx == event_stale_ctx;
+  pthread_mutex_unlock (&event_lock);
+
+  scd_disconnect (ctx);
+
+  if (stale)
+    {
+      /* scdaemon cannot send the signal anymore.  */
+      pthread_mutex_lock (&event_lock);
+      sigaction (WAIT_EVENT_SIGNAL, &event_old_action, NULL);
+      event_stale_ctx = NULL;
+      pthread_mutex_unlock (&event_lock);
+    }
+}
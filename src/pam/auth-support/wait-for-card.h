@@ -24,11 +24,15 @@
 
 #include "scd/scd.h"
 
-/* Wait for insertion of a card in slot specified by SLOT,
-   communication with the user through the PAM conversation function
-   CONV.
+/* Wait for insertion of a card, communicating with scdaemon through
+   CTX.  If TIMEOUT is not zero, give up after TIMEOUT seconds.
 
    Returns proper error code.  */
 gpg_error_t wait_for_card (scd_context_t ctx, unsigned int timeout);
 
+/* Disconnect from scdaemon through CTX, which may have been used for
+   waiting for a card.  Use this instead of scd_disconnect() in that
+   case, it restores signal dispositions changed by wait_for_card().  */
+void wait_for_card_disconnect (scd_context_t ctx);
+
 #endif
@@ -24,6 +24,7 @@
 #include <syslog.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <limits.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <pwd.h>
@@ -33,14 +34,17 @@
 #include <security/pam_modules.h>
 #include <security/pam_appl.h>
 
+#include "util/util.h"
 #include "util/simplelog.h"
 #include "util/simpleparse.h"
+#include "util/config-cache.h"
 #include "util/defs.h"
 #include "scd/scd.h"
 
 #include "auth-support/wait-for-card.h"
 #include "auth-support/conv.h"
 #include "auth-support/getpin-cb.h"
+#include "auth-support/phase.h"
 #include "auth-methods.h"
 
 
@@ -75,6 +79,9 @@ static struct auth_method auth_methods[] =
 
 /*** Option parsing. ***/
 
+/* Size of the buffer for asynchronous logging.  */
+#define LOG_ASYNC_BUFFER_SIZE (64 * 1024)
+
 /* IDs for supported options. */
 enum opt_ids
   {
@@ -86,6 +93,10 @@ enum opt_ids
     opt_scdaemon_options,
     opt_modify_environment,
     opt_quiet,
+    opt_wait_timeout,
+    opt_stats_file,
+    opt_log_async,
+    opt_log_format,
   };
 
 /* Full specifications for options. */
@@ -105,9 +116,19 @@ static simpleparse_opt_spec_t opt_specs[] =
       0, SIMPLEPARSE_ARG_NONE, 0, "Set Poldi related variables in the PAM environment" },
     { opt_quiet, "quiet",
       0, SIMPLEPARSE_ARG_NONE, 0, "Be more quiet during PAM conversation with user" },
+    { opt_wait_timeout, "wait-timeout",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, "Specify seconds to wait for card insertion" },
+    { opt_stats_file, "stats-file",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, "Specify file to record statistics in" },
+    { opt_log_async, "log-async",
+      0, SIMPLEPARSE_ARG_NONE, 0, "Write log messages in the background" },
+    { opt_log_format, "log-format",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, "Specify format of log messages" },
     { 0 }
   };
 
+#include "pam_poldi-opthash.h"
+
 /* Lookup an auth_method struct by it's NAME, return it's index in
    AUTH_METHODS list or -1 if lookup failed.  */
 static int
@@ -132,9 +153,9 @@ pam_poldi_options_cb (void *cookie, simpleparse_opt_spec_t spec, const char *arg
   gpg_err_code_t err = GPG_ERR_NO_ERROR;
   poldi_ctx_t ctx = cookie;
 
-  if (!strcmp (spec.long_opt, "log-file"))
+  switch (spec.id)
     {
-      /* LOG-FILE.  */
+    case opt_logfile:
       ctx->logfile = xtrystrdup (arg);
       if (!ctx->logfile)
 	{
@@ -143,11 +164,9 @@ pam_poldi_options_cb (void *cookie, simpleparse_opt_spec_t spec, const char *arg
 			 "failed to duplicate %s: %s",
 			 "logfile name", gpg_strerror (err));
 	}
-    }
-  else if (!strcmp (spec.long_opt, "scdaemon-program"))
-    {
-      /* SCDAEMON-PROGRAM.  */
+      break;
 
+    case opt_scdaemon_program:
       ctx->scdaemon_program = strdup (arg);
       if (!ctx->scdaemon_program)
 	{
@@ -157,11 +176,9 @@ pam_poldi_options_cb (void *cookie, simpleparse_opt_spec_t spec, const char *arg
 			 "scdaemon program name",
 			 gpg_strerror (err));
 	}
-    }
-  else if (!strcmp (spec.long_opt, "scdaemon-options"))
-    {
-      /* SCDAEMON-OPTIONS.  */
+      break;
 
+    case opt_scdaemon_options:
       ctx->scdaemon_options = strdup (arg);
       if (!ctx->scdaemon_options)
 	{
@@ -171,42 +188,106 @@ pam_poldi_options_cb (void *cookie, simpleparse_opt_spec_t spec, const char *arg
 			 "scdaemon options name",
 			 gpg_strerror (err));
 	}
-    }
-  else if (!strcmp (spec.long_opt, "auth-method"))
-    {
-      /* AUTH-METHOD.  */
+      break;
+
+    case opt_auth_method:
+      {
+	int method = auth_method_lookup (arg);
+	if (method >= 0)
+	  ctx->auth_method = method;
+	else
+	  {
+	    log_msg_error (ctx->loghandle,
+			   "unknown authentication method '%s'",
+			   arg);
+	    err = GPG_ERR_INV_VALUE;
+	  }
+      }
+      break;
+
+    case opt_debug:
+      ctx->debug = 1;
+      log_set_min_level (ctx->loghandle, LOG_LEVEL_DEBUG);
+      break;
+
+    case opt_modify_environment:
+      ctx->modify_environment = 1;
+      break;
+
+    case opt_quiet:
+      ctx->quiet = 1;
+      break;
 
-      int method = auth_method_lookup (arg);
-      if (method >= 0)
-	ctx->auth_method = method;
+    case opt_log_async:
+      ctx->log_async = 1;
+      break;
+
+    case opt_log_format:
+      if (!strcmp (arg, "text"))
+	log_set_format (ctx->loghandle, LOG_FORMAT_TEXT);
+      else if (!strcmp (arg, "kv"))
+	log_set_format (ctx->loghandle, LOG_FORMAT_KV);
+      else if (!strcmp (arg, "json"))
+	log_set_format (ctx->loghandle, LOG_FORMAT_JSON);
       else
 	{
 	  log_msg_error (ctx->loghandle,
-			 "unknown authentication method '%s'",
-			 arg);
+			 "unknown log format '%s'", arg);
 	  err = GPG_ERR_INV_VALUE;
 	}
-    }
-  else if (!strcmp (spec.long_opt, "debug"))
-    {
-      /* DEBUG.  */
-      ctx->debug = 1;
-      log_set_min_level (ctx->loghandle, LOG_LEVEL_DEBUG);
-    }
-  else if (!strcmp (spec.long_opt, "modify-environment"))
-    {
-      /* MODIFY-ENVIRONMENT.  */
-      ctx->modify_environment = 1;
-    }
-  else if (!strcmp (spec.long_opt, "quiet"))
-    {
-      /* QUIET.  */
-      ctx->quiet = 1;
+      break;
+
+    case opt_wait_timeout:
+      {
+	unsigned long timeout;
+	char *end;
+
+	errno = 0;
+	timeout = strtoul (arg, &end, 10);
+	if (!*arg || *end || errno || timeout > UINT_MAX)
+	  {
+	    log_msg_error (ctx->loghandle,
+			   "invalid wait timeout '%s'", arg);
+	    err = GPG_ERR_INV_VALUE;
+	  }
+	else
+	  ctx->wait_timeout = timeout;
+      }
+      break;
+
+    case opt_stats_file:
+      xfree (ctx->stats_file);
+      ctx->stats_file = xtrystrdup (arg);
+      if (!ctx->stats_file)
+	{
+	  err = gpg_error_from_errno (errno);
+	  log_msg_error (ctx->loghandle,
+			 "failed to duplicate %s: %s",
+			 "stats file name", gpg_strerror (err));
+	}
+      break;
+
+    default:
+      break;
     }
 
   return gpg_error (err);
 }
 
+/* Tag all log records of this authentication with a random ID, so
+   that they can be told apart from those of concurrent
+   authentications.  */
+static void
+set_auth_id (poldi_ctx_t ctx)
+{
+  unsigned char nonce[8];
+  char id[2 * sizeof (nonce) + 1];
+
+  gcry_create_nonce (nonce, sizeof (nonce));
+  bin2hex (nonce, sizeof (nonce), id);
+  log_set_field (ctx->loghandle, "auth", id);
+}
+
 /* This callback is used for simpleparse. */
 static const char *
 i18n_cb (void *cookie, const char *msg)
@@ -254,7 +335,7 @@ create_context (poldi_ctx_t *context, pam_handle_t *pam_handle)
 
   simpleparse_set_loghandle (ctx->parsehandle, ctx->loghandle);
   simpleparse_set_parse_cb (ctx->parsehandle, pam_poldi_options_cb, ctx);
-  simpleparse_set_specs (ctx->parsehandle, opt_specs);
+  simpleparse_set_specs_hashed (ctx->parsehandle, opt_specs, &opt_specs_hash);
   simpleparse_set_i18n_cb (ctx->parsehandle, i18n_cb, NULL);
 
   *context = ctx;
@@ -285,7 +366,9 @@ destroy_context (poldi_ctx_t ctx)
       log_destroy (ctx->loghandle);
       xfree (ctx->scdaemon_program);
       xfree (ctx->scdaemon_options);
-      scd_disconnect (ctx->scd);
+      xfree (ctx->stats_file);
+      stats_close (ctx->stats);
+      wait_for_card_disconnect (ctx->scd);
       scd_release_cardinfo (ctx->cardinfo);
       /* FIXME: not very consistent: conv is (de-)allocated by caller. -mo */
       xfree (ctx);
@@ -364,10 +447,14 @@ pam_sm_authenticate (pam_handle_t *pam_handle,
   struct auth_method_parse_cookie method_parse_cookie = { NULL, NULL };
   simpleparse_handle_t method_parse;
   struct getpin_cb_data getpin_cb_data;
+  scd_connect_job_t scd_job;
+  uint64_t auth_start, start;
   int use_agent = 0;
 
+  auth_start = stats_now ();
   pam_username = NULL;
   scd_ctx = NULL;
+  scd_job = NULL;
   conv = NULL;
   ctx = NULL;
   method_parse = NULL;
@@ -396,11 +483,12 @@ pam_sm_authenticate (pam_handle_t *pam_handle,
 		 LOG_FLAG_WITH_PREFIX | LOG_FLAG_WITH_TIME | LOG_FLAG_WITH_PID);
   log_set_prefix (ctx->loghandle, "Poldi");
   log_set_backend_syslog (ctx->loghandle);
+  set_auth_id (ctx);
 
   /*** Parse auth-method independent options.  ***/
 
   /* ... from configuration file:  */
-  err = simpleparse_parse_file (ctx->parsehandle, 0, POLDI_CONF_FILE);
+  err = config_cache_parse_file (ctx->parsehandle, POLDI_CONF_FILE);
   if (err)
     {
       log_msg_error (ctx->loghandle,
@@ -440,6 +528,37 @@ pam_sm_authenticate (pam_handle_t *pam_handle,
 	log_set_backend_syslog (ctx->loghandle);
     }
 
+  /* Messages are written by a background thread, so that slow log
+     files do not delay the authentication.  Syslog is always written
+     synchronously.  */
+  if (ctx->log_async)
+    {
+      gpg_error_t rc;
+
+      rc = log_set_async (ctx->loghandle, LOG_ASYNC_BUFFER_SIZE);
+      if (rc && ctx->debug)
+	log_msg_debug (ctx->loghandle,
+		       "failed to enable asynchronous logging: %s",
+		       gpg_strerror (rc));
+    }
+
+  /*** Initialize statistics. ***/
+
+  /* Recording statistics is optional, usually only root can write
+     the file.  */
+  if (!ctx->stats_file || strcmp (ctx->stats_file, "none"))
+    {
+      gpg_error_t rc;
+      const char *stats_file;
+
+      stats_file = ctx->stats_file ? ctx->stats_file : POLDI_STATS_FILE;
+      rc = stats_open (stats_file, &ctx->stats);
+      if (rc && ctx->debug)
+	log_msg_debug (ctx->loghandle,
+		       "not recording statistics in '%s': %s",
+		       stats_file, gpg_strerror (rc));
+    }
+
   /*** Sanity checks. ***/
 
   /* Authentication method to use must be specified.  */
@@ -463,6 +582,49 @@ pam_sm_authenticate (pam_handle_t *pam_handle,
 		     "using authentication method `%s'",
 		     auth_methods[ctx->auth_method].name);
     }
+  log_set_field (ctx->loghandle, "method", auth_methods[ctx->auth_method].name);
+
+  /*** Retrieve username from PAM.  ***/
+
+  ret = pam_get_item (ctx->pam_handle, PAM_USER, (const void **)&pam_username);
+  if (ret != PAM_SUCCESS)
+    {
+      /* It's not fatal, username can be in the card.  */
+      log_msg_error (ctx->loghandle, "Can't retrieve username from PAM");
+    }
+  else if (pam_username)
+    log_set_field (ctx->loghandle, "user", pam_username);
+
+  /*** Check if we use gpg-agent. ***/
+  {
+    struct passwd *pw;
+    pw = getpwuid (getuid ());
+
+    if (pw == NULL)
+      {
+	err = gpg_error_from_syserror ();
+	goto out;
+      }
+
+    /* Supporting backward compatibility of old Poldi.
+     *
+     * For use cases of sudo and screen unlock where a user wants to
+     * use smartcard using the existing scdaemon under gpg-agent.
+     */
+    if (pam_username && !strcmp (pw->pw_name, pam_username))
+      use_agent = 1;
+  }
+
+  /*** Connect to Scdaemon. ***/
+
+  /* Starting scdaemon and opening the reader takes a while, let this
+     happen while the authentication method is set up and the user is
+     asked for the card.  */
+  err = scd_connect_start (&scd_job, use_agent,
+			   ctx->scdaemon_program, ctx->scdaemon_options,
+			   ctx->loghandle);
+  if (err)
+    goto out;
 
   /*** Init authentication method.  ***/
   
@@ -499,11 +661,12 @@ pam_sm_authenticate (pam_handle_t *pam_handle,
 				auth_methods[ctx->auth_method].method->parsecb,
 				&method_parse_cookie);
       simpleparse_set_i18n_cb (method_parse, i18n_cb, NULL);
-      simpleparse_set_specs (method_parse,
-			     auth_methods[ctx->auth_method].method->opt_specs);
+      simpleparse_set_specs_hashed (method_parse,
+				    auth_methods[ctx->auth_method].method->opt_specs,
+				    auth_methods[ctx->auth_method].method->opt_hash);
 
-      err = simpleparse_parse_file (method_parse, 0, 
-				    auth_methods[ctx->auth_method].method->config);
+      err = config_cache_parse_file (method_parse,
+				     auth_methods[ctx->auth_method].method->config);
       if (err)
 	{
 	  log_msg_error (ctx->loghandle,
@@ -519,6 +682,8 @@ pam_sm_authenticate (pam_handle_t *pam_handle,
 	goto out;
     }
 
+  phase_record (ctx, STATS_PHASE_CONFIG, auth_start);
+
   /*** Prepare PAM interaction.  ***/
 
   /* Ask PAM for conv structure.  */
@@ -538,49 +703,6 @@ pam_sm_authenticate (pam_handle_t *pam_handle,
 
   ctx->conv = conv;
 
-  /*** Retrieve username from PAM.  ***/
-
-  ret = pam_get_item (ctx->pam_handle, PAM_USER, (const void **)&pam_username);
-  if (ret != PAM_SUCCESS)
-    {
-      /* It's not fatal, username can be in the card.  */
-      log_msg_error (ctx->loghandle, "Can't retrieve username from PAM");
-    }
-
-  /*** Check if we use gpg-agent. ***/
-  {
-    struct passwd *pw;
-    pw = getpwuid (getuid ());
-
-    if (pw == NULL)
-      {
-	err = gpg_error_from_syserror ();
-	goto out;
-      }
-
-    /* Supporting backward compatibility of old Poldi.
-     *
-     * For use cases of sudo and screen unlock where a user wants to
-     * use smartcard using the existing scdaemon under gpg-agent.
-     */
-    if (pam_username && !strcmp (pw->pw_name, pam_username))
-      use_agent = 1;
-  }
-
-  /*** Connect to Scdaemon. ***/
-
-  err = scd_connect (&scd_ctx, use_agent,
-		     ctx->scdaemon_program, ctx->scdaemon_options,
-		     ctx->loghandle);
-  if (err)
-    goto out;
-
-  ctx->scd = scd_ctx;
-
-  /* Install PIN retrival callback. */
-  getpin_cb_data.poldi_ctx = ctx;
-  scd_set_pincb (ctx->scd, getpin_cb, &getpin_cb_data);
-
   /*** Wait for card insertion.  ***/
 
   if (pam_username)
@@ -598,7 +720,22 @@ pam_sm_authenticate (pam_handle_t *pam_handle,
 	conv_tell (ctx->conv, _("Insert authentication card"));
     }
 
-  err = wait_for_card (ctx->scd, 0);
+  start = stats_now ();
+  err = scd_connect_finish (scd_job, &scd_ctx);
+  scd_job = NULL;
+  phase_record (ctx, STATS_PHASE_SCD_CONNECT, start);
+  if (err)
+    goto out;
+
+  ctx->scd = scd_ctx;
+
+  /* Install PIN retrival callback. */
+  getpin_cb_data.poldi_ctx = ctx;
+  scd_set_pincb (ctx->scd, getpin_cb, &getpin_cb_data);
+
+  start = stats_now ();
+  err = wait_for_card (ctx->scd, ctx->wait_timeout);
+  phase_record (ctx, STATS_PHASE_WAIT_FOR_CARD, start);
   if (err)
     {
       log_msg_error (ctx->loghandle, "failed to wait for card insertion: %s",
@@ -608,14 +745,28 @@ pam_sm_authenticate (pam_handle_t *pam_handle,
 
   /*** Receive card info. ***/
 
-  err = scd_learn (ctx->scd, &ctx->cardinfo);
-  if (err)
-    goto out;
+  {
+    unsigned int attributes;
+
+    /* Only read what is actually needed, LEARN reads everything on
+       the card, which is slow on some readers.  */
+    attributes = (SCD_ATTR_SERIALNO
+		  | auth_methods[ctx->auth_method].method->card_attributes);
+    if (ctx->modify_environment)
+      attributes |= SCD_ATTR_DISP_LANG;
+
+    start = stats_now ();
+    err = scd_learn_attributes (ctx->scd, attributes, &ctx->cardinfo);
+    phase_record (ctx, STATS_PHASE_LEARN, start);
+    if (err)
+      goto out;
+  }
 
   if (ctx->debug)
     log_msg_debug (ctx->loghandle,
 		   "connected to card; serial number is: %s",
 		   ctx->cardinfo.serialno);
+  log_set_field (ctx->loghandle, "serial", ctx->cardinfo.serialno);
 
   /*** Authenticate.  ***/
 
@@ -643,6 +794,7 @@ pam_sm_authenticate (pam_handle_t *pam_handle,
 	{
 	  /* Send username received during authentication process back
 	     to PAM.  */
+	  log_set_field (ctx->loghandle, "user", username_authenticated);
 	  ret = pam_set_item (ctx->pam_handle, PAM_USER,
 			      username_authenticated);
 	  if (ret == PAM_SUCCESS)
@@ -667,6 +819,26 @@ pam_sm_authenticate (pam_handle_t *pam_handle,
 	modify_environment (pam_handle, ctx);
     }
 
+  stats_count (ctx->stats,
+	       err ? STATS_COUNTER_FAILURE : STATS_COUNTER_SUCCESS);
+  phase_record (ctx, STATS_PHASE_TOTAL, auth_start);
+  {
+    char code[16];
+
+    snprintf (code, sizeof (code), "%u", gpg_err_code (err));
+    log_event (ctx->loghandle, err ? LOG_LEVEL_ERROR : LOG_LEVEL_INFO, "auth",
+	       "result", err ? "failure" : "success",
+	       "error", err ? code : NULL,
+	       "error_text", err ? gpg_strerror (err) : NULL,
+	       NULL);
+  }
+
+  /* Bail out of a pending connection attempt.  This waits for
+     scdaemon to finish starting up, the attempt cannot be
+     aborted.  */
+  if (scd_job)
+    scd_connect_finish (scd_job, NULL);
+
   /* Call authentication method's deinit callback. */
   if ((ctx->auth_method >= 0)
       && auth_methods[ctx->auth_method].method->func_deinit)
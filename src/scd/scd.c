@@ -31,6 +31,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <pwd.h>
+#include <pthread.h>
+#include <time.h>
 
 #include <gpg-error.h>
 #include <gcrypt.h>
@@ -41,6 +44,7 @@
 #include "util/membuf.h"
 #include "util/support.h"
 #include "util/simplelog.h"
+#include "util/defs.h"
 
 #ifdef _POSIX_OPEN_MAX
 #define MAX_OPEN_FDS _POSIX_OPEN_MAX
@@ -62,6 +66,7 @@ struct scd_context
   log_handle_t loghandle;
   scd_pincb_t pincb;
   void *pincb_cookie;
+  int brokered;			/* Connected through poldi-scdd.  */
 };
 
 /* Callback parameter for learn card */
@@ -95,9 +100,243 @@ static gpg_error_t scd_serialno_internal (assuan_context_t ctx,
 
 
 
+/*
+ * Locating gpg-agent's socket.  Asking gpgconf requires spawning a
+ * shell and gpgconf, therefore we compute the socket name the same
+ * way GnuPG does and only ask gpgconf in case the computed socket does
+ * not exist (e.g. for older GnuPG versions).
+ */
+
+/* Encode the DATALEN bytes in DATA, where DATALEN is a multiple of 5,
+   in z-base-32 as used by GnuPG, storing the NUL-terminated result in
+   BUFFER, which must provide space for DATALEN / 5 * 8 + 1 bytes.  */
+static void
+zb32_encode (const unsigned char *data, size_t datalen, char *buffer)
+{
+  static const char zb32asc[32] = "ybndrfg8ejkmcpqxot1uwisza345h769";
+  unsigned long long bits;
+  size_t i;
+  int j;
+
+  for (i = 0; i < datalen; i += 5)
+    {
+      bits = 0;
+      for (j = 0; j < 5; j++)
+	bits = (bits << 8) | data[i + j];
+      for (j = 7; j >= 0; j--)
+	*buffer++ = zb32asc[(bits >> (j * 5)) & 0x1f];
+    }
+  *buffer = 0;
+}
+
+/* Return the home directory of the current user in newly allocated
+   memory in *HOME.  Returns proper error code.  */
+static gpg_error_t
+get_home_directory (char **home)
+{
+  struct passwd pwbuf, *pw;
+  char buffer[1024];
+  const char *dir;
+
+  dir = getenv ("HOME");
+  if (!dir || !*dir)
+    {
+      if (getpwuid_r (getuid (), &pwbuf, buffer, sizeof (buffer), &pw)
+	  || !pw || !pw->pw_dir)
+	return gpg_error (GPG_ERR_NOT_FOUND);
+      dir = pw->pw_dir;
+    }
+
+  *home = xtrystrdup (dir);
+  if (!*home)
+    return gpg_error_from_syserror ();
+
+  return 0;
+}
+
+/* Compute the name of gpg-agent's socket for the current user like
+   GnuPG does, storing it in newly allocated memory in *SOCKET_NAME.
+   GNUPGHOME is the value of the GNUPGHOME environment variable or
+   NULL.  Returns proper error code.  */
+static gpg_error_t
+compute_agent_socket_name (const char *gnupghome, char **socket_name)
+{
+  char rundir[64];
+  unsigned char sha1[20];
+  char hash[25];
+  struct stat statbuf;
+  char *homedir;
+  char *default_homedir;
+  char *home;
+  char *cwd;
+  size_t n;
+  gpg_error_t err;
+
+  homedir = NULL;
+  home = NULL;
+  cwd = NULL;
+  default_homedir = NULL;
+
+  err = get_home_directory (&home);
+  if (err)
+    goto out;
+
+  default_homedir = xtrymalloc (strlen (home) + 8);
+  if (!default_homedir)
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+  strcpy (stpcpy (default_homedir, home), "/.gnupg");
+
+  /* Figure out the absolute homedir without trailing slashes.  */
+  if (!gnupghome || !*gnupghome)
+    gnupghome = default_homedir;
+  if (*gnupghome != '/')
+    {
+      cwd = getcwd (NULL, 0);
+      if (!cwd)
+	{
+	  err = gpg_error_from_syserror ();
+	  goto out;
+	}
+    }
+  homedir = xtrymalloc ((cwd ? strlen (cwd) + 1 : 0) + strlen (gnupghome) + 1);
+  if (!homedir)
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+  if (cwd)
+    strcpy (stpcpy (stpcpy (homedir, cwd), "/"), gnupghome);
+  else
+    strcpy (homedir, gnupghome);
+  n = strlen (homedir);
+  while (n > 1 && homedir[n - 1] == '/')
+    homedir[--n] = 0;
+
+  /* GnuPG places its sockets below the user's runtime directory, if
+     that is a private directory owned by the user; otherwise the
+     sockets are placed in the homedir.  */
+  snprintf (rundir, sizeof (rundir), "/run/user/%lu",
+	    (unsigned long) getuid ());
+  if (stat (rundir, &statbuf))
+    snprintf (rundir, sizeof (rundir), "/var/run/user/%lu",
+	      (unsigned long) getuid ());
+  if (stat (rundir, &statbuf)
+      || statbuf.st_uid != getuid () || (statbuf.st_mode & 0077))
+    {
+      *socket_name = xtrymalloc (strlen (homedir) + 13);
+      if (!*socket_name)
+	err = gpg_error_from_syserror ();
+      else
+	strcpy (stpcpy (*socket_name, homedir), "/S.gpg-agent");
+      goto out;
+    }
+
+  /* Sockets of non-default homedirs live in a subdirectory named after
+     a hash of the homedir.  */
+  if (strcmp (homedir, default_homedir))
+    {
+      gcry_md_hash_buffer (GCRY_MD_SHA1, sha1, homedir, strlen (homedir));
+      zb32_encode (sha1, 15, hash);
+    }
+  else
+    *hash = 0;
+
+  *socket_name = xtrymalloc (strlen (rundir) + strlen (hash) + 25);
+  if (!*socket_name)
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+  if (*hash)
+    sprintf (*socket_name, "%s/gnupg/d.%s/S.gpg-agent", rundir, hash);
+  else
+    sprintf (*socket_name, "%s/gnupg/S.gpg-agent", rundir);
+
+ out:
+
+  xfree (home);
+  xfree (default_homedir);
+  xfree (homedir);
+  free (cwd);
+
+  return err;
+}
+
+/* Cache for the computed socket name, valid for the user ID and the
+   value of GNUPGHOME it has been computed for.  */
+static struct
+{
+  int valid;
+  uid_t uid;
+  char *gnupghome;
+  char *socket_name;
+} agent_socket_cache;
+static pthread_mutex_t agent_socket_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Look up the computed socket name for the current user and GNUPGHOME
+   in the cache or compute and cache it.  The socket name is stored in
+   newly allocated memory in *SOCKET_NAME.  Returns proper error
+   code.  */
+static gpg_error_t
+get_agent_socket_name_cached (char **socket_name)
+{
+  const char *gnupghome;
+  char *gnupghome_copy;
+  char *name;
+  gpg_error_t err;
+
+  gnupghome = getenv ("GNUPGHOME");
+  err = 0;
+
+  pthread_mutex_lock (&agent_socket_cache_lock);
+
+  if (!(agent_socket_cache.valid
+	&& agent_socket_cache.uid == getuid ()
+	&& (gnupghome
+	    ? (agent_socket_cache.gnupghome
+	       && !strcmp (agent_socket_cache.gnupghome, gnupghome))
+	    : !agent_socket_cache.gnupghome)))
+    {
+      name = NULL;
+      gnupghome_copy = NULL;
+      err = compute_agent_socket_name (gnupghome, &name);
+      if (!err && gnupghome)
+	{
+	  gnupghome_copy = xtrystrdup (gnupghome);
+	  if (!gnupghome_copy)
+	    err = gpg_error_from_syserror ();
+	}
+      if (err)
+	{
+	  xfree (name);
+	  goto out;
+	}
+
+      xfree (agent_socket_cache.gnupghome);
+      xfree (agent_socket_cache.socket_name);
+      agent_socket_cache.valid = 1;
+      agent_socket_cache.uid = getuid ();
+      agent_socket_cache.gnupghome = gnupghome_copy;
+      agent_socket_cache.socket_name = name;
+    }
+
+  *socket_name = xtrystrdup (agent_socket_cache.socket_name);
+  if (!*socket_name)
+    err = gpg_error_from_syserror ();
+
+ out:
+
+  pthread_mutex_unlock (&agent_socket_cache_lock);
+
+  return err;
+}
+
 /* Get the socket of GPG-AGENT by gpgconf. */
 static gpg_error_t
-get_agent_socket_name (char **gpg_agent_sockname)
+get_agent_socket_name_gpgconf (char **gpg_agent_sockname)
 {
   gpg_error_t err = 0;
   FILE *input;
@@ -135,6 +374,25 @@ get_agent_socket_name (char **gpg_agent_sockname)
   return err;
 }
 
+/* Get the socket of GPG-AGENT.  */
+static gpg_error_t
+get_agent_socket_name (char **gpg_agent_sockname)
+{
+  struct stat statbuf;
+  gpg_error_t err;
+
+  err = get_agent_socket_name_cached (gpg_agent_sockname);
+  if (!err)
+    {
+      if (!stat (*gpg_agent_sockname, &statbuf) && S_ISSOCK (statbuf.st_mode))
+	return 0;
+      xfree (*gpg_agent_sockname);
+      *gpg_agent_sockname = NULL;
+    }
+
+  return get_agent_socket_name_gpgconf (gpg_agent_sockname);
+}
+
 /* Helper function for get_scd_socket_from_agent(), which is used by
    scd_connect().
 
@@ -200,6 +458,15 @@ get_scd_socket_from_agent (char **socket_name)
   return err;
 }
 
+/* Return true if the file described by STATBUF is owned by root and
+   neither writable by its group nor by others.  */
+static int
+root_only (const struct stat *statbuf)
+{
+  return (statbuf->st_uid == 0
+	  && !(statbuf->st_mode & (S_IWGRP | S_IWOTH)));
+}
+
 /* Send a RESTART to SCDaemon.  */
 static void
 restart_scd (scd_context_t ctx)
@@ -236,6 +503,7 @@ scd_connect (scd_context_t *scd_ctx, int use_agent, const char *scd_path,
 
   ctx->assuan_ctx = NULL;
   ctx->flags = 0;
+  ctx->brokered = 0;
 
   /* Try using scdaemon under gpg-agent.  */
   if (use_agent)
@@ -258,10 +526,50 @@ scd_connect (scd_context_t *scd_ctx, int use_agent, const char *scd_path,
       xfree (scd_socket_name);
     }
 
-  /* If scdaemon under gpg-agent is irrelevant or not available,
-   * let Poldi invoke scdaemon.
+  /* If scdaemon under gpg-agent is irrelevant or not available, try
+   * the scdaemon kept running by poldi-scdd - unless a particular
+   * scdaemon has been configured, which the broker would not honor.
    */
-  if (!use_agent || err)
+  if ((!use_agent || err)
+      && ((scd_path && *scd_path) || (scd_options && *scd_options)))
+    {
+      log_msg_debug (loghandle, "not using poldi-scdd, since "
+		     "scdaemon-program or scdaemon-options is set");
+      err = gpg_error (GPG_ERR_NO_SCDAEMON);
+    }
+  else if (!use_agent || err)
+    {
+      struct stat statbuf;
+
+      /* Check for the socket first, libassuan complains loudly about
+	 failing connects.  Since the PIN is passed through the
+	 broker, only use it if nobody but root can have created the
+	 socket.  */
+      if (stat (POLDI_SCDD_SOCKET, &statbuf) || !S_ISSOCK (statbuf.st_mode))
+	err = gpg_error (GPG_ERR_NO_SCDAEMON);
+      else if (!root_only (&statbuf)
+	       || stat (POLDI_RUN_DIRECTORY, &statbuf)
+	       || !S_ISDIR (statbuf.st_mode) || !root_only (&statbuf))
+	{
+	  log_msg_error (loghandle, "ignoring poldi-scdd socket '%s', "
+			 "it or its directory may be written by users "
+			 "other than root", POLDI_SCDD_SOCKET);
+	  err = gpg_error (GPG_ERR_NO_SCDAEMON);
+	}
+      else
+	err = assuan_socket_connect (&assuan_ctx, POLDI_SCDD_SOCKET, 0);
+      if (!err)
+	{
+	  log_msg_debug (loghandle, "connected to poldi-scdd (socket: '%s')",
+			 POLDI_SCDD_SOCKET);
+	  ctx->brokered = 1;
+	}
+    }
+
+  /* If poldi-scdd is not running either, let Poldi invoke
+   * scdaemon.
+   */
+  if (err)
     {
       const char *pgmname;
       const char *argv[5];
@@ -334,6 +642,109 @@ scd_connect (scd_context_t *scd_ctx, int use_agent, const char *scd_path,
   return err;
 }
 
+/* State of a connection attempt made in the background.  */
+struct scd_connect_job
+{
+  pthread_t thread;
+  int threaded;			/* THREAD has been created.  */
+  int use_agent;
+  char *scd_path;
+  char *scd_options;
+  log_handle_t loghandle;
+  scd_context_t scd_ctx;	/* The result.  */
+  gpg_error_t err;
+};
+
+/* Thread function for scd_connect_start.  */
+static void *
+connect_thread (void *opaque)
+{
+  struct scd_connect_job *job = opaque;
+
+  job->err = scd_connect (&job->scd_ctx, job->use_agent,
+			  job->scd_path, job->scd_options, job->loghandle);
+
+  return NULL;
+}
+
+/* Start connecting to scdaemon like scd_connect does, but in the
+   background, so that the caller can do other work meanwhile.  The
+   connection attempt is stored in *JOB, to be finished with
+   scd_connect_finish.  LOGHANDLE is used from the background thread
+   as well; its backend must not be changed until the attempt has
+   been finished.  Returns proper error code or zero on success.  */
+gpg_error_t
+scd_connect_start (scd_connect_job_t *r_job, int use_agent,
+		   const char *scd_path, const char *scd_options,
+		   log_handle_t loghandle)
+{
+  struct scd_connect_job *job;
+  gpg_error_t err;
+
+  job = xtrymalloc (sizeof (*job));
+  if (!job)
+    return gpg_error_from_syserror ();
+
+  job->threaded = 0;
+  job->use_agent = use_agent;
+  job->scd_path = NULL;
+  job->scd_options = NULL;
+  job->loghandle = loghandle;
+  job->scd_ctx = NULL;
+  job->err = 0;
+
+  if ((scd_path && !(job->scd_path = xtrystrdup (scd_path)))
+      || (scd_options && !(job->scd_options = xtrystrdup (scd_options))))
+    {
+      err = gpg_error_from_syserror ();
+      xfree (job->scd_path);
+      xfree (job->scd_options);
+      xfree (job);
+      return err;
+    }
+
+  if (!pthread_create (&job->thread, NULL, connect_thread, job))
+    job->threaded = 1;
+  else
+    /* Connect right away then.  */
+    connect_thread (job);
+
+  *r_job = job;
+
+  return 0;
+}
+
+/* Wait for the connection attempt JOB started by scd_connect_start
+   to complete and release JOB.  On success, the new context is
+   stored in *SCD_CTX; if SCD_CTX is NULL, the connection is closed
+   right away.  A connection attempt cannot be aborted, thus this
+   waits until scdaemon has been started (or failed to start) even
+   if SCD_CTX is NULL; this is bounded by the time scdaemon needs to
+   start up.  Returns proper error code or zero on success.  */
+gpg_error_t
+scd_connect_finish (scd_connect_job_t job, scd_context_t *scd_ctx)
+{
+  gpg_error_t err;
+
+  if (job->threaded)
+    pthread_join (job->thread, NULL);
+
+  err = job->err;
+  if (!err)
+    {
+      if (scd_ctx)
+	*scd_ctx = job->scd_ctx;
+      else
+	scd_disconnect (job->scd_ctx);
+    }
+
+  xfree (job->scd_path);
+  xfree (job->scd_options);
+  xfree (job);
+
+  return err;
+}
+
 /* Disconnect from SCDaemon; destroy the context SCD_CTX.  */
 void
 scd_disconnect (scd_context_t scd_ctx)
@@ -347,6 +758,26 @@ scd_disconnect (scd_context_t scd_ctx)
 }
 
 
+/* Ask scdaemon to send the signal SIGNO to this process whenever the
+   status of a card changes; a SIGNO of zero disables this again.
+   Returns GPG_ERR_NOT_SUPPORTED if scdaemon cannot signal this
+   process.  */
+gpg_error_t
+scd_set_event_signal (scd_context_t ctx, int signo)
+{
+  char line[ASSUAN_LINELENGTH];
+
+  /* With poldi-scdd scdaemon's peer is the broker, it would receive
+     the signal instead of us.  */
+  if (ctx->brokered)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  snprintf (line, sizeof (line), "OPTION event-signal=%d", signo);
+
+  return assuan_transact (ctx->assuan_ctx, line,
+			  NULL, NULL, NULL, NULL, NULL, NULL);
+}
+
 void
 scd_set_pincb (scd_context_t scd_ctx,
 	       scd_pincb_t pincb, void *cookie)
@@ -510,6 +941,69 @@ scd_learn (scd_context_t ctx,
   return rc;
 }
 
+/* Names of the card attributes for GETATTR, indexed by the bit
+   numbers of the SCD_ATTR_* flags.  */
+static const char *const card_attribute_names[] =
+  {
+    "SERIALNO",
+    "DISP-NAME",
+    "DISP-LANG",
+    "PUBKEY-URL",
+    "LOGIN-DATA",
+    "KEY-FPR"
+  };
+
+/* Read the card attributes specified by the bitmask ATTRIBUTES of
+   SCD_ATTR_* flags from the card and fill the cardinfo structure
+   CARDINFO.  Falls back to learning all attributes if the card does
+   not support reading single attributes.  Returns proper error code,
+   zero on success.  */
+int
+scd_learn_attributes (scd_context_t ctx, unsigned int attributes,
+		      struct scd_cardinfo *cardinfo)
+{
+  char line[ASSUAN_LINELENGTH];
+  struct timespec t0, t1;
+  unsigned int i;
+  int rc;
+
+  *cardinfo = scd_cardinfo_null;
+  rc = 0;
+
+  for (i = 0; i < DIM (card_attribute_names); i++)
+    {
+      if (!(attributes & (1 << i)))
+	continue;
+
+      snprintf (line, sizeof (line), "GETATTR %s", card_attribute_names[i]);
+
+      clock_gettime (CLOCK_MONOTONIC, &t0);
+      rc = assuan_transact (ctx->assuan_ctx, line,
+			    NULL, NULL, NULL, NULL,
+			    learn_status_cb, cardinfo);
+      clock_gettime (CLOCK_MONOTONIC, &t1);
+
+      log_msg_debug (ctx->loghandle,
+		     "reading card attribute %s took %lu ms: %s",
+		     card_attribute_names[i],
+		     (unsigned long) ((t1.tv_sec - t0.tv_sec) * 1000
+				      + (t1.tv_nsec - t0.tv_nsec) / 1000000),
+		     gpg_strerror (rc));
+      if (rc)
+	break;
+    }
+
+  if (rc)
+    {
+      log_msg_debug (ctx->loghandle,
+		     "falling back to learning all card attributes");
+      scd_release_cardinfo (*cardinfo);
+      rc = scd_learn (ctx, cardinfo);
+    }
+
+  return rc;
+}
+
 /* Simply release the cardinfo structure INFO.  INFO being NULL is
    okay.  */
 void
@@ -519,6 +1013,7 @@ scd_release_cardinfo (struct scd_cardinfo info)
   xfree (info.disp_name);
   xfree (info.login_data);
   xfree (info.pubkey_url);
+  xfree (info.disp_lang);
 }
 
 
@@ -698,6 +1193,8 @@ scd_pksign (scd_context_t ctx,
 {
   int rc;
   char *p, line[ASSUAN_LINELENGTH];
+  char setdata_line[ASSUAN_LINELENGTH];
+  assuan_pipelined_cmd_t cmds[2];
   membuf_t data;
   struct inq_needpin_s inqparm;
   size_t len;
@@ -710,39 +1207,39 @@ scd_pksign (scd_context_t ctx,
 
   init_membuf (&data, 1024);
 
-  if (indatalen*2 + 50 > DIM(line)) /* FIXME: Are such long inputs
-				       allowed? Should we handle them
-				       differently?  */
+  /* FIXME: Are such long inputs allowed? Should we handle them
+     differently?  */
+  if (indatalen*2 + 50 > DIM(setdata_line))
     {
       rc = gpg_error (GPG_ERR_GENERAL);
       goto out;
     }
 
-  /* Inform scdaemon about the data to be signed. */
+  /* Inform scdaemon about the data to be signed and sign it, without
+     waiting for the response to SETDATA first. */
 
-  sprintf (line, "SETDATA ");
-  p = line + strlen (line);
+  sprintf (setdata_line, "SETDATA ");
+  p = setdata_line + strlen (setdata_line);
   bin2hex (indata, indatalen, p);
 
-  rc = assuan_transact (ctx->assuan_ctx, line,
-                        NULL, NULL, NULL, NULL, NULL, NULL);
-  if (rc)
-    goto out;
-
   /* Setup NEEDPIN inquiry handler.  */
 
   inqparm.ctx = ctx;
   inqparm.getpin_cb = ctx->pincb;
   inqparm.getpin_cb_arg = ctx->pincb_cookie;
 
-  /* Go, sign it. */
-
   snprintf (line, DIM(line)-1, "PKSIGN %s", keyid);
   line[DIM(line)-1] = 0;
-  rc = assuan_transact (ctx->assuan_ctx, line,
-                        membuf_data_cb, &data,
-                        inq_needpin, &inqparm,
-                        NULL, NULL);
+
+  memset (cmds, 0, sizeof (cmds));
+  cmds[0].command = setdata_line;
+  cmds[1].command = line;
+  cmds[1].data_cb = membuf_data_cb;
+  cmds[1].data_cb_arg = &data;
+  cmds[1].inquire_cb = inq_needpin;
+  cmds[1].inquire_cb_arg = &inqparm;
+
+  rc = assuan_transact_pipelined (ctx->assuan_ctx, cmds, DIM (cmds));
   if (rc)
     goto out;
 
@@ -53,6 +53,30 @@ gpg_error_t scd_connect (scd_context_t *scd_ctx, int use_agent,
 			 const char *scd_path, const char *scd_options,
 			 log_handle_t loghandle);
 
+struct scd_connect_job;
+
+typedef struct scd_connect_job *scd_connect_job_t;
+
+/* Start connecting to scdaemon like scd_connect does, but in the
+   background, so that the caller can do other work meanwhile.  The
+   connection attempt is stored in *JOB, to be finished with
+   scd_connect_finish.  LOGHANDLE is used from the background thread
+   as well; its backend must not be changed until the attempt has
+   been finished.  Returns proper error code or zero on success.  */
+gpg_error_t scd_connect_start (scd_connect_job_t *job, int use_agent,
+			       const char *scd_path, const char *scd_options,
+			       log_handle_t loghandle);
+
+/* Wait for the connection attempt JOB started by scd_connect_start
+   to complete and release JOB.  On success, the new context is
+   stored in *SCD_CTX; if SCD_CTX is NULL, the connection is closed
+   right away.  A connection attempt cannot be aborted, thus this
+   waits until scdaemon has been started (or failed to start) even
+   if SCD_CTX is NULL; this is bounded by the time scdaemon needs to
+   start up.  Returns proper error code or zero on success.  */
+gpg_error_t scd_connect_finish (scd_connect_job_t job,
+				scd_context_t *scd_ctx);
+
 /* Disconnect from SCDaemon; destroy the context SCD_CTX.  */
 void scd_disconnect (scd_context_t scd_ctx);
 
@@ -61,6 +85,12 @@ typedef int (*scd_pincb_t) (void *data, const char *, char *, size_t);
 void scd_set_pincb (scd_context_t scd_ctx,
 		    scd_pincb_t pincb, void *cookie);
 
+/* Ask scdaemon to send the signal SIGNO to this process whenever the
+   status of a card changes; a SIGNO of zero disables this again.
+   Returns GPG_ERR_NOT_SUPPORTED if scdaemon cannot signal this
+   process.  */
+gpg_error_t scd_set_event_signal (scd_context_t ctx, int signo);
+
 /* Return the serial number of the card or an appropriate error.  The
    serial number is returned as a hexstring. */
 gpg_error_t scd_serialno (scd_context_t ctx, char **r_serialno);
@@ -70,6 +100,22 @@ gpg_error_t scd_serialno (scd_context_t ctx, char **r_serialno);
 int scd_learn (scd_context_t ctx,
 	       struct scd_cardinfo *cardinfo);
 
+/* Card attributes for scd_learn_attributes().  */
+#define SCD_ATTR_SERIALNO   (1 << 0)
+#define SCD_ATTR_DISP_NAME  (1 << 1)
+#define SCD_ATTR_DISP_LANG  (1 << 2)
+#define SCD_ATTR_PUBKEY_URL (1 << 3)
+#define SCD_ATTR_LOGIN_DATA (1 << 4)
+#define SCD_ATTR_KEY_FPR    (1 << 5)
+
+/* Read the card attributes specified by the bitmask ATTRIBUTES of
+   SCD_ATTR_* flags from the card and fill the cardinfo structure
+   CARDINFO.  Falls back to learning all attributes if the card does
+   not support reading single attributes.  Returns proper error code,
+   zero on success.  */
+int scd_learn_attributes (scd_context_t ctx, unsigned int attributes,
+			  struct scd_cardinfo *cardinfo);
+
 /* Simply release the cardinfo structure INFO.  INFO being NULL is
    okay.  */
 void scd_release_cardinfo (struct scd_cardinfo cardinfo);
@@ -0,0 +1,671 @@
+/* cdb.c - Constant database files for Poldi
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+/* File format.  All integers are stored in little-endian byte order.
+
+     Offset  Size  Content
+     0       4     Magic "PCDB"
+     4       4     Format version (1)
+     8       4     Flags
+     12      4     Number of tables (N)
+     16      8     Device of source file
+     24      8     Inode of source file
+     32      8     Modification time of source file
+     40      8     Size of source file
+     48      8*N   Table directory; per table: offset of the slot
+                   array, number of slots
+
+   The table directory is followed by the records.  A record consists
+   of the key length (4), the value length (4), the key, a NUL byte,
+   the value and another NUL byte.  The records are followed by the
+   slot arrays.  Each slot consists of a 32 bit hash value and the
+   offset of the record (4); a record offset of zero marks an empty
+   slot.  The number of slots of a table is a power of two and the
+   slots are searched by linear probing.  */
+
+#include "util-local.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "cdb.h"
+
+#define CDB_MAGIC        "PCDB"
+#define CDB_VERSION      1
+#define CDB_HEADER_SIZE  48
+#define CDB_RECORD_SIZE  8
+#define CDB_SLOT_SIZE    8
+
+
+
+/* Helper functions for (de-)serialization.  */
+
+static unsigned int
+get_u32 (const unsigned char *p)
+{
+  return (((unsigned int) p[0])
+	  | ((unsigned int) p[1] << 8)
+	  | ((unsigned int) p[2] << 16)
+	  | ((unsigned int) p[3] << 24));
+}
+
+static unsigned long long
+get_u64 (const unsigned char *p)
+{
+  return (((unsigned long long) get_u32 (p + 4) << 32)
+	  | (unsigned long long) get_u32 (p));
+}
+
+static void
+put_u32 (unsigned char *p, unsigned int v)
+{
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
+static void
+put_u64 (unsigned char *p, unsigned long long v)
+{
+  put_u32 (p, v & 0xffffffff);
+  put_u32 (p + 4, v >> 32);
+}
+
+/* The hash function used by the original cdb.  */
+static unsigned int
+cdb_hash (const void *key, size_t keylen)
+{
+  const unsigned char *p = key;
+  unsigned int h = 5381;
+
+  while (keylen--)
+    h = ((h << 5) + h) ^ *p++;
+
+  return h & 0xffffffff;
+}
+
+
+
+/*
+ * Source identities.
+ */
+
+/* Fill *SOURCE with the identity of the file described by ST.  */
+void
+cdb_source_from_stat (struct cdb_source *source, const struct stat *st)
+{
+  source->dev = st->st_dev;
+  source->ino = st->st_ino;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+  /* Use nanosecond resolution where available, so that changes
+     within the same second are noticed as well.  */
+  source->mtime = ((unsigned long long) st->st_mtim.tv_sec * 1000000000
+		   + st->st_mtim.tv_nsec);
+#else
+  source->mtime = st->st_mtime;
+#endif
+  source->size = st->st_size;
+}
+
+/* Return true if the source identities A and B are equal.  */
+int
+cdb_source_equal (const struct cdb_source *a, const struct cdb_source *b)
+{
+  return (a->dev == b->dev
+	  && a->ino == b->ino
+	  && a->mtime == b->mtime
+	  && a->size == b->size);
+}
+
+
+
+/*
+ * Reading.
+ */
+
+/* Open the database file FILENAME and map it into memory; DB is
+   initialized accordingly.  Returns proper error code.  */
+gpg_error_t
+cdb_open (struct cdb *db, const char *filename)
+{
+  const unsigned char *map;
+  struct stat statbuf;
+  gpg_error_t err;
+  unsigned int i;
+  int fd;
+
+  map = MAP_FAILED;
+  db->map = NULL;
+  db->size = 0;
+
+  fd = open (filename, O_RDONLY);
+  if (fd == -1)
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+
+  if (fstat (fd, &statbuf))
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+
+  if (statbuf.st_size < CDB_HEADER_SIZE
+      || statbuf.st_size > 0xffffffff)
+    {
+      err = gpg_error (GPG_ERR_INV_DATA);
+      goto out;
+    }
+
+  map = mmap (NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+
+  db->map = map;
+  db->size = statbuf.st_size;
+  cdb_source_from_stat (&db->file, &statbuf);
+
+  /* Parse header.  */
+
+  if (memcmp (map, CDB_MAGIC, 4) || get_u32 (map + 4) != CDB_VERSION)
+    {
+      err = gpg_error (GPG_ERR_INV_DATA);
+      goto out;
+    }
+
+  db->flags = get_u32 (map + 8);
+  db->ntables = get_u32 (map + 12);
+  db->source.dev = get_u64 (map + 16);
+  db->source.ino = get_u64 (map + 24);
+  db->source.mtime = get_u64 (map + 32);
+  db->source.size = get_u64 (map + 40);
+
+  /* Make sure that the table directory and the slot arrays are
+     contained in the file.  The records are checked on access.  */
+
+  if (db->ntables > (db->size - CDB_HEADER_SIZE) / 8)
+    {
+      err = gpg_error (GPG_ERR_INV_DATA);
+      goto out;
+    }
+
+  for (i = 0; i < db->ntables; i++)
+    {
+      const unsigned char *entry = map + CDB_HEADER_SIZE + 8 * i;
+      size_t offset = get_u32 (entry);
+      size_t nslots = get_u32 (entry + 4);
+
+      if ((nslots & (nslots - 1))
+	  || offset > db->size
+	  || nslots > (db->size - offset) / CDB_SLOT_SIZE)
+	{
+	  err = gpg_error (GPG_ERR_INV_DATA);
+	  goto out;
+	}
+    }
+
+  err = 0;
+
+ out:
+
+  if (fd != -1)
+    close (fd);
+
+  if (err)
+    {
+      if (map != MAP_FAILED)
+	munmap ((void *) map, statbuf.st_size);
+      db->map = NULL;
+      db->size = 0;
+    }
+
+  return err;
+}
+
+/* Release the resources associated with the database DB.  */
+void
+cdb_close (struct cdb *db)
+{
+  if (db && db->map)
+    {
+      munmap ((void *) db->map, db->size);
+      db->map = NULL;
+      db->size = 0;
+    }
+}
+
+/* Prepare FIND for iterating over the values stored under the key
+   KEY/KEYLEN in table TABLE of the database DB.  */
+void
+cdb_findstart (struct cdb_find *find, const struct cdb *db,
+	       unsigned int table, const void *key, size_t keylen)
+{
+  find->db = db;
+  find->key = key;
+  find->keylen = keylen;
+  find->hash = cdb_hash (key, keylen);
+  find->probes = 0;
+
+  if (table < db->ntables)
+    {
+      const unsigned char *entry = db->map + CDB_HEADER_SIZE + 8 * table;
+
+      find->slots_offset = get_u32 (entry);
+      find->nslots = get_u32 (entry + 4);
+    }
+  else
+    {
+      find->slots_offset = 0;
+      find->nslots = 0;
+    }
+
+  if (find->nslots)
+    find->slot = find->hash & (find->nslots - 1);
+  else
+    find->slot = 0;
+}
+
+/* Retrieve the next value for the key given to cdb_findstart().  On
+   success, *DATA points to the value stored in the mapped file, which
+   is NUL-terminated; its length without the NUL is stored in
+   *DATALEN.  Returns GPG_ERR_NOT_FOUND in case there are no more
+   values, GPG_ERR_INV_DATA in case the database is corrupt.  */
+gpg_error_t
+cdb_findnext (struct cdb_find *find, const char **data, size_t *datalen)
+{
+  const struct cdb *db = find->db;
+
+  while (find->probes < find->nslots)
+    {
+      const unsigned char *slot;
+      const unsigned char *record;
+      size_t record_offset;
+      size_t keylen, vallen;
+
+      slot = db->map + find->slots_offset + CDB_SLOT_SIZE * find->slot;
+      record_offset = get_u32 (slot + 4);
+      if (!record_offset)
+	/* Empty slot, the key is not contained in the table.  */
+	break;
+
+      find->slot = (find->slot + 1) & (find->nslots - 1);
+      find->probes++;
+
+      if (get_u32 (slot) != find->hash)
+	continue;
+
+      /* Candidate found, check bounds of record.  */
+      if (record_offset < CDB_HEADER_SIZE
+	  || record_offset > db->size - CDB_RECORD_SIZE)
+	return gpg_error (GPG_ERR_INV_DATA);
+      record = db->map + record_offset;
+      keylen = get_u32 (record);
+      vallen = get_u32 (record + 4);
+      if (keylen + vallen + 2 > db->size - record_offset - CDB_RECORD_SIZE)
+	return gpg_error (GPG_ERR_INV_DATA);
+      record += CDB_RECORD_SIZE;
+      if (record[keylen] || record[keylen + 1 + vallen])
+	return gpg_error (GPG_ERR_INV_DATA);
+
+      if (keylen == find->keylen && !memcmp (record, find->key, keylen))
+	{
+	  *data = (const char *) record + keylen + 1;
+	  if (datalen)
+	    *datalen = vallen;
+	  return 0;
+	}
+    }
+
+  return gpg_error (GPG_ERR_NOT_FOUND);
+}
+
+
+
+/*
+ * Writing.
+ */
+
+/* Hash entries collected for one table.  */
+struct cdb_make_table
+{
+  unsigned int *entries;	/* Pairs of hash value and record
+				   offset.  */
+  unsigned int n;		/* Number of entries.  */
+  unsigned int size;		/* Number of allocated entries.  */
+  unsigned int offset;		/* Offset of the slot array.  */
+  unsigned int nslots;		/* Number of slots.  */
+};
+
+struct cdb_make_s
+{
+  FILE *fp;			/* Stream for the temporary file.  */
+  char *filename;		/* Final name of the database.  */
+  char *tmpname;		/* Name of the temporary file.  */
+  unsigned int flags;
+  struct cdb_source source;
+  unsigned int ntables;
+  struct cdb_make_table *tables;
+  unsigned int pos;		/* Current write position.  */
+};
+
+/* Discard the database under construction and release MAKE.  */
+void
+cdb_make_abort (cdb_make_t make)
+{
+  unsigned int i;
+
+  if (!make)
+    return;
+
+  if (make->fp)
+    {
+      fclose (make->fp);
+      remove (make->tmpname);
+    }
+  if (make->tables)
+    {
+      for (i = 0; i < make->ntables; i++)
+	xfree (make->tables[i].entries);
+      xfree (make->tables);
+    }
+  xfree (make->filename);
+  xfree (make->tmpname);
+  xfree (make);
+}
+
+/* Start writing a new database with NTABLES tables, which is to be
+   stored as FILENAME.  The new handle is stored in *MAKE.  Returns
+   proper error code.  */
+gpg_error_t
+cdb_make_start (cdb_make_t *make, const char *filename, unsigned int ntables)
+{
+  unsigned char header[CDB_HEADER_SIZE];
+  cdb_make_t mk;
+  gpg_error_t err;
+  unsigned int i;
+  int fd;
+
+  mk = xtrymalloc (sizeof (*mk));
+  if (!mk)
+    return gpg_error_from_syserror ();
+  memset (mk, 0, sizeof (*mk));
+
+  mk->ntables = ntables;
+  mk->filename = xtrystrdup (filename);
+  mk->tmpname = xtrymalloc (strlen (filename) + 8);
+  mk->tables = xtrymalloc (sizeof (*mk->tables) * ntables);
+  if (!mk->filename || !mk->tmpname || !mk->tables)
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+  memset (mk->tables, 0, sizeof (*mk->tables) * ntables);
+
+  /* The temporary file is created in the target directory, so that
+     it can be renamed into place atomically.  */
+  sprintf (mk->tmpname, "%s.XXXXXX", filename);
+  fd = mkstemp (mk->tmpname);
+  if (fd == -1)
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+
+  mk->fp = fdopen (fd, "w");
+  if (!mk->fp)
+    {
+      err = gpg_error_from_syserror ();
+      close (fd);
+      remove (mk->tmpname);
+      goto out;
+    }
+
+  /* Reserve space for header and table directory; they are written
+     by cdb_make_finish().  */
+  memset (header, 0, sizeof (header));
+  if (fwrite (header, sizeof (header), 1, mk->fp) != 1)
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+  for (i = 0; i < ntables; i++)
+    if (fwrite (header, 8, 1, mk->fp) != 1)
+      {
+	err = gpg_error_from_syserror ();
+	goto out;
+      }
+  mk->pos = CDB_HEADER_SIZE + 8 * ntables;
+
+  *make = mk;
+  err = 0;
+
+ out:
+
+  if (err)
+    cdb_make_abort (mk);
+
+  return err;
+}
+
+/* Record the flags FLAGS and the source identity SOURCE in the
+   database under construction.  */
+void
+cdb_make_set_info (cdb_make_t make, unsigned int flags,
+		   const struct cdb_source *source)
+{
+  make->flags = flags;
+  if (source)
+    make->source = *source;
+}
+
+/* Add the value DATA/DATALEN under the key KEY/KEYLEN to table TABLE
+   of the database under construction.  Returns proper error code.  */
+gpg_error_t
+cdb_make_add (cdb_make_t make, unsigned int table,
+	      const void *key, size_t keylen,
+	      const void *data, size_t datalen)
+{
+  struct cdb_make_table *tab;
+  unsigned char record[CDB_RECORD_SIZE];
+  size_t record_size;
+
+  if (table >= make->ntables)
+    return gpg_error (GPG_ERR_INV_ARG);
+
+  tab = &make->tables[table];
+
+  record_size = CDB_RECORD_SIZE + keylen + datalen + 2;
+  if (keylen > 0xffffffff || datalen > 0xffffffff
+      || record_size > 0xffffffff - make->pos
+      || tab->n == 0x7fffffff)
+    return gpg_error (GPG_ERR_TOO_LARGE);
+
+  if (tab->n == tab->size)
+    {
+      unsigned int *entries;
+      unsigned int size = tab->size ? tab->size * 2 : 64;
+
+      entries = xtryrealloc (tab->entries, sizeof (*entries) * 2 * size);
+      if (!entries)
+	return gpg_error_from_syserror ();
+      tab->entries = entries;
+      tab->size = size;
+    }
+
+  put_u32 (record, keylen);
+  put_u32 (record + 4, datalen);
+  if (fwrite (record, sizeof (record), 1, make->fp) != 1
+      || (keylen && fwrite (key, keylen, 1, make->fp) != 1)
+      || putc (0, make->fp) == EOF
+      || (datalen && fwrite (data, datalen, 1, make->fp) != 1)
+      || putc (0, make->fp) == EOF)
+    return gpg_error_from_syserror ();
+
+  tab->entries[2 * tab->n] = cdb_hash (key, keylen);
+  tab->entries[2 * tab->n + 1] = make->pos;
+  tab->n++;
+  make->pos += record_size;
+
+  return 0;
+}
+
+/* Write the slot array for TAB to the database file and remember its
+   location in TAB.  Returns proper error code.  */
+static gpg_error_t
+write_table (cdb_make_t make, struct cdb_make_table *tab)
+{
+  unsigned char *slots;
+  unsigned int n, i, slot;
+  gpg_error_t err;
+
+  /* Use a load factor of at most one half.  */
+  for (n = tab->n ? 2 : 0; n && n < 2 * tab->n; n *= 2)
+    if (n >= 0x10000000)
+      return gpg_error (GPG_ERR_TOO_LARGE);
+
+  tab->offset = make->pos;
+  tab->nslots = n;
+  if (!n)
+    return 0;
+
+  if ((size_t) n * CDB_SLOT_SIZE > 0xffffffff - make->pos)
+    return gpg_error (GPG_ERR_TOO_LARGE);
+
+  slots = xtrymalloc ((size_t) n * CDB_SLOT_SIZE);
+  if (!slots)
+    return gpg_error_from_syserror ();
+  memset (slots, 0, (size_t) n * CDB_SLOT_SIZE);
+
+  for (i = 0; i < tab->n; i++)
+    {
+      slot = tab->entries[2 * i] & (n - 1);
+      while (get_u32 (slots + CDB_SLOT_SIZE * slot + 4))
+	slot = (slot + 1) & (n - 1);
+      put_u32 (slots + CDB_SLOT_SIZE * slot, tab->entries[2 * i]);
+      put_u32 (slots + CDB_SLOT_SIZE * slot + 4, tab->entries[2 * i + 1]);
+    }
+
+  if (fwrite (slots, CDB_SLOT_SIZE, n, make->fp) != n)
+    err = gpg_error_from_syserror ();
+  else
+    {
+      make->pos += n * CDB_SLOT_SIZE;
+      err = 0;
+    }
+
+  xfree (slots);
+
+  return err;
+}
+
+/* Write out the database under construction and move it into place.
+   The handle MAKE is released in any case.  Returns proper error
+   code.  */
+gpg_error_t
+cdb_make_finish (cdb_make_t make)
+{
+  unsigned char header[CDB_HEADER_SIZE];
+  unsigned char entry[8];
+  gpg_error_t err;
+  unsigned int i;
+  FILE *fp;
+
+  err = 0;
+
+  /* Write the slot arrays, then go back and fill in the header.  */
+
+  for (i = 0; i < make->ntables; i++)
+    {
+      err = write_table (make, &make->tables[i]);
+      if (err)
+	goto out;
+    }
+
+  memcpy (header, CDB_MAGIC, 4);
+  put_u32 (header + 4, CDB_VERSION);
+  put_u32 (header + 8, make->flags);
+  put_u32 (header + 12, make->ntables);
+  put_u64 (header + 16, make->source.dev);
+  put_u64 (header + 24, make->source.ino);
+  put_u64 (header + 32, make->source.mtime);
+  put_u64 (header + 40, make->source.size);
+
+  if (fseek (make->fp, 0, SEEK_SET)
+      || fwrite (header, sizeof (header), 1, make->fp) != 1)
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+
+  for (i = 0; i < make->ntables; i++)
+    {
+      put_u32 (entry, make->tables[i].offset);
+      put_u32 (entry + 4, make->tables[i].nslots);
+      if (fwrite (entry, sizeof (entry), 1, make->fp) != 1)
+	{
+	  err = gpg_error_from_syserror ();
+	  goto out;
+	}
+    }
+
+  /* Make sure the data is on disk before the rename makes it
+     visible.  */
+  if (fflush (make->fp)
+      || fchmod (fileno (make->fp), 0644)
+      || fsync (fileno (make->fp)))
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+
+  fp = make->fp;
+  make->fp = NULL;
+  if (fclose (fp))
+    {
+      err = gpg_error_from_syserror ();
+      remove (make->tmpname);
+      goto out;
+    }
+
+  if (rename (make->tmpname, make->filename))
+    {
+      err = gpg_error_from_syserror ();
+      remove (make->tmpname);
+      goto out;
+    }
+
+ out:
+
+  cdb_make_abort (make);
+
+  return err;
+}
+
+/* END */
@@ -0,0 +1,129 @@
+/* cdb.h - Constant database files for Poldi
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+/* This is a small implementation of immutable, memory-mapped
+   key/value database files in the spirit of D. J. Bernstein's "cdb".
+   A database file contains one or more hash tables ("tables"); each
+   table maps keys to one or more values.  Database files are written
+   once through the cdb_make_* interface and atomically put in place
+   by renaming; afterwards they are only read, which is done without
+   any memory allocation directly from the mapped file.
+
+   Additionally, every database file records the identity (device,
+   inode, modification time and size) of the source file it has been
+   compiled from, so that users can figure out whether a database file
+   is still up to date.  */
+
+#ifndef POLDI_CDB_H
+#define POLDI_CDB_H
+
+#include <poldi.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/* Identity of the file a database has been compiled from.  */
+struct cdb_source
+{
+  unsigned long long dev;
+  unsigned long long ino;
+  unsigned long long mtime;
+  unsigned long long size;
+};
+
+/* Handle for an opened database file.  The definition is public so
+   that it can be allocated on the stack.  */
+struct cdb
+{
+  const unsigned char *map;	/* The mapped database file.  */
+  size_t size;			/* Size of the mapping.  */
+  unsigned int flags;		/* Flags stored in the file.  */
+  unsigned int ntables;		/* Number of tables.  */
+  struct cdb_source source;	/* Identity of the source file.  */
+  struct cdb_source file;	/* Identity of the database file
+				   itself.  */
+};
+
+/* State for iterating over the values stored for a key.  */
+struct cdb_find
+{
+  const struct cdb *db;
+  const void *key;
+  size_t keylen;
+  unsigned int hash;
+  unsigned int slots_offset;
+  unsigned int nslots;
+  unsigned int slot;
+  unsigned int probes;
+};
+
+typedef struct cdb_make_s *cdb_make_t;
+
+/* Fill *SOURCE with the identity of the file described by ST.  */
+void cdb_source_from_stat (struct cdb_source *source, const struct stat *st);
+
+/* Return true if the source identities A and B are equal.  */
+int cdb_source_equal (const struct cdb_source *a, const struct cdb_source *b);
+
+/* Open the database file FILENAME and map it into memory; DB is
+   initialized accordingly.  Returns proper error code.  */
+gpg_error_t cdb_open (struct cdb *db, const char *filename);
+
+/* Release the resources associated with the database DB.  */
+void cdb_close (struct cdb *db);
+
+/* Prepare FIND for iterating over the values stored under the key
+   KEY/KEYLEN in table TABLE of the database DB.  */
+void cdb_findstart (struct cdb_find *find, const struct cdb *db,
+		    unsigned int table, const void *key, size_t keylen);
+
+/* Retrieve the next value for the key given to cdb_findstart().  On
+   success, *DATA points to the value stored in the mapped file, which
+   is NUL-terminated; its length without the NUL is stored in
+   *DATALEN.  Returns GPG_ERR_NOT_FOUND in case there are no more
+   values, GPG_ERR_INV_DATA in case the database is corrupt.  */
+gpg_error_t cdb_findnext (struct cdb_find *find,
+			  const char **data, size_t *datalen);
+
+/* Start writing a new database with NTABLES tables, which is to be
+   stored as FILENAME.  The new handle is stored in *MAKE.  Returns
+   proper error code.  */
+gpg_error_t cdb_make_start (cdb_make_t *make, const char *filename,
+			    unsigned int ntables);
+
+/* Record the flags FLAGS and the source identity SOURCE in the
+   database under construction.  */
+void cdb_make_set_info (cdb_make_t make, unsigned int flags,
+			const struct cdb_source *source);
+
+/* Add the value DATA/DATALEN under the key KEY/KEYLEN to table TABLE
+   of the database under construction.  Returns proper error code.  */
+gpg_error_t cdb_make_add (cdb_make_t make, unsigned int table,
+			  const void *key, size_t keylen,
+			  const void *data, size_t datalen);
+
+/* Write out the database under construction and move it into place.
+   The handle MAKE is released in any case.  Returns proper error
+   code.  */
+gpg_error_t cdb_make_finish (cdb_make_t make);
+
+/* Discard the database under construction and release MAKE.  */
+void cdb_make_abort (cdb_make_t make);
+
+#endif
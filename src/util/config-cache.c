@@ -0,0 +1,276 @@
+/* config-cache.c - Per-process cache of parsed configuration files
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <util-local.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <gpg-error.h>
+
+#include "simpleparse.h"
+#include "cdb.h"
+#include "config-cache.h"
+
+/* Number of configuration files for which snapshots are kept.  Poldi
+   reads poldi.conf and the configuration of the authentication
+   method.  */
+#define CONFIG_CACHE_SIZE 4
+
+/* An option found in a configuration file.  */
+struct config_option
+{
+  simpleparse_opt_spec_t spec;
+  char *arg;
+};
+
+/* The options found in a configuration file.  A snapshot is never
+   modified once it has been published in the cache.  */
+struct config_snapshot
+{
+  unsigned int refs;		/* Protected by CONFIG_CACHE_LOCK.  */
+  char *filename;
+  simpleparse_opt_spec_t *specs;
+  struct cdb_source source;	/* Identity of the parsed file.  */
+  struct config_option *options;
+  size_t n_options;
+  size_t options_size;
+};
+typedef struct config_snapshot *config_snapshot_t;
+
+static config_snapshot_t config_cache[CONFIG_CACHE_SIZE];
+static unsigned int config_cache_next;
+static pthread_mutex_t config_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+static void
+snapshot_free (config_snapshot_t snapshot)
+{
+  size_t i;
+
+  for (i = 0; i < snapshot->n_options; i++)
+    xfree (snapshot->options[i].arg);
+  xfree (snapshot->options);
+  xfree (snapshot->filename);
+  xfree (snapshot);
+}
+
+/* Drop a reference to SNAPSHOT.  CONFIG_CACHE_LOCK must be held.  */
+static void
+snapshot_unref (config_snapshot_t snapshot)
+{
+  if (snapshot && !--snapshot->refs)
+    snapshot_free (snapshot);
+}
+
+/* Parser callback recording the options in the snapshot passed as
+   COOKIE.  */
+static gpg_error_t
+snapshot_record_cb (void *cookie, simpleparse_opt_spec_t spec, const char *arg)
+{
+  config_snapshot_t snapshot = cookie;
+  struct config_option *options;
+  char *arg_copy;
+
+  if (snapshot->n_options == snapshot->options_size)
+    {
+      size_t size = snapshot->options_size ? 2 * snapshot->options_size : 16;
+
+      options = xtryrealloc (snapshot->options, size * sizeof (*options));
+      if (!options)
+	return gpg_error_from_errno (errno);
+      snapshot->options = options;
+      snapshot->options_size = size;
+    }
+
+  arg_copy = NULL;
+  if (arg)
+    {
+      arg_copy = xtrystrdup (arg);
+      if (!arg_copy)
+	return gpg_error_from_errno (errno);
+    }
+
+  snapshot->options[snapshot->n_options].spec = spec;
+  snapshot->options[snapshot->n_options].arg = arg_copy;
+  snapshot->n_options++;
+
+  return 0;
+}
+
+/* Parse FILENAME, which has the identity SOURCE, through HANDLE and
+   store the options found in a new snapshot in *SNAPSHOT.  The parser
+   callback of HANDLE is preserved.  */
+static gpg_error_t
+snapshot_create (simpleparse_handle_t handle, const char *filename,
+		 const struct cdb_source *source, config_snapshot_t *snapshot)
+{
+  simpleparse_parse_cb_t parse_cb;
+  config_snapshot_t snap;
+  void *cookie;
+  gpg_error_t err;
+
+  snap = xtrymalloc (sizeof (*snap));
+  if (!snap)
+    return gpg_error_from_errno (errno);
+  memset (snap, 0, sizeof (*snap));
+
+  snap->refs = 1;
+  snap->specs = simpleparse_get_specs (handle);
+  snap->source = *source;
+  snap->filename = xtrystrdup (filename);
+  if (!snap->filename)
+    {
+      err = gpg_error_from_errno (errno);
+      goto out;
+    }
+
+  simpleparse_get_parse_cb (handle, &parse_cb, &cookie);
+  simpleparse_set_parse_cb (handle, snapshot_record_cb, snap);
+  err = simpleparse_parse_file (handle, 0, filename);
+  simpleparse_set_parse_cb (handle, parse_cb, cookie);
+
+ out:
+
+  if (err)
+    snapshot_free (snap);
+  else
+    *snapshot = snap;
+
+  return err;
+}
+
+/* Return a reference to the cached snapshot of FILENAME for SPECS if
+   it still matches the identity SOURCE, or NULL.  */
+static config_snapshot_t
+cache_lookup (const char *filename, simpleparse_opt_spec_t *specs,
+	      const struct cdb_source *source)
+{
+  config_snapshot_t snapshot = NULL;
+  int i;
+
+  pthread_mutex_lock (&config_cache_lock);
+  for (i = 0; i < CONFIG_CACHE_SIZE; i++)
+    if (config_cache[i]
+	&& config_cache[i]->specs == specs
+	&& !strcmp (config_cache[i]->filename, filename))
+      {
+	if (cdb_source_equal (&config_cache[i]->source, source))
+	  {
+	    snapshot = config_cache[i];
+	    snapshot->refs++;
+	  }
+	break;
+      }
+  pthread_mutex_unlock (&config_cache_lock);
+
+  return snapshot;
+}
+
+/* Publish SNAPSHOT in the cache, replacing the snapshot of the same
+   file, or the oldest one if the cache is full.  */
+static void
+cache_insert (config_snapshot_t snapshot)
+{
+  int i;
+
+  pthread_mutex_lock (&config_cache_lock);
+  for (i = 0; i < CONFIG_CACHE_SIZE; i++)
+    if (!config_cache[i]
+	|| (config_cache[i]->specs == snapshot->specs
+	    && !strcmp (config_cache[i]->filename, snapshot->filename)))
+      break;
+  if (i == CONFIG_CACHE_SIZE)
+    {
+      i = config_cache_next;
+      config_cache_next = (config_cache_next + 1) % CONFIG_CACHE_SIZE;
+    }
+  snapshot_unref (config_cache[i]);
+  config_cache[i] = snapshot;
+  snapshot->refs++;
+  pthread_mutex_unlock (&config_cache_lock);
+}
+
+gpg_error_t
+config_cache_parse_file (simpleparse_handle_t handle, const char *filename)
+{
+  simpleparse_parse_cb_t parse_cb;
+  config_snapshot_t snapshot;
+  struct cdb_source source;
+  struct stat st;
+  void *cookie;
+  gpg_error_t err;
+  size_t i;
+
+  if (stat (filename, &st))
+    /* Let simpleparse report the error.  */
+    return simpleparse_parse_file (handle, 0, filename);
+
+  cdb_source_from_stat (&source, &st);
+  snapshot = cache_lookup (filename, simpleparse_get_specs (handle), &source);
+  if (!snapshot)
+    {
+      /* If the file changes while it is parsed, the snapshot is
+	 outdated right away and the file gets parsed again next
+	 time.  */
+      err = snapshot_create (handle, filename, &source, &snapshot);
+      if (err)
+	return err;
+      cache_insert (snapshot);
+    }
+
+  simpleparse_get_parse_cb (handle, &parse_cb, &cookie);
+  err = 0;
+  for (i = 0; i < snapshot->n_options && !err; i++)
+    err = (*parse_cb) (cookie, snapshot->options[i].spec,
+		       snapshot->options[i].arg);
+
+  pthread_mutex_lock (&config_cache_lock);
+  snapshot_unref (snapshot);
+  pthread_mutex_unlock (&config_cache_lock);
+
+  return err;
+}
+
+void
+config_cache_flush (void)
+{
+  int i;
+
+  pthread_mutex_lock (&config_cache_lock);
+  for (i = 0; i < CONFIG_CACHE_SIZE; i++)
+    {
+      snapshot_unref (config_cache[i]);
+      config_cache[i] = NULL;
+    }
+  pthread_mutex_unlock (&config_cache_lock);
+}
+
+#ifdef __GNUC__
+/* Release the snapshots when the PAM module gets unloaded.  */
+static void __attribute__ ((destructor))
+config_cache_cleanup (void)
+{
+  config_cache_flush ();
+}
+#endif
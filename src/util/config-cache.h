@@ -0,0 +1,44 @@
+/* config-cache.h - Per-process cache of parsed configuration files
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#ifndef CONFIG_CACHE_H
+#define CONFIG_CACHE_H
+
+#include <gpg-error.h>
+
+#include "simpleparse.h"
+
+/* The options found in a configuration file are kept in a snapshot,
+   which is shared by all threads of the process.  A snapshot is only
+   used as long as the device, inode, size and modification time of
+   the file are unchanged; otherwise the file is parsed again and the
+   new snapshot replaces the old one.  */
+
+/* Parse the configuration file FILENAME like simpleparse_parse_file,
+   using the option specifications and the parser callback installed
+   in HANDLE.  If an up-to-date snapshot of the file exists, the
+   callback is invoked for the options recorded in it and the file is
+   not read.  Returns proper error code.  */
+gpg_error_t config_cache_parse_file (simpleparse_handle_t handle,
+				     const char *filename);
+
+/* Drop all snapshots.  */
+void config_cache_flush (void);
+
+#endif
@@ -0,0 +1,123 @@
+# gen-opthash.awk - Generate perfect hashes for simpleparse tables
+# Copyright (C) 2026 g10 Code GmbH
+#
+# This file is part of Poldi.
+#
+# Poldi is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# Poldi is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, see
+# <http://www.gnu.org/licenses/>.
+
+# Usage: awk -v table=NAME -f gen-opthash.awk FILE.c
+#
+# Reads the static simpleparse_opt_spec_t array NAME from FILE.c and
+# writes a C header defining NAME_hash, a simpleparse_opt_hash_t for
+# use with simpleparse_set_specs_hashed.  The entries of the array
+# must start with "{ ID, "LONG-OPT"," on one line.
+#
+# The hash function must match opt_hash in simpleparse.c:
+#
+#   h = 0; for each byte c: h = (h * mult + c) mod 2^32
+#   slot = h mod size
+#
+# The multiplier is searched for, so that all options of the table
+# end up in different slots.
+
+function opt_hash(name, mult,    h, i)
+{
+  h = 0
+  for (i = 1; i <= length(name); i++)
+    h = (h * mult + ord[substr(name, i, 1)]) % 4294967296
+  return h
+}
+
+# Try MULT with SIZE slots; fill SLOT on success.
+function try_mult(mult, size,    i, s)
+{
+  for (i = 0; i < size; i++)
+    slot[i] = 0
+  for (i = 1; i <= n; i++)
+    {
+      s = opt_hash(names[i], mult) % size
+      if (slot[s])
+	return 0
+      slot[s] = i
+    }
+  return 1
+}
+
+BEGIN {
+  if (!table)
+    {
+      print "gen-opthash.awk: no table given" > "/dev/stderr"
+      exit 1
+    }
+  for (i = 1; i < 128; i++)
+    ord[sprintf("%c", i)] = i
+  n = 0
+  state = 0
+}
+
+state == 0 && $0 ~ ("(^|[^A-Za-z_0-9])" table "\\[\\] *=") {
+  state = 1
+  next
+}
+
+state == 1 && /\{ *0 *\}/ {
+  state = 2
+  next
+}
+
+state == 1 && /\{ *[A-Za-z_0-9]+, *"[^"]*"/ {
+  line = $0
+  sub(/^[^"]*"/, "", line)
+  sub(/".*$/, "", line)
+  names[++n] = line
+}
+
+END {
+  if (state != 2 || !n)
+    {
+      print "gen-opthash.awk: table " table " not found" > "/dev/stderr"
+      exit 1
+    }
+  if (n > 255)
+    {
+      print "gen-opthash.awk: table " table " too large" > "/dev/stderr"
+      exit 1
+    }
+
+  size = 1
+  while (size < 2 * n)
+    size *= 2
+  found = 0
+  while (!found)
+    {
+      for (mult = 31; mult < 65536 && !found; mult += 2)
+	found = try_mult(mult, size)
+      if (!found)
+	size *= 2
+    }
+  mult -= 2
+
+  printf "/* Generated by gen-opthash.awk from %s - DO NOT EDIT.  */\n\n", FILENAME
+  printf "static const unsigned char %s_hash_slots[%d] =\n  {", table, size
+  for (i = 0; i < size; i++)
+    printf "%s%s%d", (i ? "," : ""), (i % 16 ? " " : "\n    "), slot[i]
+  printf "\n  };\n\n"
+  printf "/* Slot contents are indices + 1 into %s:\n", table
+  for (i = 1; i <= n; i++)
+    printf "     %d: %s\n", i, names[i]
+  printf " */\n\n"
+  printf "static const simpleparse_opt_hash_t %s_hash =\n", table
+  printf "  { %d, %d, %s_hash_slots };\n", mult, size, table
+}
@@ -23,30 +23,375 @@
 #include <assert.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <fcntl.h>
 #include <time.h>
 #include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 #include <syslog.h>
+#include <pthread.h>
 
 #include <gpg-error.h>
 
 #include "simplelog.h"
 
+/* Messages are formatted into a buffer of this size on the stack;
+   longer messages need a heap allocation.  */
+#define LOG_LINE_LENGTH 1024
+
+/* Growable buffer for formatting a log record.  Records are built on
+   the stack and only moved to the heap if they get long.  */
+struct line_buf
+{
+  char *p;
+  size_t len;
+  size_t size;
+  int oom;			/* Set if growing failed; the record is
+				   truncated then.  */
+  char stack[LOG_LINE_LENGTH];
+};
+
+static void
+lb_init (struct line_buf *lb)
+{
+  lb->p = lb->stack;
+  lb->len = 0;
+  lb->size = sizeof (lb->stack);
+  lb->oom = 0;
+}
+
+static void
+lb_release (struct line_buf *lb)
+{
+  if (lb->p != lb->stack)
+    xfree (lb->p);
+}
+
+/* Make sure that LB has room for N more bytes plus a terminating
+   nul.  Returns false if not.  */
+static int
+lb_reserve (struct line_buf *lb, size_t n)
+{
+  size_t size;
+  char *p;
+
+  if (lb->len + n + 1 <= lb->size)
+    return 1;
+  if (lb->oom)
+    return 0;
+
+  size = 2 * lb->size;
+  while (size < lb->len + n + 1)
+    size *= 2;
+  if (lb->p == lb->stack)
+    {
+      p = xtrymalloc (size);
+      if (p)
+	memcpy (p, lb->stack, lb->len);
+    }
+  else
+    p = xtryrealloc (lb->p, size);
+  if (!p)
+    {
+      lb->oom = 1;
+      return 0;
+    }
+  lb->p = p;
+  lb->size = size;
+
+  return 1;
+}
+
+static void
+lb_put (struct line_buf *lb, const char *data, size_t n)
+{
+  if (!lb_reserve (lb, n))
+    n = lb->size - lb->len - 1;
+  memcpy (lb->p + lb->len, data, n);
+  lb->len += n;
+}
+
+static void
+lb_puts (struct line_buf *lb, const char *string)
+{
+  lb_put (lb, string, strlen (string));
+}
+
+static void
+lb_vprintf (struct line_buf *lb, const char *fmt, va_list ap)
+{
+  va_list ap_copy;
+  int ret;
+
+  va_copy (ap_copy, ap);
+  ret = vsnprintf (lb->p + lb->len, lb->size - lb->len, fmt, ap_copy);
+  va_end (ap_copy);
+  if (ret < 0)
+    return;
+  if (lb->len + ret + 1 > lb->size)
+    {
+      if (lb_reserve (lb, ret))
+	vsnprintf (lb->p + lb->len, lb->size - lb->len, fmt, ap);
+      else
+	ret = lb->size - lb->len - 1;
+    }
+  lb->len += ret;
+}
+
+static void
+lb_printf (struct line_buf *lb, const char *fmt, ...)
+{
+  va_list ap;
+
+  va_start (ap, fmt);
+  lb_vprintf (lb, fmt, ap);
+  va_end (ap);
+}
+
+/* Append VALUE to LB, quoted and escaped for FORMAT.  In the
+   key=value format, values are only quoted if needed.  */
+static void
+lb_put_value (struct line_buf *lb, log_format_t format, const char *value)
+{
+  const unsigned char *s;
+  int quote;
+
+  if (format == LOG_FORMAT_KV)
+    {
+      quote = !*value;
+      for (s = (const unsigned char *) value; *s && !quote; s++)
+	if (*s <= ' ' || *s == '"' || *s == '=' || *s == '\\' || *s == 0x7f)
+	  quote = 1;
+      if (!quote)
+	{
+	  lb_puts (lb, value);
+	  return;
+	}
+    }
+
+  lb_put (lb, "\"", 1);
+  for (s = (const unsigned char *) value; *s; s++)
+    {
+      if (*s == '"' || *s == '\\')
+	{
+	  lb_put (lb, "\\", 1);
+	  lb_put (lb, (const char *) s, 1);
+	}
+      else if (*s == '\n')
+	lb_puts (lb, "\\n");
+      else if (*s == '\t')
+	lb_puts (lb, "\\t");
+      else if (*s < ' ' || *s == 0x7f)
+	lb_printf (lb, format == LOG_FORMAT_JSON ? "\\u%04x" : "\\x%02x", *s);
+      else
+	lb_put (lb, (const char *) s, 1);
+    }
+  lb_put (lb, "\"", 1);
+}
+
+/* Append the field KEY with value VALUE to the structured record in
+   LB.  */
+static void
+lb_put_field (struct line_buf *lb, log_format_t format,
+	      const char *key, const char *value)
+{
+  if (format == LOG_FORMAT_JSON)
+    {
+      lb_puts (lb, lb->len > 1 ? ",\"" : "\"");
+      lb_puts (lb, key);
+      lb_puts (lb, "\":");
+    }
+  else
+    {
+      if (lb->len)
+	lb_put (lb, " ", 1);
+      lb_puts (lb, key);
+      lb_put (lb, "=", 1);
+    }
+  lb_put_value (lb, format, value);
+}
+
+/* Ring buffer for asynchronous logging.  Writers append complete
+   messages under LOCK; the flusher thread writes out everything
+   between TAIL and HEAD and then advances TAIL.  Messages which do not
+   fit into the free space are dropped and counted.  */
+struct log_ring
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;		/* Signalled when data is added or
+				   STOP is set.  */
+  pthread_t thread;
+  char *buffer;
+  size_t size;
+  size_t head;			/* Total number of bytes added.  */
+  size_t tail;			/* Total number of bytes written.  */
+  unsigned long dropped;	/* Messages dropped since last
+				   notice.  */
+  int stop;
+};
+
+/* Context field of structured records.  */
+struct log_field
+{
+  char *key;			/* NULL if unused.  */
+  char *value;
+};
+
 struct log_handle
 {
   log_backend_t backend;
   log_level_t min_level;
+  log_format_t format;
   unsigned int flags;
   char prefix[LOG_PREFIX_LENGTH];
-  FILE *stream;
+  FILE *stream;			/* For LOG_BACKEND_STREAM.  */
+  int fd;			/* For LOG_BACKEND_FILE.  */
+  struct log_ring *ring;	/* Non-NULL in asynchronous mode.  */
+  struct log_field fields[LOG_MAX_FIELDS];
 };
 
+/* Write the data described by IOV/IOVCNT to the stream or file
+   backend of HANDLE.  File backends get a single writev, so that
+   messages of concurrent writers do not get mixed up.  */
+static void
+internal_emit (log_handle_t handle, struct iovec *iov, int iovcnt)
+{
+  int i;
+
+  if (handle->backend == LOG_BACKEND_FILE)
+    {
+      ssize_t ret;
+
+      do
+	ret = writev (handle->fd, iov, iovcnt);
+      while (ret == -1 && errno == EINTR);
+    }
+  else
+    {
+      for (i = 0; i < iovcnt; i++)
+	fwrite (iov[i].iov_base, iov[i].iov_len, 1, handle->stream);
+      fflush (handle->stream);
+    }
+}
+
+static void format_dropped_notice (log_handle_t handle,
+				   unsigned long dropped,
+				   struct line_buf *lb);
+
+/* Flusher thread for asynchronous logging; OPAQUE is the log
+   handle.  */
+static void *
+log_ring_flusher (void *opaque)
+{
+  log_handle_t handle = opaque;
+  struct log_ring *ring = handle->ring;
+  struct line_buf notice;
+  unsigned long dropped;
+  struct iovec iov[3];
+  size_t start, n;
+  int iovcnt;
+
+  pthread_mutex_lock (&ring->lock);
+  while (1)
+    {
+      while (ring->head == ring->tail && !ring->dropped && !ring->stop)
+	pthread_cond_wait (&ring->cond, &ring->lock);
+      if (ring->head == ring->tail && !ring->dropped)
+	break;
+
+      n = ring->head - ring->tail;
+      start = ring->tail % ring->size;
+      dropped = ring->dropped;
+      ring->dropped = 0;
+      pthread_mutex_unlock (&ring->lock);
+
+      /* The pending data may wrap around the end of the buffer.
+	 Writers do not touch it until TAIL has been advanced.  */
+      iovcnt = 0;
+      if (n)
+	{
+	  iov[iovcnt].iov_base = ring->buffer + start;
+	  iov[iovcnt].iov_len = start + n > ring->size ? ring->size - start : n;
+	  iovcnt++;
+	  if (start + n > ring->size)
+	    {
+	      iov[iovcnt].iov_base = ring->buffer;
+	      iov[iovcnt].iov_len = start + n - ring->size;
+	      iovcnt++;
+	    }
+	}
+      if (dropped)
+	{
+	  format_dropped_notice (handle, dropped, &notice);
+	  iov[iovcnt].iov_base = notice.p;
+	  iov[iovcnt].iov_len = notice.len;
+	  iovcnt++;
+	}
+      internal_emit (handle, iov, iovcnt);
+      if (dropped)
+	lb_release (&notice);
+
+      pthread_mutex_lock (&ring->lock);
+      ring->tail += n;
+    }
+  pthread_mutex_unlock (&ring->lock);
+
+  return NULL;
+}
+
+/* Append the message LINE/LINE_N to the ring buffer of HANDLE or
+   count it as dropped if there is not enough free space.  */
+static void
+log_ring_add (log_handle_t handle, const char *line, size_t line_n)
+{
+  struct log_ring *ring = handle->ring;
+  size_t start, n;
+
+  pthread_mutex_lock (&ring->lock);
+  if (ring->size - (ring->head - ring->tail) < line_n)
+    ring->dropped++;
+  else
+    {
+      start = ring->head % ring->size;
+      n = start + line_n > ring->size ? ring->size - start : line_n;
+      memcpy (ring->buffer + start, line, n);
+      memcpy (ring->buffer, line + n, line_n - n);
+      ring->head += line_n;
+    }
+  pthread_cond_signal (&ring->cond);
+  pthread_mutex_unlock (&ring->lock);
+}
+
+/* Stop asynchronous logging for HANDLE, after writing out all
+   pending messages.  */
+static void
+log_ring_stop (log_handle_t handle)
+{
+  struct log_ring *ring = handle->ring;
+
+  pthread_mutex_lock (&ring->lock);
+  ring->stop = 1;
+  pthread_cond_signal (&ring->cond);
+  pthread_mutex_unlock (&ring->lock);
+  pthread_join (ring->thread, NULL);
+
+  pthread_cond_destroy (&ring->cond);
+  pthread_mutex_destroy (&ring->lock);
+  xfree (ring->buffer);
+  xfree (ring);
+  handle->ring = NULL;
+}
+
 static gpg_error_t
 internal_release_backend (log_handle_t handle)
 {
   assert (handle->backend != LOG_BACKEND_NONE);
 
+  if (handle->ring)
+    log_ring_stop (handle);
+
   switch (handle->backend)
     {
     case LOG_BACKEND_NONE:
@@ -57,8 +402,9 @@ internal_release_backend (log_handle_t handle)
 
     case LOG_BACKEND_FILE:
       /* FIXME: error checking.  */
-      assert (handle->stream);
-      fclose (handle->stream);
+      assert (handle->fd != -1);
+      close (handle->fd);
+      handle->fd = -1;
       break;
     }
 
@@ -71,19 +417,21 @@ static gpg_error_t
 internal_set_backend_file (log_handle_t handle, const char *filename)
 {
   gpg_error_t err = 0;
-  FILE *stream = NULL;
+  int fd;
 
   assert (handle->backend == LOG_BACKEND_NONE);
 
-  stream = fopen (filename, "a");
-  if (!stream)
+  /* With O_APPEND, each message written by a single write ends up in
+     one piece, even if several processes log to the same file.  */
+  fd = open (filename, O_WRONLY | O_APPEND | O_CREAT, 0666);
+  if (fd == -1)
     {
       err = gpg_error_from_errno (errno);
       goto out;
     }
 
   handle->backend = LOG_BACKEND_FILE;
-  handle->stream = stream;
+  handle->fd = fd;
 
  out:
 
@@ -126,8 +474,13 @@ log_create (log_handle_t *handle)
 
   (*handle)->backend = LOG_BACKEND_NONE;
   (*handle)->min_level = LOG_LEVEL_INFO;
+  (*handle)->format = LOG_FORMAT_TEXT;
   (*handle)->flags = 0;
   (*handle)->prefix[0] = 0;
+  (*handle)->stream = NULL;
+  (*handle)->fd = -1;
+  (*handle)->ring = NULL;
+  memset ((*handle)->fields, 0, sizeof ((*handle)->fields));
 
  out:
 
@@ -137,10 +490,17 @@ log_create (log_handle_t *handle)
 void
 log_destroy (log_handle_t handle)
 {
+  int i;
+
   if (handle)
     {
       if (handle->backend != LOG_BACKEND_NONE)
 	internal_release_backend (handle);
+      for (i = 0; i < LOG_MAX_FIELDS; i++)
+	{
+	  xfree (handle->fields[i].key);
+	  xfree (handle->fields[i].value);
+	}
       xfree (handle);
     }
 }
@@ -202,6 +562,58 @@ log_set_backend_syslog (log_handle_t handle)
   return err;
 }
 
+gpg_error_t
+log_set_async (log_handle_t handle, size_t size)
+{
+  struct log_ring *ring;
+  gpg_error_t err;
+  int ret;
+
+  assert (handle);
+
+  if (handle->ring)
+    log_ring_stop (handle);
+
+  if (!size)
+    return 0;
+
+  if (handle->backend != LOG_BACKEND_STREAM
+      && handle->backend != LOG_BACKEND_FILE)
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+
+  ring = xtrymalloc (sizeof (*ring));
+  if (!ring)
+    return gpg_error_from_errno (errno);
+  ring->buffer = xtrymalloc (size);
+  if (!ring->buffer)
+    {
+      err = gpg_error_from_errno (errno);
+      xfree (ring);
+      return err;
+    }
+  ring->size = size;
+  ring->head = ring->tail = 0;
+  ring->dropped = 0;
+  ring->stop = 0;
+  pthread_mutex_init (&ring->lock, NULL);
+  pthread_cond_init (&ring->cond, NULL);
+
+  handle->ring = ring;
+  ret = pthread_create (&ring->thread, NULL, log_ring_flusher, handle);
+  if (ret)
+    {
+      err = gpg_error_from_errno (ret);
+      pthread_cond_destroy (&ring->cond);
+      pthread_mutex_destroy (&ring->lock);
+      xfree (ring->buffer);
+      xfree (ring);
+      handle->ring = NULL;
+      return err;
+    }
+
+  return 0;
+}
+
 
 void
 log_set_prefix (log_handle_t handle, const char *prefix)
@@ -212,6 +624,70 @@ log_set_prefix (log_handle_t handle, const char *prefix)
   handle->prefix[sizeof (handle->prefix) - 1] = 0;
 }
 
+void
+log_set_format (log_handle_t handle, log_format_t format)
+{
+  assert (handle);
+
+  if (format == LOG_FORMAT_TEXT
+      || format == LOG_FORMAT_KV
+      || format == LOG_FORMAT_JSON)
+    handle->format = format;
+}
+
+gpg_error_t
+log_set_field (log_handle_t handle, const char *key, const char *value)
+{
+  struct log_field *field;
+  char *copy;
+  int i;
+
+  assert (handle);
+
+  field = NULL;
+  for (i = 0; i < LOG_MAX_FIELDS; i++)
+    if (handle->fields[i].key && !strcmp (handle->fields[i].key, key))
+      {
+	field = &handle->fields[i];
+	break;
+      }
+    else if (!handle->fields[i].key && !field)
+      field = &handle->fields[i];
+
+  if (!value)
+    {
+      /* Remove the field.  */
+      if (field && field->key)
+	{
+	  xfree (field->key);
+	  xfree (field->value);
+	  field->key = field->value = NULL;
+	}
+      return 0;
+    }
+
+  if (!field)
+    return gpg_error (GPG_ERR_TOO_LARGE);
+
+  copy = xtrystrdup (value);
+  if (!copy)
+    return gpg_error_from_errno (errno);
+
+  if (!field->key)
+    {
+      field->key = xtrystrdup (key);
+      if (!field->key)
+	{
+	  xfree (copy);
+	  return gpg_error_from_errno (errno);
+	}
+    }
+  xfree (field->value);
+  field->value = copy;
+
+  return 0;
+}
+
 void
 log_set_min_level (log_handle_t handle, log_level_t min_level)
 {
@@ -224,11 +700,192 @@ log_set_min_level (log_handle_t handle, log_level_t min_level)
     handle->min_level = min_level;
 }
 
+/* Return the name of LEVEL.  */
+static const char *
+level_name (log_level_t level)
+{
+  switch (level)
+    {
+    case LOG_LEVEL_DEBUG: return "debug";
+    case LOG_LEVEL_INFO:  return "info";
+    case LOG_LEVEL_ERROR: return "error";
+    case LOG_LEVEL_FATAL: return "fatal";
+    }
+  return "error";
+}
+
+/* Return the syslog priority for messages of level LEVEL.  */
+static int
+syslog_priority (log_level_t level)
+{
+  int priority;
+
+  switch (level)
+    {
+    case LOG_LEVEL_DEBUG:
+      priority = LOG_DEBUG;
+      break;
+
+    case LOG_LEVEL_INFO:
+      priority = LOG_INFO;
+      break;
+
+    case LOG_LEVEL_ERROR:
+      priority = LOG_ERR;
+      break;
+
+    case LOG_LEVEL_FATAL:
+      priority = LOG_ALERT;
+      break;
+
+    default:
+      /* FIXME: what to do when the user passes an invalid log level?
+	 -mo */
+      priority = LOG_ERR;
+      break;
+    }
+
+  return LOG_MAKEPRI (LOG_AUTH, priority);
+}
+
+/* Append the header of a text message of level LEVEL for HANDLE to
+   LB.  */
+static void
+format_text_header (log_handle_t handle, log_level_t level,
+		    struct line_buf *lb)
+{
+  if ((handle->flags & LOG_FLAG_WITH_PREFIX) && (*handle->prefix != 0))
+    lb_printf (lb, "%s ", handle->prefix);
+
+  if (handle->flags & LOG_FLAG_WITH_TIME)
+    {
+      struct tm tm;
+      time_t atime = time (NULL);
+
+      localtime_r (&atime, &tm);
+      lb_printf (lb, "%04d-%02d-%02d %02d:%02d:%02d ",
+		 1900+tm.tm_year, tm.tm_mon+1, tm.tm_mday,
+		 tm.tm_hour, tm.tm_min, tm.tm_sec);
+    }
+
+  if (handle->flags & LOG_FLAG_WITH_PID)
+    lb_printf (lb, "[%u] ", (unsigned int) getpid ());
+
+  switch (level)
+    {
+    case LOG_LEVEL_ERROR:
+    case LOG_LEVEL_FATAL:
+      lb_puts (lb, "error: ");
+      break;
+
+    case LOG_LEVEL_DEBUG:
+      lb_puts (lb, "debug: ");
+      break;
+
+    case LOG_LEVEL_INFO:
+      break;
+    }
+}
+
+/* Start a structured record of level LEVEL for HANDLE in LB: the
+   standard fields and the context fields.  */
+static void
+format_record_header (log_handle_t handle, log_level_t level,
+		      struct line_buf *lb)
+{
+  char buffer[64];
+  struct tm tm;
+  time_t atime;
+  int i;
+
+  if (handle->format == LOG_FORMAT_JSON)
+    lb_put (lb, "{", 1);
+
+  /* Records are meant for machines, thus the time is in UTC.  */
+  atime = time (NULL);
+  gmtime_r (&atime, &tm);
+  snprintf (buffer, sizeof (buffer), "%04d-%02d-%02dT%02d:%02d:%02dZ",
+	    1900+tm.tm_year, tm.tm_mon+1, tm.tm_mday,
+	    tm.tm_hour, tm.tm_min, tm.tm_sec);
+  lb_put_field (lb, handle->format, "time", buffer);
+
+  if (*handle->prefix)
+    lb_put_field (lb, handle->format, "prog", handle->prefix);
+
+  snprintf (buffer, sizeof (buffer), "%u", (unsigned int) getpid ());
+  lb_put_field (lb, handle->format, "pid", buffer);
+
+  lb_put_field (lb, handle->format, "level", level_name (level));
+
+  for (i = 0; i < LOG_MAX_FIELDS; i++)
+    if (handle->fields[i].key)
+      lb_put_field (lb, handle->format,
+		    handle->fields[i].key, handle->fields[i].value);
+}
+
+/* Format the notice about DROPPED messages lost by asynchronous
+   logging for HANDLE into LB, including the terminating newline.  In
+   the structured formats, this is a log_dropped event.  */
+static void
+format_dropped_notice (log_handle_t handle, unsigned long dropped,
+		       struct line_buf *lb)
+{
+  char count[32];
+
+  snprintf (count, sizeof (count), "%lu", dropped);
+
+  lb_init (lb);
+  if (handle->format == LOG_FORMAT_TEXT)
+    {
+      format_text_header (handle, LOG_LEVEL_ERROR, lb);
+      lb_printf (lb, "%s log messages dropped", count);
+    }
+  else
+    {
+      format_record_header (handle, LOG_LEVEL_ERROR, lb);
+      lb_put_field (lb, handle->format, "event", "log_dropped");
+      lb_put_field (lb, handle->format, "count", count);
+      if (handle->format == LOG_FORMAT_JSON)
+	lb_put (lb, "}", 1);
+    }
+  /* The terminating nul is always accounted for.  */
+  lb->p[lb->len++] = '\n';
+}
+
+/* Write the record or message in LB, which must not contain the
+   terminating newline yet, through the backend of HANDLE at level
+   LEVEL.  */
+static void
+internal_emit_line (log_handle_t handle, log_level_t level,
+		    struct line_buf *lb)
+{
+  struct iovec iov;
+
+  if (handle->backend == LOG_BACKEND_SYSLOG)
+    {
+      lb->p[lb->len] = 0;
+      syslog (syslog_priority (level), "%s", lb->p);
+      return;
+    }
+
+  /* The terminating nul is always accounted for.  */
+  lb->p[lb->len++] = '\n';
+
+  if (handle->ring)
+    log_ring_add (handle, lb->p, lb->len);
+  else
+    {
+      iov.iov_base = lb->p;
+      iov.iov_len = lb->len;
+      internal_emit (handle, &iov, 1);
+    }
+}
+
 static gpg_error_t
 internal_log_write (log_handle_t handle, log_level_t level,
 		    const char *fmt, va_list ap)
 {
-  gpg_error_t err;
+  struct line_buf lb;
 
   assert (handle->backend != LOG_BACKEND_NONE);
 
@@ -240,84 +897,72 @@ internal_log_write (log_handle_t handle, log_level_t level,
        min_level. */
     return 0;
 
-  if (handle->backend == LOG_BACKEND_SYSLOG)
+  if (handle->backend == LOG_BACKEND_SYSLOG
+      && handle->format == LOG_FORMAT_TEXT)
     {
-      int syslog_priority;
+      vsyslog (syslog_priority (level), fmt, ap);
+      return 0;
+    }
 
-      switch (level)
-	{
-	case LOG_LEVEL_DEBUG:
-	  syslog_priority = LOG_DEBUG;
-	  break;
-
-	case LOG_LEVEL_INFO:
-	  syslog_priority = LOG_INFO;
-	  break;
-
-	case LOG_LEVEL_ERROR:
-	  syslog_priority = LOG_ERR;
-	  break;
-
-	case LOG_LEVEL_FATAL:
-	  syslog_priority = LOG_ALERT;
-	  break;
-
-	default:
-	  /* FIXME: what to do when the user passes an invalid log
-	     level? -mo */
-	  syslog_priority = LOG_ERR;
-	  break;
-	}
-	  
-      vsyslog (LOG_MAKEPRI (LOG_AUTH, syslog_priority), fmt, ap);
-      err = 0;
+  /* The whole message is formatted into a single buffer and written
+     at once.  */
+  lb_init (&lb);
+  if (handle->format == LOG_FORMAT_TEXT)
+    {
+      format_text_header (handle, level, &lb);
+      lb_vprintf (&lb, fmt, ap);
     }
-  else if (handle->backend == LOG_BACKEND_STREAM
-	   || handle->backend == LOG_BACKEND_FILE)
+  else
     {
-      FILE *stream = handle->stream;
-
-      assert (stream);
-
-      if ((handle->flags & LOG_FLAG_WITH_PREFIX) && (*handle->prefix != 0))
-	fprintf (stream, "%s ", handle->prefix);
-
-      if (handle->flags & LOG_FLAG_WITH_TIME)
-	{
-	  struct tm *tp;
-	  time_t atime = time (NULL);
-          
-	  tp = localtime (&atime);
-	  fprintf (stream, "%04d-%02d-%02d %02d:%02d:%02d ",
-		   1900+tp->tm_year, tp->tm_mon+1, tp->tm_mday,
-		   tp->tm_hour, tp->tm_min, tp->tm_sec);
-	}
-
-      if (handle->flags & LOG_FLAG_WITH_PID)
-	fprintf (stream, "[%u] ", (unsigned int) getpid ());
+      struct line_buf msg;
+
+      format_record_header (handle, level, &lb);
+      lb_init (&msg);
+      lb_vprintf (&msg, fmt, ap);
+      msg.p[msg.len] = 0;
+      lb_put_field (&lb, handle->format, "msg", msg.p);
+      lb_release (&msg);
+      if (handle->format == LOG_FORMAT_JSON)
+	lb_put (&lb, "}", 1);
+    }
+  internal_emit_line (handle, level, &lb);
+  lb_release (&lb);
 
-      switch (level)
-	{
-	case LOG_LEVEL_ERROR:
-	case LOG_LEVEL_FATAL:
-	  fprintf (stream, "error: ");
-	  break;
+  return 0;
+}
 
-	case LOG_LEVEL_DEBUG:
-	  fprintf (stream, "debug: ");
-	  break;
+gpg_error_t
+log_event (log_handle_t handle, log_level_t level, const char *event, ...)
+{
+  const char *key, *value;
+  struct line_buf lb;
+  va_list ap;
 
-	case LOG_LEVEL_INFO:
-	  break;
-	}
+  if (!handle
+      || handle->backend == LOG_BACKEND_NONE
+      || handle->format == LOG_FORMAT_TEXT
+      || level < handle->min_level)
+    return 0;
 
-      vfprintf (stream, fmt, ap);
-      putc ('\n', stream);
+  lb_init (&lb);
+  format_record_header (handle, level, &lb);
+  lb_put_field (&lb, handle->format, "event", event);
 
-      err = 0;
+  va_start (ap, event);
+  while ((key = va_arg (ap, const char *)))
+    {
+      value = va_arg (ap, const char *);
+      if (value)
+	lb_put_field (&lb, handle->format, key, value);
     }
+  va_end (ap);
 
-  return err;
+  if (handle->format == LOG_FORMAT_JSON)
+    lb_put (&lb, "}", 1);
+  internal_emit_line (handle, level, &lb);
+  lb_release (&lb);
+
+  return 0;
 }
 
 gpg_error_t
@@ -47,8 +47,18 @@ typedef enum
     LOG_LEVEL_FATAL
   } log_level_t;
 
+typedef enum
+  {
+    LOG_FORMAT_TEXT,		/* Free-form text.  */
+    LOG_FORMAT_KV,		/* One key=value record per line.  */
+    LOG_FORMAT_JSON		/* One JSON object per line.  */
+  } log_format_t;
+
 #define LOG_PREFIX_LENGTH 128
 
+/* Maximum number of context fields.  */
+#define LOG_MAX_FIELDS 8
+
 gpg_error_t log_create (log_handle_t *handle);
 void log_destroy (log_handle_t handle);
 
@@ -57,15 +67,40 @@ void log_unset_flags (log_handle_t handle, unsigned int flags);
 void log_set_prefix (log_handle_t handle, const char *prefix);
 void log_set_min_level (log_handle_t handle, log_level_t min_level);
 
+/* Select the output format of HANDLE.  In the structured formats
+   every message becomes a record with the fields time, prog (the
+   prefix), pid, level, the context fields and msg.  */
+void log_set_format (log_handle_t handle, log_format_t format);
+
+/* Set the context field KEY of HANDLE to VALUE, or remove it if VALUE
+   is NULL.  Context fields are added to every structured record.  */
+gpg_error_t log_set_field (log_handle_t handle, const char *key,
+			   const char *value);
+
 gpg_error_t log_set_backend_stream (log_handle_t handle, FILE *fp);
 gpg_error_t log_set_backend_file (log_handle_t handle, const char *filename);
 gpg_error_t log_set_backend_syslog (log_handle_t handle);
 
+/* Make HANDLE log asynchronously: messages are collected in a ring
+   buffer of SIZE bytes and written out by a background thread.
+   Messages which do not fit into the buffer are dropped, the number
+   of dropped messages is logged.  Only supported for the stream and
+   file backends; setting another backend or a SIZE of zero switches
+   back to synchronous logging.  */
+gpg_error_t log_set_async (log_handle_t handle, size_t size);
+
 gpg_error_t log_write (log_handle_t handle, log_level_t level,
 		       const char *fmt, ...);
 gpg_error_t log_write_va (log_handle_t handle, log_level_t level,
 			  const char *fmt, va_list ap);
 
+/* Log a structured record for EVENT at level LEVEL.  The variable
+   arguments are pairs of field names and string values, terminated by
+   NULL; fields with a NULL value are skipped.  Events are only logged
+   in the structured formats.  */
+gpg_error_t log_event (log_handle_t handle, log_level_t level,
+		       const char *event, ...);
+
 gpg_error_t log_msg_debug (log_handle_t handle, const char *fmt, ...);
 gpg_error_t log_msg_info  (log_handle_t handle, const char *fmt, ...);
 gpg_error_t log_msg_error (log_handle_t handle, const char *fmt, ...);
@@ -26,6 +26,7 @@
 #include <stdarg.h>
 #include <assert.h>
 #include <limits.h>
+#include <stdint.h>
 #include <errno.h>
 
 #include <gpg-error.h>
@@ -50,17 +51,11 @@ struct simpleparse_handle
   const char *syntax_description;	   /* Description of command-line syntax. */
   const char *copyright_info;		   /* Copyright information. */
   simpleparse_opt_spec_t *specs;   /* Specifications for the supported options. */
+  const simpleparse_opt_hash_t *hash; /* Perfect hash for SPECS or NULL. */
   FILE *stream_stdout;
   FILE *stream_stderr;
 };
 
-/** String list. **/
-
-#define TOKENSIZE 512
-
-/* For now, we use static allocation... */
-typedef char token_t[TOKENSIZE];
-
 /* Install the logging handle LOGHANDLE in HANDLE.  */
 void
 simpleparse_set_loghandle (simpleparse_handle_t handle,
@@ -75,10 +70,39 @@ simpleparse_set_specs (simpleparse_handle_t handle, simpleparse_opt_spec_t *spec
 {
   assert (specs);
   handle->specs = specs;
+  handle->hash = NULL;
   /* FIXME, necessary to check for INT_MAX overflow? */
   return 0;
 }
 
+/* Like simpleparse_set_specs, but long options are looked up through
+   HASH, which must have been generated for SPECS by
+   gen-opthash.awk.  */
+gpg_error_t
+simpleparse_set_specs_hashed (simpleparse_handle_t handle,
+			      simpleparse_opt_spec_t *specs,
+			      const simpleparse_opt_hash_t *hash)
+{
+  gpg_error_t err;
+
+  err = simpleparse_set_specs (handle, specs);
+  if (!err)
+    handle->hash = hash;
+  return err;
+}
+
+/* The hash function used by gen-opthash.awk.  */
+static unsigned int
+opt_hash (unsigned int mult, const char *name)
+{
+  uint32_t h = 0;
+
+  for (; *name; name++)
+    h = h * mult + (unsigned char) *name;
+
+  return h;
+}
+
 /* This function looks up the specification structure for a long
    option by it's name in the context of HANDLE.  The name is given as
    NAME. On success the struct is stored in *SPEC. Returns proper
@@ -94,6 +118,21 @@ lookup_opt_spec_long (simpleparse_handle_t handle,
 
   assert (name);
 
+  if (handle->hash)
+    {
+      /* Only the option in NAME's slot can match.  */
+      const simpleparse_opt_hash_t *hash = handle->hash;
+      unsigned int slot;
+
+      slot = hash->slots[opt_hash (hash->mult, name) % hash->size];
+      if (slot && !strcmp (name, handle->specs[slot - 1].long_opt))
+	*spec = handle->specs[slot - 1];
+      else
+	err = gpg_error (GPG_ERR_UNKNOWN_OPTION);
+
+      return err;
+    }
+
   for (i = 0; handle->specs[i].long_opt; i++)
     if (!strcmp (name, handle->specs[i].long_opt))
       break;
@@ -394,10 +433,13 @@ internal_parse_args (simpleparse_handle_t handle, unsigned int flags,
   return err;
 }
 	    
+/* The tokens of a line.  The tokens point into the line buffer, the
+   index is reused for all lines of a parse.  */
 typedef struct
 {
-  token_t *tokens;
-  unsigned int size;
+  char **tokens;
+  unsigned int size;		/* Number of tokens.  */
+  unsigned int alloced;		/* Allocated slots.  */
 } token_list_t;
 
 static gpg_error_t
@@ -405,62 +447,54 @@ token_list_init (token_list_t *list)
 {
   list->tokens = NULL;
   list->size = 0;
+  list->alloced = 0;
 
   return 0;
 }
 
 static gpg_error_t
-token_list_add (token_list_t *list, const char *item, int length)
+token_list_add (token_list_t *list, char *token)
 {
   gpg_error_t err = 0;
-  int item_length;
-  token_t *tokens = NULL;
-
-  if (!item)
-    goto out;
-
-  if (list->size == UINT_MAX)
-    {
-      err = gpg_error (GPG_ERR_TOO_LARGE);
-      goto out;
-    }
+  unsigned int alloced;
+  char **tokens;
 
-  if (length == -1)
+  if (list->size == list->alloced)
     {
-      item_length = my_strlen (item);
-      if (item_length)
+      if (list->alloced > UINT_MAX / 2 / sizeof (*tokens))
 	{
 	  err = gpg_error (GPG_ERR_TOO_LARGE);
 	  goto out;
 	}
-    }
-  else
-    item_length = length;
 
-  if (item_length >= TOKENSIZE)
-    {
-      err = gpg_error (GPG_ERR_TOO_LARGE);
-      goto out;
-    }
-
-  tokens = xtryrealloc (list->tokens, sizeof (*list->tokens) * (list->size + 1));
-  if (!tokens)
-    {
-      err = gpg_error_from_errno (errno);
-      goto out;
+      /* Grow by doubling, so that adding a token is cheap on
+	 average.  */
+      alloced = list->alloced ? 2 * list->alloced : 8;
+      tokens = xtryrealloc (list->tokens, sizeof (*tokens) * alloced);
+      if (!tokens)
+	{
+	  err = gpg_error_from_errno (errno);
+	  goto out;
+	}
+      list->tokens = tokens;
+      list->alloced = alloced;
     }
 
-  list->tokens = tokens;
-  assert (item_length < TOKENSIZE);
-  memcpy (list->tokens[list->size], item, item_length);
-  list->tokens[list->size][item_length] = 0;
-  list->size++;
+  list->tokens[list->size++] = token;
 
  out:
 
   return err;
 }
 
+/* Forget the tokens in LIST, but keep the index for the next
+   line.  */
+static void
+token_list_reset (token_list_t *list)
+{
+  list->size = 0;
+}
+
 static gpg_error_t
 token_list_clear (token_list_t *list)
 {
@@ -468,19 +502,20 @@ token_list_clear (token_list_t *list)
     xfree (list->tokens);
   list->tokens = NULL;
   list->size = 0;
+  list->alloced = 0;
   return 0;
 }
 
+/* Split LINE into tokens, which are stored in TOKENS.  LINE is
+   modified: the tokens are terminated in place.  */
 static gpg_error_t
 internal_parse_line (char *line, token_list_t *tokens)
 {
-  token_list_t token_list;
   gpg_error_t err;
-  char *p;
+  char *p, *end;
 
-  err = token_list_init (&token_list);
-  if (err)
-    goto out;
+  err = 0;
+  token_list_reset (tokens);
 
   /* Start. */
   p = line;
@@ -559,23 +594,25 @@ internal_parse_line (char *line, token_list_t *tokens)
       /* Now we have a new token in {p[0], p[1], ..., p[i-1]}; i is
 	 positive. In case of quoted tokens, we must subtract one
 	 byte, since the trailing quote character is not part of the
-	 token. */
+	 token.  The byte following the token is overwritten with a
+	 NUL character; a delimiting whitespace must be skipped before
+	 that.  */
 
-      err = token_list_add (&token_list, p, i - !!quoting_char);
+      err = token_list_add (tokens, p);
       if (err)
 	goto out;
 
+      end = p + i - !!quoting_char;
       p += i;
+      if (!quoting_char && *p)
+	p++;
+      *end = '\0';
     }
 	      
  out:
 
   if (err)
-    {
-      token_list_clear (&token_list);
-    }
-  else
-    *tokens = token_list;
+    token_list_reset (tokens);
 
   return err;
 }
@@ -644,16 +681,6 @@ internal_process_tokens (simpleparse_handle_t handle, token_list_t tokens)
   return err;
 }
 
-/* Replaces the first occurence of a newline character in the string S
-   with a NUL character. */
-static void
-cut_trailing_newline (char *s)
-{
-  char *nl = strchr (s, '\n');
-  if (nl)
-    *nl = '\0';
-}
-
 /* Parse the stream STREAM using the state contained in HANDLE. FLAGS
    is not used yet. Returns proper error code.  */
 static gpg_error_t
@@ -661,38 +688,36 @@ internal_parse_stream (simpleparse_handle_t handle, unsigned int flags, FILE *st
 {
   size_t line_size;
   char *line;
-  int length;
+  ssize_t length;
   token_list_t tokens;
   gpg_error_t err;
-  int ret;
 
-  tokens.tokens = NULL;
-  tokens.size = 0;
+  /* The line buffer and the token index are reused for all lines.  */
+  line = NULL;
+  line_size = 0;
+  token_list_init (&tokens);
   err = 0;
 
   while (1)
     {
-      line = NULL;
-      line_size = 0;
-
-      ret = getline (&line, &line_size, stream);
-      if (ret == -1)
+      length = getline (&line, &line_size, stream);
+      if (length == -1)
 	{
 	  if (!feof (stream))
 	    err = gpg_error_from_errno (errno);
 	  goto out;
 	}
 
-      /* We simply ignore NUL characters in line.  */
-      length = my_strlen (line);
-      if (length == -1)
+      if (length > INT_MAX)
 	{
 	  err = GPG_ERR_TOO_LARGE;
 	  goto out;
 	}
 
-      /* Ignore terminating newline character.  */
-      cut_trailing_newline (line);
+      /* Ignore terminating newline character.  NUL characters in the
+	 line simply end it.  */
+      if (length && line[length - 1] == '\n')
+	line[length - 1] = '\0';
       
       /* Split line into tokens. */
 
@@ -707,18 +732,12 @@ internal_parse_stream (simpleparse_handle_t handle, unsigned int flags, FILE *st
 	  if (err)
 	    goto out;
 	}
-
-      /* Release. */
-
-      token_list_clear (&tokens);
-      free (line);
-      line = NULL;
     }
 
  out:
 
-  if (line)
-    free (line);		/* Allocated by getline, thus standard
+  token_list_clear (&tokens);
+  free (line);			/* Allocated by getline, thus standard
 				   free. */
   return err;
 }
@@ -837,6 +856,27 @@ simpleparse_set_parse_cb (simpleparse_handle_t handle,
   handle->parse_cookie = cookie;
 }
 
+/* Store the parser callback of HANDLE and it's cookie in *PARSE_CB
+   and *COOKIE.  */
+void
+simpleparse_get_parse_cb (simpleparse_handle_t handle,
+			  simpleparse_parse_cb_t *parse_cb, void **cookie)
+{
+  assert (handle);
+
+  *parse_cb = handle->parse_cb;
+  *cookie = handle->parse_cookie;
+}
+
+/* Return the option specifications installed in HANDLE.  */
+simpleparse_opt_spec_t *
+simpleparse_get_specs (simpleparse_handle_t handle)
+{
+  assert (handle);
+
+  return handle->specs;
+}
+
 void
 simpleparse_set_i18n_cb (simpleparse_handle_t handle,
 			 simpleparse_i18n_cb_t i18n_cb, void *cookie)
@@ -50,6 +50,16 @@ typedef struct
   unsigned flags;
   const char *description; /* optional option description */
 } simpleparse_opt_spec_t;
+
+/* Perfect hash over the long options of a static specification
+   table, as generated by gen-opthash.awk.  */
+typedef struct
+{
+  unsigned int mult;		/* Multiplier of the hash function.  */
+  unsigned int size;		/* Number of slots.  */
+  const unsigned char *slots;	/* Index + 1 into the table, or 0.  */
+} simpleparse_opt_hash_t;
+
 typedef struct simpleparse_handle *simpleparse_handle_t;
 
 gpg_error_t simpleparse_create (simpleparse_handle_t *handle);
@@ -64,12 +74,19 @@ typedef gpg_error_t (*simpleparse_parse_cb_t) (void *cookie,
 void simpleparse_set_parse_cb (simpleparse_handle_t handle,
 			       simpleparse_parse_cb_t parse_cb, void *cookie);
 
+void simpleparse_get_parse_cb (simpleparse_handle_t handle,
+			       simpleparse_parse_cb_t *parse_cb, void **cookie);
+
 typedef const char *(*simpleparse_i18n_cb_t) (void *cookie, const char *msg);
 
 void simpleparse_set_i18n_cb (simpleparse_handle_t handle,
 			      simpleparse_i18n_cb_t i18n_cb, void *cookie);
 
 gpg_error_t simpleparse_set_specs (simpleparse_handle_t handle, simpleparse_opt_spec_t *specs);
+gpg_error_t simpleparse_set_specs_hashed (simpleparse_handle_t handle,
+					 simpleparse_opt_spec_t *specs,
+					 const simpleparse_opt_hash_t *hash);
+simpleparse_opt_spec_t *simpleparse_get_specs (simpleparse_handle_t handle);
 
 void simpleparse_set_name (simpleparse_handle_t handle, const char *program_name);
 void simpleparse_set_package (simpleparse_handle_t handle, const char *package_name);
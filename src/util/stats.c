@@ -0,0 +1,333 @@
+/* stats.c - Authentication latency statistics for Poldi
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+#include <poldi.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stats.h"
+
+#define STATS_MAGIC   0x504f4c53 /* "POLS" */
+#define STATS_VERSION 1
+
+struct stats_s
+{
+  struct stats_data *data;	/* The mapped file.  */
+  int writable;
+};
+
+static const char *const phase_names[STATS_PHASES] =
+  {
+    "total",
+    "config",
+    "scd-connect",
+    "wait-for-card",
+    "learn",
+    "usersdb-lookup",
+    "key-lookup",
+    "cert-lookup",
+    "cert-validate",
+    "pin-entry",
+    "pksign",
+    "verify"
+  };
+
+static const char *const counter_names[STATS_COUNTERS] =
+  {
+    "success",
+    "failure"
+  };
+
+/* Initialize the statistics data DATA.  */
+static void
+init_data (struct stats_data *data)
+{
+  memset (data, 0, sizeof (*data));
+  data->magic = STATS_MAGIC;
+  data->version = STATS_VERSION;
+  data->reset_time = time (NULL);
+}
+
+/* Map the statistics file open at FD, for writing if WRITABLE is
+   true, and store a new handle in *STATS.  */
+static gpg_error_t
+map_file (int fd, int writable, stats_t *stats)
+{
+  stats_t handle;
+  void *map;
+
+  handle = xtrymalloc (sizeof (*handle));
+  if (!handle)
+    return gpg_error_from_syserror ();
+
+  map = mmap (NULL, sizeof (struct stats_data),
+	      writable ? PROT_READ | PROT_WRITE : PROT_READ,
+	      MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    {
+      gpg_error_t err = gpg_error_from_syserror ();
+      xfree (handle);
+      return err;
+    }
+
+  handle->data = map;
+  handle->writable = writable;
+  *stats = handle;
+
+  return 0;
+}
+
+/* Open the directory containing FILENAME and store a descriptor in
+   *DIR_FD.  Returns proper error code.  */
+static gpg_error_t
+open_directory (const char *filename, int *dir_fd)
+{
+  const char *slash;
+  char *dirname;
+  size_t len;
+  int fd;
+
+  slash = strrchr (filename, '/');
+  if (!slash)
+    fd = open (".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  else
+    {
+      /* Keep the slash of a file in the root directory.  */
+      len = slash == filename ? 1 : slash - filename;
+      dirname = xtrymalloc (len + 1);
+      if (!dirname)
+	return gpg_error_from_syserror ();
+      memcpy (dirname, filename, len);
+      dirname[len] = 0;
+      fd = open (dirname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      xfree (dirname);
+    }
+  if (fd == -1)
+    return gpg_error_from_syserror ();
+
+  *dir_fd = fd;
+
+  return 0;
+}
+
+/* Open the statistics file FILENAME for recording, creating it if
+   needed, and store a new handle in *STATS.  Since this is done as
+   root, the file and its directory must be owned by root; links are
+   not followed.  Returns proper error code.  */
+gpg_error_t
+stats_open (const char *filename, stats_t *stats)
+{
+  struct stats_data data;
+  struct stat statbuf;
+  const char *basename;
+  gpg_error_t err;
+  ssize_t n;
+  int dir_fd = -1;
+  int fd;
+
+  err = open_directory (filename, &dir_fd);
+  if (err)
+    return err;
+  if (fstat (dir_fd, &statbuf))
+    {
+      err = gpg_error_from_syserror ();
+      close (dir_fd);
+      return err;
+    }
+  if (statbuf.st_uid != 0)
+    {
+      close (dir_fd);
+      return gpg_error (GPG_ERR_EPERM);
+    }
+
+  basename = strrchr (filename, '/');
+  basename = basename ? basename + 1 : filename;
+  fd = openat (dir_fd, basename, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC,
+	       0644);
+  err = fd == -1 ? gpg_error_from_syserror () : 0;
+  close (dir_fd);
+  if (err)
+    return err;
+
+  /* The file is initialized by whoever finds it empty or outdated;
+     the lock serializes this between processes.  */
+  if (flock (fd, LOCK_EX) || fstat (fd, &statbuf))
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+  if (!S_ISREG (statbuf.st_mode) || statbuf.st_uid != 0
+      || statbuf.st_nlink != 1)
+    {
+      err = gpg_error (GPG_ERR_EPERM);
+      goto out;
+    }
+
+  /* Other processes may still have the file mapped, so it is never
+     shrunk: an outdated file is overwritten in place, which grows it
+     as needed, and any trailing bytes are left alone.  */
+  n = 0;
+  if (statbuf.st_size >= (off_t) sizeof (data))
+    n = pread (fd, &data, sizeof (data), 0);
+  if (n != sizeof (data)
+      || data.magic != STATS_MAGIC || data.version != STATS_VERSION)
+    {
+      init_data (&data);
+      if (pwrite (fd, &data, sizeof (data), 0) != sizeof (data))
+	{
+	  err = gpg_error_from_syserror ();
+	  goto out;
+	}
+    }
+
+  err = map_file (fd, 1, stats);
+
+ out:
+
+  close (fd);
+
+  return err;
+}
+
+/* Open the statistics file FILENAME for reading only and store a new
+   handle in *STATS.  Returns proper error code.  */
+gpg_error_t
+stats_open_readonly (const char *filename, stats_t *stats)
+{
+  struct stats_data data;
+  gpg_error_t err;
+  int fd;
+
+  fd = open (filename, O_RDONLY);
+  if (fd == -1)
+    return gpg_error_from_syserror ();
+
+  if (pread (fd, &data, sizeof (data), 0) != sizeof (data)
+      || data.magic != STATS_MAGIC || data.version != STATS_VERSION)
+    err = gpg_error (GPG_ERR_INV_DATA);
+  else
+    err = map_file (fd, 0, stats);
+
+  close (fd);
+
+  return err;
+}
+
+/* Close the statistics handle STATS.  */
+void
+stats_close (stats_t stats)
+{
+  if (stats)
+    {
+      munmap (stats->data, sizeof (struct stats_data));
+      xfree (stats);
+    }
+}
+
+/* Return the statistics data of STATS.  */
+const struct stats_data *
+stats_get (stats_t stats)
+{
+  return stats->data;
+}
+
+/* Reset all statistics of STATS to zero.  */
+void
+stats_reset (stats_t stats)
+{
+  if (stats && stats->writable)
+    {
+      memset (stats->data->counters, 0, sizeof (stats->data->counters));
+      memset (stats->data->phases, 0, sizeof (stats->data->phases));
+      stats->data->reset_time = time (NULL);
+    }
+}
+
+/* Return the current time of the monotonic clock in microseconds.  */
+uint64_t
+stats_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * (uint64_t) 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Record that PHASE took the time since START, as returned by
+   stats_now, in STATS.  */
+void
+stats_record (stats_t stats, enum stats_phase phase, uint64_t start)
+{
+  struct stats_phase_data *p;
+  uint64_t duration, max;
+  unsigned int bucket;
+  uint64_t ms;
+
+  if (!stats || !stats->writable || phase >= STATS_PHASES)
+    return;
+
+  duration = stats_now () - start;
+  p = &stats->data->phases[phase];
+
+  for (bucket = 0, ms = duration / 1000;
+       ms && bucket < STATS_BUCKETS - 1;
+       ms >>= 1)
+    bucket++;
+
+  __atomic_fetch_add (&p->count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add (&p->sum_us, duration, __ATOMIC_RELAXED);
+  __atomic_fetch_add (&p->buckets[bucket], 1, __ATOMIC_RELAXED);
+
+  max = __atomic_load_n (&p->max_us, __ATOMIC_RELAXED);
+  while (duration > max
+	 && !__atomic_compare_exchange_n (&p->max_us, &max, duration, 0,
+					  __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
+/* Increment COUNTER in STATS.  */
+void
+stats_count (stats_t stats, enum stats_counter counter)
+{
+  if (!stats || !stats->writable || counter >= STATS_COUNTERS)
+    return;
+
+  __atomic_fetch_add (&stats->data->counters[counter], 1, __ATOMIC_RELAXED);
+}
+
+/* Return the name of PHASE.  */
+const char *
+stats_phase_name (enum stats_phase phase)
+{
+  return phase < STATS_PHASES ? phase_names[phase] : "?";
+}
+
+/* Return the name of COUNTER.  */
+const char *
+stats_counter_name (enum stats_counter counter)
+{
+  return counter < STATS_COUNTERS ? counter_names[counter] : "?";
+}
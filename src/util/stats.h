@@ -0,0 +1,130 @@
+/* stats.h - Authentication latency statistics for Poldi
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+/* Poldi records how long the phases of an authentication take into a
+   host-wide statistics file, which is memory-mapped and shared by all
+   processes using Poldi.  For every phase the file contains a count,
+   the sum and the maximum of the durations and a histogram with
+   logarithmic buckets; additionally there are some plain counters.
+   All updates are done with atomic operations, no locking is
+   involved.
+
+   All functions taking a stats handle accept NULL, in which case they
+   do nothing; so that a failure to open the statistics file does not
+   need to be handled specially.  */
+
+#ifndef POLDI_STATS_H
+#define POLDI_STATS_H
+
+#include <poldi.h>
+
+#include <stdint.h>
+
+/* Phases of an authentication.  */
+enum stats_phase
+  {
+    STATS_PHASE_TOTAL,		/* Complete authentication.  */
+    STATS_PHASE_CONFIG,		/* Parsing configuration.  */
+    STATS_PHASE_SCD_CONNECT,	/* Waiting for the scdaemon
+				   connection.  */
+    STATS_PHASE_WAIT_FOR_CARD,	/* Waiting for the card.  */
+    STATS_PHASE_LEARN,		/* Reading card attributes.  */
+    STATS_PHASE_USERSDB_LOOKUP,	/* Looking up accounts.  */
+    STATS_PHASE_KEY_LOOKUP,	/* Looking up the card's key.  */
+    STATS_PHASE_CERT_LOOKUP,	/* Looking up the certificate.  */
+    STATS_PHASE_CERT_VALIDATE,	/* Validating the certificate.  */
+    STATS_PHASE_PIN_ENTRY,	/* Asking the user for the PIN.  */
+    STATS_PHASE_PKSIGN,		/* Signing the challenge, including
+				   PIN entry.  */
+    STATS_PHASE_VERIFY,		/* Verifying the signature.  */
+    STATS_PHASES
+  };
+
+/* Counters.  */
+enum stats_counter
+  {
+    STATS_COUNTER_SUCCESS,	/* Successful authentications.  */
+    STATS_COUNTER_FAILURE,	/* Failed authentications.  */
+    STATS_COUNTERS
+  };
+
+/* Number of histogram buckets.  Bucket 0 counts durations below one
+   millisecond, bucket I durations from 2^(I-1) up to 2^I
+   milliseconds; the last bucket counts everything longer.  */
+#define STATS_BUCKETS 16
+
+/* Statistics for one phase.  */
+struct stats_phase_data
+{
+  uint64_t count;
+  uint64_t sum_us;		/* Sum of durations in
+				   microseconds.  */
+  uint64_t max_us;		/* Longest duration in
+				   microseconds.  */
+  uint64_t buckets[STATS_BUCKETS];
+};
+
+/* Layout of the statistics file.  */
+struct stats_data
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t reset_time;		/* Time of creation or last reset,
+				   seconds since the epoch.  */
+  uint64_t counters[STATS_COUNTERS];
+  struct stats_phase_data phases[STATS_PHASES];
+};
+
+typedef struct stats_s *stats_t;
+
+/* Open the statistics file FILENAME for recording, creating it if
+   needed, and store a new handle in *STATS.  Returns proper error
+   code.  */
+gpg_error_t stats_open (const char *filename, stats_t *stats);
+
+/* Open the statistics file FILENAME for reading only and store a new
+   handle in *STATS.  Returns proper error code.  */
+gpg_error_t stats_open_readonly (const char *filename, stats_t *stats);
+
+/* Close the statistics handle STATS.  */
+void stats_close (stats_t stats);
+
+/* Return the statistics data of STATS.  */
+const struct stats_data *stats_get (stats_t stats);
+
+/* Reset all statistics of STATS to zero.  */
+void stats_reset (stats_t stats);
+
+/* Return the current time of the monotonic clock in microseconds.  */
+uint64_t stats_now (void);
+
+/* Record that PHASE took the time since START, as returned by
+   stats_now, in STATS.  */
+void stats_record (stats_t stats, enum stats_phase phase, uint64_t start);
+
+/* Increment COUNTER in STATS.  */
+void stats_count (stats_t stats, enum stats_counter counter);
+
+/* Return the name of PHASE.  */
+const char *stats_phase_name (enum stats_phase phase);
+
+/* Return the name of COUNTER.  */
+const char *stats_counter_name (enum stats_counter counter);
+
+#endif
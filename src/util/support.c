@@ -197,6 +197,85 @@ string_to_sexp (gcry_sexp_t *sexp, char *string)
   return err;
 }
 
+/* Key files smaller than this are read into a buffer on the stack by
+   file_to_sexp(); mapping them would be more expensive than copying
+   them.  */
+#define FILE_TO_SEXP_BUFSIZE 4096
+
+/* This functions reads the S-Expression contained in the file
+   FILENAME into a new S-Expression object, which is to be stored in
+   *SEXP.  The file may contain the S-Expression in canonical or
+   advanced format; it is parsed directly from a stack buffer or a
+   read-only mapping of the file, without allocating an intermediate
+   copy.  Returns GPG_ERR_NO_DATA in case the file is empty, other
+   error codes on failure.  */
+gpg_error_t
+file_to_sexp (const char *filename, gcry_sexp_t *sexp)
+{
+  char buffer[FILE_TO_SEXP_BUFSIZE];
+  struct stat statbuf;
+  gpg_error_t err;
+  ssize_t nread;
+  void *map;
+  int fd;
+
+  map = MAP_FAILED;
+
+  fd = open (filename, O_RDONLY);
+  if (fd == -1)
+    {
+      err = gpg_error_from_errno (errno);
+      goto out;
+    }
+
+  if (fstat (fd, &statbuf))
+    {
+      err = gpg_error_from_errno (errno);
+      goto out;
+    }
+
+  if (! statbuf.st_size)
+    {
+      err = gpg_error (GPG_ERR_NO_DATA);
+      goto out;
+    }
+
+  /* Given the length, Libgcrypt accepts the canonical as well as the
+     advanced format and does not require a terminating NUL.  */
+  if (statbuf.st_size <= sizeof (buffer))
+    {
+      do
+	nread = read (fd, buffer, statbuf.st_size);
+      while (nread == -1 && errno == EINTR);
+      if (nread != statbuf.st_size)
+	{
+	  err = (nread == -1
+		 ? gpg_error_from_errno (errno) : gpg_error (GPG_ERR_EOF));
+	  goto out;
+	}
+      err = gcry_sexp_new (sexp, buffer, nread, 0);
+    }
+  else
+    {
+      map = mmap (NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map == MAP_FAILED)
+	{
+	  err = gpg_error_from_errno (errno);
+	  goto out;
+	}
+      err = gcry_sexp_new (sexp, map, statbuf.st_size, 0);
+    }
+
+ out:
+
+  if (map != MAP_FAILED)
+    munmap (map, statbuf.st_size);
+  if (fd != -1)
+    close (fd);
+
+  return err;
+}
+
 /* This function retrieves the content from the file specified by
    FILENAMED and writes it into a newly allocated chunk of memory,
    which is then stored in *DATA and *DATALEN.  This functions adds a
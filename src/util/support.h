@@ -65,6 +65,14 @@ gpg_error_t file_to_binstring (const char *filename, void **data, size_t *datale
    in *SEXP.  Returns proper error code.  */
 gpg_error_t string_to_sexp (gcry_sexp_t *sexp, char *string);
 
+/* This functions reads the S-Expression contained in the file
+   FILENAME, which may be in canonical or advanced format, into a new
+   S-Expression object, which is to be stored in *SEXP; no
+   intermediate heap copy of the file is made.  Returns
+   GPG_ERR_NO_DATA in case the file is empty, other error codes on
+   failure.  */
+gpg_error_t file_to_sexp (const char *filename, gcry_sexp_t *sexp);
+
 gpg_error_t char_vector_dup (int len, const char **a, char ***b);
 
 void char_vector_free (char **a);
@@ -0,0 +1,190 @@
+/* dirmngr-bench.c - benchmark for Poldi's dirmngr access.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+/* This program performs the dirmngr transactions of an x509
+   authentication - connect, "LOOKUP --url" and VALIDATE - through
+   the functions used by Poldi and reports the time spent in each of
+   them.  It is meant to be run against mock-dirmngr, but works with
+   dirmngr as well.  With --reuse all transactions are made through a
+   single connection, with --pool connections are taken from Poldi's
+   connection pool.  */
+
+#include <poldi.h>
+
+#include <assert.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <gpg-error.h>
+#include <gcrypt.h>
+#include <ksba.h>
+
+#include "dirmngr.h"
+
+#include <simplelog.h>
+
+static double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+print_help (void)
+{
+  printf ("\
+Usage: dirmngr-bench [options] <socket> <url>\n\
+Benchmark certificate lookup and validation through dirmngr.\n\
+\n\
+Options:\n\
+ -n, --iterations N   number of authentications (default: 1000)\n\
+ -r, --reuse          use a single connection\n\
+ -p, --pool           use the connection pool\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  double t_connect, t_lookup, t_validate, start, t;
+  dirmngr_ctx_t ctx = NULL;
+  log_handle_t loghandle;
+  const char *socket_name, *url;
+  int iterations = 1000;
+  int reuse = 0;
+  unsigned int flags = 0;
+  ksba_cert_t cert;
+  gpg_error_t err;
+  int i, c;
+
+  while (1)
+    {
+      static struct option long_options[] =
+	{
+	  { "iterations", required_argument, 0, 'n' },
+	  { "reuse", no_argument, 0, 'r' },
+	  { "pool", no_argument, 0, 'p' },
+	  { "help", no_argument, 0, 'h' },
+	  { 0, 0, 0, 0 }
+	};
+
+      c = getopt_long (argc, argv, "n:rph", long_options, NULL);
+      if (c == -1)
+	break;
+
+      switch (c)
+	{
+	case 'n':
+	  iterations = atoi (optarg);
+	  break;
+
+	case 'r':
+	  reuse = 1;
+	  break;
+
+	case 'p':
+	  flags |= DIRMNGR_FLAG_POOL;
+	  break;
+
+	case 'h':
+	  print_help ();
+	  exit (0);
+
+	default:
+	  print_help ();
+	  exit (1);
+	}
+    }
+
+  if (argc - optind != 2 || iterations <= 0)
+    {
+      print_help ();
+      exit (1);
+    }
+  socket_name = argv[optind];
+  url = argv[optind + 1];
+
+  gcry_check_version (NULL);
+
+  err = log_create (&loghandle);
+  assert (!err);
+  log_set_backend_stream (loghandle, stderr);
+
+  t_connect = t_lookup = t_validate = 0;
+  for (i = 0; i < iterations; i++)
+    {
+      if (!ctx)
+	{
+	  start = now ();
+	  err = dirmngr_connect (&ctx, socket_name, flags, loghandle);
+	  t_connect += now () - start;
+	  if (err)
+	    {
+	      fprintf (stderr, "failed to connect to `%s': %s\n",
+		       socket_name, gpg_strerror (err));
+	      exit (1);
+	    }
+	}
+
+      start = now ();
+      err = dirmngr_lookup_url (ctx, url, &cert);
+      t = now ();
+      t_lookup += t - start;
+      if (err)
+	{
+	  fprintf (stderr, "failed to look up `%s': %s\n",
+		   url, gpg_strerror (err));
+	  exit (1);
+	}
+
+      err = dirmngr_validate (ctx, cert);
+      t_validate += now () - t;
+      ksba_cert_release (cert);
+      if (err)
+	{
+	  fprintf (stderr, "failed to validate certificate: %s\n",
+		   gpg_strerror (err));
+	  exit (1);
+	}
+
+      if (!reuse)
+	{
+	  dirmngr_disconnect (ctx);
+	  ctx = NULL;
+	}
+    }
+
+  dirmngr_disconnect (ctx);
+  log_destroy (loghandle);
+
+  printf ("%i authentications%s:\n", iterations,
+	  reuse ? " through a single connection"
+	  : (flags & DIRMNGR_FLAG_POOL) ? " through the connection pool" : "");
+  printf ("  %-10s %10.1f us\n", "connect", t_connect * 1e6 / iterations);
+  printf ("  %-10s %10.1f us\n", "lookup", t_lookup * 1e6 / iterations);
+  printf ("  %-10s %10.1f us\n", "validate", t_validate * 1e6 / iterations);
+  printf ("  %-10s %10.1f us\n", "total",
+	  (t_connect + t_lookup + t_validate) * 1e6 / iterations);
+
+  return 0;
+}
@@ -0,0 +1,149 @@
+/* key-bench.c - benchmark for loading keys in different formats.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+/* This program compares the cost of loading a public key from a key
+   file in advanced format through file_to_string() and
+   string_to_sexp() - as Poldi used to do - with loading it through
+   file_to_sexp() from key files in advanced and in canonical
+   format.  */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <gpg-error.h>
+#include <gcrypt.h>
+
+#include <support.h>
+
+/* Write the key KEY in format FORMAT to the file FILENAME.  */
+static void
+write_key (const char *filename, gcry_sexp_t key, int format)
+{
+  size_t n;
+  size_t written;
+  char *buf;
+  FILE *fp;
+
+  n = gcry_sexp_sprint (key, format, NULL, 0);
+  buf = malloc (n);
+  assert (buf);
+  n = gcry_sexp_sprint (key, format, buf, n);
+  if (format == GCRYSEXP_FMT_ADVANCED)
+    /* Do not write the terminating NUL.  */
+    n--;
+
+  fp = fopen (filename, "w");
+  assert (fp);
+  written = fwrite (buf, n, 1, fp);
+  assert (written == 1);
+  fclose (fp);
+  free (buf);
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Load the key from FILENAME ITERATIONS times, using file_to_sexp()
+   if DIRECT is true, file_to_string() and string_to_sexp()
+   otherwise.  Print the results labeled with NAME.  */
+static void
+bench (const char *name, const char *filename, int direct, int iterations)
+{
+  gcry_sexp_t key;
+  gpg_error_t err;
+  char *string;
+  double start;
+  int i;
+
+  start = now ();
+  for (i = 0; i < iterations; i++)
+    {
+      if (direct)
+	err = file_to_sexp (filename, &key);
+      else
+	{
+	  err = file_to_string (filename, &string);
+	  assert (!err);
+	  err = string_to_sexp (&key, string);
+	  gcry_free (string);
+	}
+      assert (!err);
+      gcry_sexp_release (key);
+    }
+
+  printf ("%-40s %8.2f us/key\n", name,
+	  (now () - start) * 1e6 / iterations);
+}
+
+int
+main (int argc, const char **argv)
+{
+  char dir[] = "/tmp/key-bench.XXXXXX";
+  char advanced[64], canonical[64];
+  char *tmpdir;
+  gcry_sexp_t parms, keypair, key;
+  int iterations;
+  gpg_error_t err;
+
+  iterations = argc > 1 ? atoi (argv[1]) : 10000;
+  assert (iterations > 0);
+
+  /* Init.  */
+  gcry_check_version (NULL);
+  gcry_control (GCRYCTL_INITIALIZATION_FINISHED, 0);
+
+  err = gcry_sexp_build (&parms, NULL, "(genkey (rsa (nbits 4:2048)))");
+  assert (!err);
+  err = gcry_pk_genkey (&keypair, parms);
+  assert (!err);
+  key = gcry_sexp_find_token (keypair, "public-key", 0);
+  assert (key);
+
+  tmpdir = mkdtemp (dir);
+  assert (tmpdir);
+  snprintf (advanced, sizeof (advanced), "%s/advanced", dir);
+  snprintf (canonical, sizeof (canonical), "%s/canonical", dir);
+  write_key (advanced, key, GCRYSEXP_FMT_ADVANCED);
+  write_key (canonical, key, GCRYSEXP_FMT_CANON);
+
+  printf ("loading a 2048 bit RSA key %i times:\n", iterations);
+  bench ("advanced, file_to_string/string_to_sexp", advanced, 0, iterations);
+  bench ("advanced, file_to_sexp", advanced, 1, iterations);
+  bench ("canonical, file_to_sexp", canonical, 1, iterations);
+
+  unlink (advanced);
+  unlink (canonical);
+  rmdir (dir);
+
+  gcry_sexp_release (key);
+  gcry_sexp_release (keypair);
+  gcry_sexp_release (parms);
+
+  return 0;
+}
@@ -0,0 +1,529 @@
+/* mock-dirmngr.c - dirmngr stand-in for tests and benchmarks.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+/* This program emulates the part of dirmngr used by Poldi's x509
+   authentication method: "LOOKUP --url" and VALIDATE, including the
+   TARGETCERT and SENDCERT inquiries.  Certificates are served from a
+   local directory, validation results follow a configured policy;
+   therefore the x509 method can be tested and benchmarked without
+   network access or an LDAP server.
+
+   It is invoked as "mock-dirmngr [--options FILE] SOCKET" and accepts
+   connections on the local socket SOCKET, which is to be used as
+   `dirmngr-socket' in poldi-x509.conf, until it is killed.  FILE
+   contains lines of the form "OPTION VALUE" as follows:
+
+     cert-directory DIR  serve certificates from DIR; "LOOKUP --url URL"
+                         returns the DER encoded certificate stored in
+                         DIR under the last path component of URL
+     validate RESULT     result of VALIDATE: valid (the default),
+                         revoked, expired or untrusted
+     revoked FILE        VALIDATE reports the certificate in FILE as
+                         revoked, may be given several times
+     issuer DN           ask for the issuer certificate DN through a
+                         SENDCERT inquiry during VALIDATE
+     latency CMD=MSEC    delay each CMD command by MSEC milliseconds
+
+   A suitable certificate can be created from a key with OpenSSL:
+
+     openssl req -new -x509 -key KEY -outform DER -out CERT \
+       -subj "/CN=Test/emailAddress=USER@DOMAIN"  */
+
+/* Report errors like dirmngr does.  */
+#define GPG_ERR_SOURCE_DEFAULT GPG_ERR_SOURCE_DIRMNGR
+
+#include <poldi.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <gpg-error.h>
+
+#include "assuan.h"
+
+#include <simpleparse.h>
+#include <simplelog.h>
+#include <support.h>
+
+#define PROGRAM_NAME    "mock-dirmngr"
+#define PROGRAM_VERSION "0.1"
+
+/* Maximum number of commands with configured latencies.  */
+#define MAX_LATENCIES 16
+
+/* Maximum number of revoked certificates.  */
+#define MAX_REVOKED 16
+
+/* Maximum size of certificates accepted by VALIDATE.  */
+#define MAX_CERT_SIZE 65536
+
+/* A certificate.  */
+struct cert
+{
+  void *data;
+  size_t length;
+};
+
+/* Configuration of the server.  */
+static struct
+{
+  char *cert_directory;
+  gpg_err_code_t validate;
+  struct cert revoked[MAX_REVOKED];
+  int nrevoked;
+  char *issuer;
+  struct
+  {
+    char *command;
+    unsigned int msec;
+  } latencies[MAX_LATENCIES];
+  int nlatencies;
+} config;
+
+enum opt_ids
+  {
+    opt_none,
+    opt_cert_directory,
+    opt_validate,
+    opt_revoked,
+    opt_issuer,
+    opt_latency
+  };
+
+static simpleparse_opt_spec_t opt_specs[] =
+  {
+    { opt_cert_directory, "cert-directory",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, "Specify directory containing certificates" },
+    { opt_validate, "validate",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, "Specify result of certificate validation" },
+    { opt_revoked, "revoked",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, "Specify file containing a revoked certificate" },
+    { opt_issuer, "issuer",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, "Specify issuer to ask for during validation" },
+    { opt_latency, "latency",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, "Specify latency of a command" },
+    { 0 }
+  };
+
+
+
+/* Replace the string in *DST with a copy of SRC.  */
+static void
+set_string (char **dst, const char *src)
+{
+  free (*dst);
+  *dst = strdup (src);
+  assert (*dst);
+}
+
+static gpg_error_t
+options_cb (void *cookie, simpleparse_opt_spec_t spec, const char *arg)
+{
+  gpg_error_t err = 0;
+  char *p;
+
+  switch (spec.id)
+    {
+    case opt_cert_directory:
+      set_string (&config.cert_directory, arg);
+      break;
+
+    case opt_validate:
+      if (!strcmp (arg, "valid"))
+	config.validate = GPG_ERR_NO_ERROR;
+      else if (!strcmp (arg, "revoked"))
+	config.validate = GPG_ERR_CERT_REVOKED;
+      else if (!strcmp (arg, "expired"))
+	config.validate = GPG_ERR_CERT_EXPIRED;
+      else if (!strcmp (arg, "untrusted"))
+	config.validate = GPG_ERR_NOT_TRUSTED;
+      else
+	{
+	  fprintf (stderr, PROGRAM_NAME ": invalid validation result `%s'\n",
+		   arg);
+	  err = gpg_error (GPG_ERR_INV_VALUE);
+	}
+      break;
+
+    case opt_revoked:
+      if (config.nrevoked == MAX_REVOKED)
+	{
+	  err = gpg_error (GPG_ERR_TOO_LARGE);
+	  break;
+	}
+      err = file_to_binstring (arg, &config.revoked[config.nrevoked].data,
+			       &config.revoked[config.nrevoked].length);
+      if (err)
+	fprintf (stderr, PROGRAM_NAME ": failed to read `%s': %s\n",
+		 arg, gpg_strerror (err));
+      else
+	config.nrevoked++;
+      break;
+
+    case opt_issuer:
+      set_string (&config.issuer, arg);
+      break;
+
+    case opt_latency:
+      p = strchr (arg, '=');
+      if (!p || p == arg || config.nlatencies == MAX_LATENCIES)
+	{
+	  fprintf (stderr, PROGRAM_NAME ": invalid latency `%s'\n", arg);
+	  err = gpg_error (GPG_ERR_INV_VALUE);
+	  break;
+	}
+      config.latencies[config.nlatencies].command = strndup (arg, p - arg);
+      assert (config.latencies[config.nlatencies].command);
+      config.latencies[config.nlatencies].msec = strtoul (p + 1, NULL, 10);
+      config.nlatencies++;
+      break;
+    }
+
+  return err;
+}
+
+/* Sleep for the latency configured for COMMAND.  */
+static void
+delay (const char *command)
+{
+  struct timespec ts;
+  int i;
+
+  for (i = 0; i < config.nlatencies; i++)
+    if (!strcmp (config.latencies[i].command, command))
+      {
+	ts.tv_sec = config.latencies[i].msec / 1000;
+	ts.tv_nsec = (config.latencies[i].msec % 1000) * 1000000L;
+	while (nanosleep (&ts, &ts) && errno == EINTR)
+	  ;
+	break;
+      }
+}
+
+
+
+static int
+cmd_lookup (assuan_context_t ctx, char *line)
+{
+  char *filename, *name;
+  void *data;
+  size_t length;
+  gpg_error_t err;
+
+  delay ("LOOKUP");
+
+  /* Only lookups by URL are supported.  */
+  if (strncmp (line, "--url ", 6))
+    return gpg_error (GPG_ERR_NOT_SUPPORTED);
+  line += 6;
+  while (*line == ' ')
+    line++;
+
+  if (!config.cert_directory)
+    return gpg_error (GPG_ERR_NOT_FOUND);
+
+  name = strrchr (line, '/');
+  name = name ? name + 1 : line;
+  if (!*name || !strcmp (name, "..") || !strcmp (name, "."))
+    return gpg_error (GPG_ERR_NOT_FOUND);
+
+  filename = malloc (strlen (config.cert_directory) + 1 + strlen (name) + 1);
+  assert (filename);
+  sprintf (filename, "%s/%s", config.cert_directory, name);
+
+  err = file_to_binstring (filename, &data, &length);
+  free (filename);
+  if (gpg_err_code (err) == GPG_ERR_ENOENT)
+    return gpg_error (GPG_ERR_NOT_FOUND);
+  if (err)
+    return err;
+
+  /* Like dirmngr terminate each certificate with END.  */
+  err = assuan_send_data (ctx, data, length);
+  if (!err)
+    err = assuan_send_data (ctx, NULL, 0);
+  if (!err)
+    err = assuan_write_line (ctx, "END");
+  xfree (data);
+
+  return err;
+}
+
+static int
+cmd_validate (assuan_context_t ctx, char *line)
+{
+  unsigned char *cert = NULL;
+  unsigned char *issuer = NULL;
+  size_t cert_n, issuer_n;
+  char inquiry[ASSUAN_LINELENGTH];
+  gpg_error_t err;
+  int i;
+
+  delay ("VALIDATE");
+
+  err = assuan_inquire (ctx, "TARGETCERT", &cert, &cert_n, MAX_CERT_SIZE);
+  if (err)
+    goto out;
+
+  /* Like dirmngr ask for the issuer while building the chain.  The
+     answer is ignored, Poldi does not provide it anyway.  */
+  if (config.issuer)
+    {
+      snprintf (inquiry, sizeof (inquiry), "SENDCERT %s", config.issuer);
+      err = assuan_inquire (ctx, inquiry, &issuer, &issuer_n, MAX_CERT_SIZE);
+      if (err)
+	goto out;
+    }
+
+  for (i = 0; i < config.nrevoked; i++)
+    if (config.revoked[i].length == cert_n
+	&& !memcmp (config.revoked[i].data, cert, cert_n))
+      {
+	err = gpg_error (GPG_ERR_CERT_REVOKED);
+	goto out;
+      }
+
+  if (config.validate)
+    err = gpg_error (config.validate);
+
+ out:
+
+  free (cert);
+  free (issuer);
+
+  return err;
+}
+
+/* Serve the client connected through FD.  */
+static void
+serve (int fd)
+{
+  assuan_context_t ctx;
+  int rc;
+
+  /* FD has already been accepted.  */
+  rc = assuan_init_socket_server_ext (&ctx, fd, 2);
+  if (!rc)
+    rc = assuan_register_command (ctx, "LOOKUP", cmd_lookup);
+  if (!rc)
+    rc = assuan_register_command (ctx, "VALIDATE", cmd_validate);
+  if (!rc)
+    rc = assuan_set_hello_line (ctx, PROGRAM_NAME " " PROGRAM_VERSION
+				" ready");
+
+  while (!rc)
+    {
+      rc = assuan_accept (ctx);
+      if (rc == -1)
+	{
+	  rc = 0;
+	  break;
+	}
+      if (!rc)
+	rc = assuan_process (ctx);
+    }
+
+  if (rc)
+    fprintf (stderr, PROGRAM_NAME ": server error: %s\n",
+	     assuan_strerror (rc));
+
+  assuan_deinit_server (ctx);
+}
+
+/* Accept connections on the socket SOCKET_NAME, serving each of them
+   in a new process.  */
+static int
+run_server (const char *socket_name)
+{
+  struct sockaddr_un addr;
+  int listen_fd, fd;
+  pid_t pid;
+
+  if (strlen (socket_name) >= sizeof (addr.sun_path))
+    {
+      fprintf (stderr, PROGRAM_NAME ": socket name too long\n");
+      return 1;
+    }
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, socket_name);
+
+  listen_fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd == -1)
+    {
+      fprintf (stderr, PROGRAM_NAME ": failed to create socket: %s\n",
+	       strerror (errno));
+      return 1;
+    }
+
+  unlink (socket_name);
+  if (bind (listen_fd, (struct sockaddr *) &addr, sizeof (addr))
+      || listen (listen_fd, 64))
+    {
+      fprintf (stderr, PROGRAM_NAME ": failed to listen on `%s': %s\n",
+	       socket_name, strerror (errno));
+      return 1;
+    }
+
+  /* Do not keep zombies around.  */
+  signal (SIGCHLD, SIG_IGN);
+
+  while (1)
+    {
+      fd = accept (listen_fd, NULL, NULL);
+      if (fd == -1)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  fprintf (stderr, PROGRAM_NAME ": accept failed: %s\n",
+		   strerror (errno));
+	  return 1;
+	}
+
+      pid = fork ();
+      if (pid == -1)
+	fprintf (stderr, PROGRAM_NAME ": fork failed: %s\n", strerror (errno));
+      else if (!pid)
+	{
+	  close (listen_fd);
+	  serve (fd);
+	  _exit (0);
+	}
+
+      close (fd);
+    }
+}
+
+
+
+static void
+print_help (void)
+{
+  printf ("\
+Usage: %s [options] <socket>\n\
+Emulate dirmngr for Poldi's x509 authentication method.\n\
+\n\
+Options:\n\
+ -h, --help               print help information\n\
+ -v, --version            print version information\n\
+     --options FILE       read configuration from FILE\n\
+\n\
+Report bugs to <" PACKAGE_BUGREPORT ">.\n", PROGRAM_NAME);
+}
+
+static void
+print_version (void)
+{
+  printf (PROGRAM_NAME " " PROGRAM_VERSION "\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  simpleparse_handle_t parsehandle;
+  log_handle_t loghandle;
+  const char *options = NULL;
+  gpg_error_t err;
+  int c;
+
+  while (1)
+    {
+      static struct option long_options[] =
+	{
+	  { "version", no_argument, 0, 'v' },
+	  { "help", no_argument, 0, 'h' },
+	  { "options", required_argument, 0, 'o' },
+	  { 0, 0, 0, 0 }
+	};
+      int option_index = 0;
+
+      c = getopt_long (argc, argv, "vh", long_options, &option_index);
+
+      /* Detect the end of the options. */
+      if (c == -1)
+	break;
+
+      switch (c)
+	{
+	case 'o':
+	  options = optarg;
+	  break;
+
+	case 'h':
+	  print_help ();
+	  exit (0);
+	  break;
+
+	case 'v':
+	  print_version ();
+	  exit (0);
+	  break;
+
+	case '?':
+	  /* `getopt_long' already printed an error message. */
+	  exit (1);
+	  break;
+
+	default:
+	  abort ();
+	}
+    }
+
+  if (argc - optind != 1)
+    {
+      print_help ();
+      exit (1);
+    }
+
+  if (options)
+    {
+      err = log_create (&loghandle);
+      assert (!err);
+      log_set_prefix (loghandle, PROGRAM_NAME);
+      log_set_backend_stream (loghandle, stderr);
+      err = simpleparse_create (&parsehandle);
+      assert (!err);
+      simpleparse_set_loghandle (parsehandle, loghandle);
+      simpleparse_set_specs (parsehandle, opt_specs);
+      simpleparse_set_parse_cb (parsehandle, options_cb, NULL);
+      err = simpleparse_parse_file (parsehandle, 0, options);
+      simpleparse_destroy (parsehandle);
+      log_destroy (loghandle);
+      if (err)
+	{
+	  fprintf (stderr, PROGRAM_NAME ": failed to parse `%s': %s\n",
+		   options, gpg_strerror (err));
+	  exit (1);
+	}
+    }
+
+  return run_server (argv[optind]);
+}
+
+/* END */
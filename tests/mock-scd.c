@@ -0,0 +1,818 @@
+/* mock-scd.c - software card Assuan server for tests and benchmarks.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+/* This program emulates scdaemon with an OpenPGP card inserted,
+   implementing the subset of the protocol used by Poldi: SERIALNO,
+   LEARN, GETATTR, SETDATA, PKSIGN (including the NEEDPIN inquiry),
+   READKEY and RESTART.  The card's key is an ordinary RSA or EdDSA
+   key kept in a file, therefore Poldi can be tested and benchmarked
+   end-to-end without a card reader.
+
+   Like scdaemon it is invoked as "mock-scd --server [--options FILE]",
+   so it can be used as `scdaemon-program' in poldi.conf; FILE is
+   taken from `scdaemon-options'.  It contains lines of the form
+   "OPTION VALUE" as follows:
+
+     key FILE          key created with --genkey (required for signing)
+     serialno SERIALNO serial number of the card
+     pin PIN           PIN expected by PKSIGN (default: 123456)
+     disp-name NAME    value of the DISP-NAME attribute
+     disp-lang LANG    value of the DISP-LANG attribute
+     pubkey-url URL    value of the PUBKEY-URL attribute
+     login-data DATA   value of the LOGIN-DATA attribute
+     card-file FILE    the card is only present while FILE exists
+     latency CMD=MSEC  delay each CMD command by MSEC milliseconds
+
+   "mock-scd --genkey ALGO FILE" creates a new key (ALGO being "rsa"
+   or "ed25519") in FILE and prints its public key in the format used
+   by Poldi's key files.  */
+
+/* Report errors like scdaemon does.  */
+#define GPG_ERR_SOURCE_DEFAULT GPG_ERR_SOURCE_SCD
+
+#include <poldi.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <gpg-error.h>
+#include <gcrypt.h>
+
+#include "assuan.h"
+
+#include <simpleparse.h>
+#include <simplelog.h>
+#include <support.h>
+
+#define PROGRAM_NAME    "mock-scd"
+#define PROGRAM_VERSION "0.1"
+
+#define DEFAULT_SERIALNO "D2760001240102000005000012340000"
+#define DEFAULT_PIN      "123456"
+
+/* Maximum number of commands with configured latencies.  */
+#define MAX_LATENCIES 16
+
+/* Configuration of the emulated card.  */
+static struct
+{
+  char *serialno;
+  char *pin;
+  char *disp_name;
+  char *disp_lang;
+  char *pubkey_url;
+  char *login_data;
+  char *card_file;
+  struct
+  {
+    char *command;
+    unsigned int msec;
+  } latencies[MAX_LATENCIES];
+  int nlatencies;
+  gcry_sexp_t public_key;
+  gcry_sexp_t private_key;
+  int algo;
+} card;
+
+/* Data set by the last SETDATA command.  */
+static unsigned char *setdata;
+static size_t setdata_n;
+
+enum opt_ids
+  {
+    opt_none,
+    opt_key,
+    opt_serialno,
+    opt_pin,
+    opt_disp_name,
+    opt_disp_lang,
+    opt_pubkey_url,
+    opt_login_data,
+    opt_card_file,
+    opt_latency
+  };
+
+static simpleparse_opt_spec_t opt_specs[] =
+  {
+    { opt_key, "key",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, "Specify file containing the card's key" },
+    { opt_serialno, "serialno",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, "Specify the card's serial number" },
+    { opt_pin, "pin",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, "Specify the card's PIN" },
+    { opt_disp_name, "disp-name",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, "Specify the card holder's name" },
+    { opt_disp_lang, "disp-lang",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, "Specify the card holder's language" },
+    { opt_pubkey_url, "pubkey-url",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, "Specify the URL of the public key" },
+    { opt_login_data, "login-data",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, "Specify the card's login data" },
+    { opt_card_file, "card-file",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, "Specify file indicating card presence" },
+    { opt_latency, "latency",
+      0, SIMPLEPARSE_ARG_REQUIRED, 0, "Specify latency of a command" },
+    { 0 }
+  };
+
+
+
+/* Replace the string in *DST with a copy of SRC.  */
+static void
+set_string (char **dst, const char *src)
+{
+  free (*dst);
+  *dst = strdup (src);
+  assert (*dst);
+}
+
+/* Load the key created by --genkey from FILENAME.  */
+static gpg_error_t
+load_key (const char *filename)
+{
+  gcry_sexp_t key_data;
+  gpg_error_t err;
+
+  err = file_to_sexp (filename, &key_data);
+  if (err)
+    return err;
+
+  card.public_key = gcry_sexp_find_token (key_data, "public-key", 0);
+  card.private_key = gcry_sexp_find_token (key_data, "private-key", 0);
+  gcry_sexp_release (key_data);
+  if (!card.public_key || !card.private_key)
+    return gpg_error (GPG_ERR_INV_SEXP);
+
+  card.algo = pk_algo (card.public_key);
+  if (card.algo != GCRY_PK_RSA && card.algo != GCRY_PK_ECC)
+    return gpg_error (GPG_ERR_UNSUPPORTED_ALGORITHM);
+
+  return 0;
+}
+
+static gpg_error_t
+options_cb (void *cookie, simpleparse_opt_spec_t spec, const char *arg)
+{
+  gpg_error_t err = 0;
+  char *p;
+
+  switch (spec.id)
+    {
+    case opt_key:
+      err = load_key (arg);
+      if (err)
+	fprintf (stderr, PROGRAM_NAME ": failed to load key from `%s': %s\n",
+		 arg, gpg_strerror (err));
+      break;
+
+    case opt_serialno:
+      set_string (&card.serialno, arg);
+      break;
+
+    case opt_pin:
+      set_string (&card.pin, arg);
+      break;
+
+    case opt_disp_name:
+      set_string (&card.disp_name, arg);
+      break;
+
+    case opt_disp_lang:
+      set_string (&card.disp_lang, arg);
+      break;
+
+    case opt_pubkey_url:
+      set_string (&card.pubkey_url, arg);
+      break;
+
+    case opt_login_data:
+      set_string (&card.login_data, arg);
+      break;
+
+    case opt_card_file:
+      set_string (&card.card_file, arg);
+      break;
+
+    case opt_latency:
+      p = strchr (arg, '=');
+      if (!p || p == arg || card.nlatencies == MAX_LATENCIES)
+	{
+	  fprintf (stderr, PROGRAM_NAME ": invalid latency `%s'\n", arg);
+	  err = gpg_error (GPG_ERR_INV_VALUE);
+	  break;
+	}
+      card.latencies[card.nlatencies].command = strndup (arg, p - arg);
+      assert (card.latencies[card.nlatencies].command);
+      card.latencies[card.nlatencies].msec = strtoul (p + 1, NULL, 10);
+      card.nlatencies++;
+      break;
+    }
+
+  return err;
+}
+
+
+
+/* Sleep for the latency configured for COMMAND.  */
+static void
+delay (const char *command)
+{
+  struct timespec ts;
+  int i;
+
+  for (i = 0; i < card.nlatencies; i++)
+    if (!strcmp (card.latencies[i].command, command))
+      {
+	ts.tv_sec = card.latencies[i].msec / 1000;
+	ts.tv_nsec = (card.latencies[i].msec % 1000) * 1000000L;
+	while (nanosleep (&ts, &ts) && errno == EINTR)
+	  ;
+	break;
+      }
+}
+
+/* Returns true if a card is inserted.  */
+static int
+card_present (void)
+{
+  struct stat statbuf;
+
+  return !card.card_file || !stat (card.card_file, &statbuf);
+}
+
+/* Send the status line KEYWORD with VALUE percent-escaped like
+   scdaemon does.  */
+static gpg_error_t
+send_status (assuan_context_t ctx, const char *keyword, const char *value)
+{
+  char buf[ASSUAN_LINELENGTH];
+  const unsigned char *s;
+  char *p;
+
+  p = buf;
+  for (s = (const unsigned char *) value;
+       *s && p < buf + sizeof (buf) - 4; s++)
+    if (*s == '%' || *s == '+' || *s <= ' ')
+      p += sprintf (p, "%%%02X", *s);
+    else
+      *p++ = *s;
+  *p = 0;
+
+  return assuan_write_status (ctx, keyword, buf);
+}
+
+/* Send the KEY-FPR status line.  The fingerprint of an OpenPGP key
+   depends on its creation date, which we do not have, therefore the
+   keygrip stands in for it.  */
+static gpg_error_t
+send_key_fpr (assuan_context_t ctx)
+{
+  unsigned char grip[20];
+  char buf[2 + 2 * sizeof (grip) + 1];
+  unsigned int i;
+
+  if (!card.public_key || !gcry_pk_get_keygrip (card.public_key, grip))
+    return 0;
+
+  strcpy (buf, "3 ");
+  for (i = 0; i < sizeof (grip); i++)
+    sprintf (buf + 2 + 2 * i, "%02X", grip[i]);
+
+  return assuan_write_status (ctx, "KEY-FPR", buf);
+}
+
+/* Send the card attribute NAME; unset attributes are skipped like
+   empty data objects are by scdaemon.  */
+static gpg_error_t
+send_attribute (assuan_context_t ctx, const char *name)
+{
+  const char *value;
+
+  if (!strcmp (name, "SERIALNO"))
+    value = card.serialno;
+  else if (!strcmp (name, "DISP-NAME"))
+    value = card.disp_name;
+  else if (!strcmp (name, "DISP-LANG"))
+    value = card.disp_lang;
+  else if (!strcmp (name, "PUBKEY-URL"))
+    value = card.pubkey_url;
+  else if (!strcmp (name, "LOGIN-DATA"))
+    value = card.login_data;
+  else if (!strcmp (name, "KEY-FPR"))
+    return send_key_fpr (ctx);
+  else
+    return gpg_error (GPG_ERR_INV_NAME);
+
+  return value ? send_status (ctx, name, value) : 0;
+}
+
+/* Skip "--foo" style options of a command line.  */
+static char *
+skip_options (char *line)
+{
+  while (line[0] == '-' && line[1] == '-')
+    {
+      while (*line && *line != ' ')
+	line++;
+      while (*line == ' ')
+	line++;
+    }
+
+  return line;
+}
+
+
+
+static int
+cmd_serialno (assuan_context_t ctx, char *line)
+{
+  char buf[ASSUAN_LINELENGTH];
+
+  delay ("SERIALNO");
+  if (!card_present ())
+    return gpg_error (GPG_ERR_CARD_NOT_PRESENT);
+
+  snprintf (buf, sizeof (buf), "%s 0", card.serialno);
+
+  return assuan_write_status (ctx, "SERIALNO", buf);
+}
+
+static int
+cmd_learn (assuan_context_t ctx, char *line)
+{
+  static const char *attributes[] =
+    { "SERIALNO", "DISP-NAME", "DISP-LANG", "PUBKEY-URL", "LOGIN-DATA",
+      "KEY-FPR", NULL };
+  gpg_error_t err = 0;
+  int i;
+
+  delay ("LEARN");
+  if (!card_present ())
+    return gpg_error (GPG_ERR_CARD_NOT_PRESENT);
+
+  for (i = 0; !err && attributes[i]; i++)
+    err = send_attribute (ctx, attributes[i]);
+
+  return err;
+}
+
+static int
+cmd_getattr (assuan_context_t ctx, char *line)
+{
+  delay ("GETATTR");
+  if (!card_present ())
+    return gpg_error (GPG_ERR_CARD_NOT_PRESENT);
+
+  return send_attribute (ctx, line);
+}
+
+static int
+cmd_setdata (assuan_context_t ctx, char *line)
+{
+  size_t n;
+
+  delay ("SETDATA");
+
+  n = strlen (line);
+  if (!n || n % 2 || strspn (line, "0123456789abcdefABCDEF") != n)
+    return gpg_error (GPG_ERR_ASS_PARAMETER);
+
+  free (setdata);
+  setdata_n = n / 2;
+  setdata = malloc (setdata_n);
+  assert (setdata);
+  for (n = 0; n < setdata_n; n++)
+    sscanf (line + 2 * n, "%2hhx", setdata + n);
+
+  return 0;
+}
+
+/* Append the value of the element NAME of the signature SIG,
+   left-padded to LENGTH bytes, to BUF.  */
+static gpg_error_t
+append_mpi (unsigned char *buf, size_t length, gcry_sexp_t sig,
+	    const char *name)
+{
+  gcry_sexp_t element;
+  const char *data;
+  size_t n;
+
+  element = gcry_sexp_find_token (sig, name, 0);
+  if (!element)
+    return gpg_error (GPG_ERR_INV_SEXP);
+  data = gcry_sexp_nth_data (element, 1, &n);
+  while (n > length && data && !*data)
+    {
+      data++;
+      n--;
+    }
+  if (!data || n > length)
+    {
+      gcry_sexp_release (element);
+      return gpg_error (GPG_ERR_INV_SEXP);
+    }
+
+  memset (buf, 0, length - n);
+  memcpy (buf + length - n, data, n);
+  gcry_sexp_release (element);
+
+  return 0;
+}
+
+static int
+cmd_pksign (assuan_context_t ctx, char *line)
+{
+  unsigned char response[2 * 512];
+  size_t response_n, length;
+  gcry_sexp_t sexp_data = NULL;
+  gcry_sexp_t sexp_sig = NULL;
+  unsigned char *pin = NULL;
+  size_t pin_n;
+  gpg_error_t err;
+
+  delay ("PKSIGN");
+  line = skip_options (line);
+
+  if (!card_present ())
+    return gpg_error (GPG_ERR_CARD_NOT_PRESENT);
+  if (!card.private_key)
+    return gpg_error (GPG_ERR_NO_SECKEY);
+  if (strncmp (line, "OPENPGP.", 8))
+    return gpg_error (GPG_ERR_INV_ID);
+  if (!setdata)
+    return gpg_error (GPG_ERR_MISSING_VALUE);
+
+  err = assuan_inquire (ctx, "NEEDPIN ||Please enter the PIN",
+			&pin, &pin_n, 100);
+  if (err)
+    goto out;
+  if (strnlen ((char *) pin, pin_n) != strlen (card.pin)
+      || memcmp (pin, card.pin, strlen (card.pin)))
+    {
+      err = gpg_error (GPG_ERR_BAD_PIN);
+      goto out;
+    }
+
+  err = challenge_data (&sexp_data, card.algo, setdata, setdata_n);
+  if (!err)
+    err = gcry_pk_sign (&sexp_sig, sexp_data, card.private_key);
+  if (err)
+    goto out;
+
+  /* The card returns the signature as a string of the size of the
+     modulus resp. as R || S.  */
+  length = (gcry_pk_get_nbits (card.public_key) + 7) / 8;
+  if (card.algo == GCRY_PK_RSA)
+    {
+      response_n = length;
+      err = append_mpi (response, length, sexp_sig, "s");
+    }
+  else
+    {
+      response_n = 2 * length;
+      err = append_mpi (response, length, sexp_sig, "r");
+      if (!err)
+	err = append_mpi (response + length, length, sexp_sig, "s");
+    }
+  if (err)
+    goto out;
+
+  err = assuan_send_data (ctx, response, response_n);
+
+ out:
+
+  if (pin)
+    {
+      memset (pin, 0, pin_n);
+      free (pin);
+    }
+  gcry_sexp_release (sexp_data);
+  gcry_sexp_release (sexp_sig);
+  free (setdata);
+  setdata = NULL;
+
+  return err;
+}
+
+static int
+cmd_readkey (assuan_context_t ctx, char *line)
+{
+  unsigned char *buf;
+  size_t n;
+  gpg_error_t err;
+
+  delay ("READKEY");
+  line = skip_options (line);
+
+  if (!card_present ())
+    return gpg_error (GPG_ERR_CARD_NOT_PRESENT);
+  if (!card.public_key)
+    return gpg_error (GPG_ERR_NO_PUBKEY);
+  if (strncmp (line, "OPENPGP.", 8))
+    return gpg_error (GPG_ERR_INV_ID);
+
+  n = gcry_sexp_sprint (card.public_key, GCRYSEXP_FMT_CANON, NULL, 0);
+  buf = malloc (n);
+  assert (buf);
+  n = gcry_sexp_sprint (card.public_key, GCRYSEXP_FMT_CANON, buf, n);
+
+  err = assuan_send_data (ctx, buf, n);
+  free (buf);
+
+  return err;
+}
+
+static int
+cmd_restart (assuan_context_t ctx, char *line)
+{
+  delay ("RESTART");
+
+  return 0;
+}
+
+/* Run the Assuan server on stdin/stdout.  */
+static int
+run_server (void)
+{
+  static struct
+  {
+    const char *name;
+    int (*handler) (assuan_context_t, char *);
+  } commands[] =
+    {
+      { "SERIALNO", cmd_serialno },
+      { "LEARN", cmd_learn },
+      { "GETATTR", cmd_getattr },
+      { "SETDATA", cmd_setdata },
+      { "PKSIGN", cmd_pksign },
+      { "READKEY", cmd_readkey },
+      { "RESTART", cmd_restart },
+      { NULL }
+    };
+  assuan_context_t ctx;
+  int filedes[2];
+  int rc;
+  int i;
+
+  filedes[0] = 0;
+  filedes[1] = 1;
+  rc = assuan_init_pipe_server (&ctx, filedes);
+  if (rc)
+    {
+      fprintf (stderr, PROGRAM_NAME ": failed to initialize server: %s\n",
+	       assuan_strerror (rc));
+      return 1;
+    }
+
+  for (i = 0; !rc && commands[i].name; i++)
+    rc = assuan_register_command (ctx, commands[i].name, commands[i].handler);
+  if (!rc)
+    rc = assuan_set_hello_line (ctx, PROGRAM_NAME " " PROGRAM_VERSION
+				" ready");
+
+  delay ("STARTUP");
+
+  while (!rc)
+    {
+      rc = assuan_accept (ctx);
+      if (rc == -1)
+	{
+	  rc = 0;
+	  break;
+	}
+      if (!rc)
+	rc = assuan_process (ctx);
+    }
+
+  if (rc)
+    fprintf (stderr, PROGRAM_NAME ": server error: %s\n",
+	     assuan_strerror (rc));
+
+  assuan_deinit_server (ctx);
+
+  return !!rc;
+}
+
+
+
+/* Create a new key of type ALGO, write it to FILENAME and print the
+   public key.  */
+static int
+genkey (const char *algo, const char *filename)
+{
+  gcry_sexp_t params, key_data, public_key;
+  gpg_error_t err;
+  char *string;
+  FILE *fp;
+  size_t n;
+
+  if (!strcmp (algo, "rsa"))
+    err = gcry_sexp_new (&params, "(genkey (rsa (nbits 4:2048)))", 0, 1);
+  else if (!strcmp (algo, "ed25519"))
+    err = gcry_sexp_new (&params,
+			 "(genkey (ecc (curve Ed25519) (flags eddsa)))", 0, 1);
+  else
+    {
+      fprintf (stderr, PROGRAM_NAME ": unknown algorithm `%s'\n", algo);
+      return 1;
+    }
+  assert (!err);
+
+  err = gcry_pk_genkey (&key_data, params);
+  gcry_sexp_release (params);
+  if (err)
+    {
+      fprintf (stderr, PROGRAM_NAME ": failed to generate key: %s\n",
+	       gpg_strerror (err));
+      return 1;
+    }
+
+  n = gcry_sexp_sprint (key_data, GCRYSEXP_FMT_ADVANCED, NULL, 0);
+  string = malloc (n);
+  assert (string);
+  n = gcry_sexp_sprint (key_data, GCRYSEXP_FMT_ADVANCED, string, n);
+
+  fp = fopen (filename, "w");
+  if (!fp || fwrite (string, n - 1, 1, fp) != 1 || fclose (fp))
+    {
+      fprintf (stderr, PROGRAM_NAME ": failed to write `%s': %s\n",
+	       filename, strerror (errno));
+      return 1;
+    }
+  free (string);
+
+  public_key = gcry_sexp_find_token (key_data, "public-key", 0);
+  assert (public_key);
+  err = sexp_to_string (public_key, &string);
+  assert (!err);
+  printf ("%s", string);
+  gcry_free (string);
+
+  gcry_sexp_release (public_key);
+  gcry_sexp_release (key_data);
+
+  return 0;
+}
+
+static void
+print_help (void)
+{
+  printf ("\
+Usage: %s [options]\n\
+Emulate scdaemon with an OpenPGP card inserted.\n\
+\n\
+Options:\n\
+ -h, --help               print help information\n\
+ -v, --version            print version information\n\
+     --server             run in server mode\n\
+     --options FILE       read card configuration from FILE\n\
+     --genkey ALGO FILE   create key for algorithm ALGO in FILE\n\
+\n\
+Report bugs to <" PACKAGE_BUGREPORT ">.\n", PROGRAM_NAME);
+}
+
+static void
+print_version (void)
+{
+  printf (PROGRAM_NAME " " PROGRAM_VERSION "\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  simpleparse_handle_t parsehandle;
+  log_handle_t loghandle;
+  const char *options = NULL;
+  const char *algo = NULL;
+  int server = 0;
+  gpg_error_t err;
+  int c;
+
+  while (1)
+    {
+      static struct option long_options[] =
+	{
+	  { "version", no_argument, 0, 'v' },
+	  { "help", no_argument, 0, 'h' },
+	  { "server", no_argument, 0, 's' },
+	  { "options", required_argument, 0, 'o' },
+	  { "genkey", required_argument, 0, 'g' },
+	  { 0, 0, 0, 0 }
+	};
+      int option_index = 0;
+
+      c = getopt_long (argc, argv, "vh", long_options, &option_index);
+
+      /* Detect the end of the options. */
+      if (c == -1)
+	break;
+
+      switch (c)
+	{
+	case 's':
+	  server = 1;
+	  break;
+
+	case 'o':
+	  options = optarg;
+	  break;
+
+	case 'g':
+	  algo = optarg;
+	  break;
+
+	case 'h':
+	  print_help ();
+	  exit (0);
+	  break;
+
+	case 'v':
+	  print_version ();
+	  exit (0);
+	  break;
+
+	case '?':
+	  /* `getopt_long' already printed an error message. */
+	  exit (1);
+	  break;
+
+	default:
+	  abort ();
+	}
+    }
+
+  if (!gcry_check_version (NULL))
+    {
+      fprintf (stderr, PROGRAM_NAME ": failed to initialize libgcrypt\n");
+      exit (1);
+    }
+  gcry_control (GCRYCTL_INITIALIZATION_FINISHED, 0);
+
+  if (algo)
+    {
+      if (argc - optind != 1)
+	{
+	  print_help ();
+	  exit (1);
+	}
+      return genkey (algo, argv[optind]);
+    }
+
+  if (!server || argc != optind)
+    {
+      print_help ();
+      exit (1);
+    }
+
+  set_string (&card.serialno, DEFAULT_SERIALNO);
+  set_string (&card.pin, DEFAULT_PIN);
+
+  if (options)
+    {
+      err = log_create (&loghandle);
+      assert (!err);
+      log_set_prefix (loghandle, PROGRAM_NAME);
+      log_set_backend_stream (loghandle, stderr);
+      err = simpleparse_create (&parsehandle);
+      assert (!err);
+      simpleparse_set_loghandle (parsehandle, loghandle);
+      simpleparse_set_specs (parsehandle, opt_specs);
+      simpleparse_set_parse_cb (parsehandle, options_cb, NULL);
+      err = simpleparse_parse_file (parsehandle, 0, options);
+      simpleparse_destroy (parsehandle);
+      log_destroy (loghandle);
+      if (err)
+	{
+	  fprintf (stderr, PROGRAM_NAME ": failed to parse `%s': %s\n",
+		   options, gpg_strerror (err));
+	  exit (1);
+	}
+    }
+
+  return run_server ();
+}
+
+/* END */
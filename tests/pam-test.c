@@ -26,13 +26,75 @@
 #include <getopt.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
 
 
 
 #define PROGRAM_NAME    "pam-test"
-#define PROGRAM_VERSION "0.2"
+#define PROGRAM_VERSION "0.3"
 
-/* Use the standard conversation function from libpam-misc. */
+/* PIN to answer PIN prompts with instead of asking the user.  */
+static const char *pin;
+
+/* Do not print the outcome of each authentication.  */
+static int quiet;
+
+/* Number of PIN prompts answered during the current
+   authentication.  */
+static int pin_prompts;
+
+/* Conversation function answering PIN prompts with PIN, used for
+   running authentications without user interaction.  */
+static int
+pin_conv (int num_msg, const struct pam_message **msg,
+	  struct pam_response **resp, void *appdata_ptr)
+{
+  struct pam_response *replies;
+  int i;
+
+  replies = calloc (num_msg, sizeof (*replies));
+  if (!replies)
+    return PAM_BUF_ERR;
+
+  for (i = 0; i < num_msg; i++)
+    switch (msg[i]->msg_style)
+      {
+      case PAM_PROMPT_ECHO_OFF:
+	/* Poldi asks again if the PIN is rejected, giving the same
+	   answer would loop forever.  */
+	if (pin_prompts++)
+	  goto fail;
+	replies[i].resp = strdup (pin);
+	if (!replies[i].resp)
+	  goto fail;
+	break;
+
+      case PAM_PROMPT_ECHO_ON:
+	/* Nobody is there to answer.  */
+	goto fail;
+
+      case PAM_ERROR_MSG:
+      case PAM_TEXT_INFO:
+	if (!quiet)
+	  printf ("%s\n", msg[i]->msg);
+	break;
+      }
+
+  *resp = replies;
+
+  return PAM_SUCCESS;
+
+ fail:
+
+  for (i = 0; i < num_msg; i++)
+    free (replies[i].resp);
+  free (replies);
+
+  return PAM_CONV_ERR;
+}
+
+/* Use the standard conversation function from libpam-misc unless a
+   PIN has been given. */
 static struct pam_conv conv =
   {
     misc_conv,
@@ -50,6 +112,8 @@ Options:\n\
  -h, --help      print help information\n\
  -v, --version   print version information\n\
  -u, --username  specify username for authentication\n\
+ -p, --pin PIN   answer PIN prompts with PIN\n\
+ -c, --count N   authenticate N times and print timing\n\
 \n\
 Report bugs to <moritz@gnu.org>.\n", PROGRAM_NAME);
 }
@@ -60,7 +124,8 @@ print_version (void)
   printf (PROGRAM_NAME " " PROGRAM_VERSION "\n");
 }
 
-static void
+/* Run one authentication, return true on success.  */
+static int
 test_auth (const char *servicename, const char *username)
 {
   const void *user_opaque;
@@ -68,6 +133,8 @@ test_auth (const char *servicename, const char *username)
   pam_handle_t *handle;
   int rc;
 
+  pin_prompts = 0;
+
   /* Connect to PAM.  */
   rc = pam_start (servicename, username, &conv, &handle);
   if (rc != PAM_SUCCESS)
@@ -80,8 +147,16 @@ test_auth (const char *servicename, const char *username)
   rc = pam_authenticate (handle, 0);
   if (rc != PAM_SUCCESS)
     {
-      printf ("Authentication failed\n");
+      if (!quiet)
+	printf ("Authentication failed\n");
       fprintf (stderr, "error: %s\n", pam_strerror (handle, rc));
+      pam_end (handle, rc);
+      goto out;
+    }
+
+  if (quiet)
+    {
+      pam_end (handle, rc);
       goto out;
     }
 
@@ -98,13 +173,21 @@ test_auth (const char *servicename, const char *username)
   printf ("Authenticated as user `%s'\n", user);
 
   /* Disconnect from PAM.  */
-  rc = pam_end (handle, rc);
-  if (rc != PAM_SUCCESS)
+  if (pam_end (handle, rc) != PAM_SUCCESS)
     fprintf (stderr, "error: failed to release PAM handle\n");
 
  out:
 
-  return;
+  return rc == PAM_SUCCESS;
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
 /* This is a simple test program for PAM authentication.  */
@@ -113,6 +196,10 @@ main (int argc, char **argv)
 {
   const char *servicename;
   const char *username;
+  unsigned long count = 1;
+  unsigned long i, failed;
+  double start, elapsed;
+  char *end;
   int c;
 
   servicename = username = NULL;
@@ -124,11 +211,13 @@ main (int argc, char **argv)
 	  { "version", no_argument, 0, 'v' },
 	  { "help", no_argument, 0, 'h' },
 	  { "user", required_argument, 0, 'u' },
+	  { "pin", required_argument, 0, 'p' },
+	  { "count", required_argument, 0, 'c' },
 	  { 0, 0, 0, 0 }
 	};
       int option_index = 0;
 
-      c = getopt_long (argc, argv, "vhu:",
+      c = getopt_long (argc, argv, "vhu:p:c:",
 		       long_options, &option_index);
 
       /* Detect the end of the options. */
@@ -146,6 +235,20 @@ main (int argc, char **argv)
 	    }
 	  break;
 
+	case 'p':
+	  pin = optarg;
+	  break;
+
+	case 'c':
+	  errno = 0;
+	  count = strtoul (optarg, &end, 10);
+	  if (!*optarg || *end || errno || !count)
+	    {
+	      fprintf (stderr, "invalid count `%s'\n", optarg);
+	      exit (1);
+	    }
+	  break;
+
 	case 'h':
 	  print_help ();
 	  exit (0);
@@ -172,9 +275,28 @@ main (int argc, char **argv)
     }
 
   servicename = argv[optind];
-  test_auth (servicename, username);
 
-  return 0;
+  if (pin)
+    conv.conv = pin_conv;
+
+  if (count == 1)
+    {
+      test_auth (servicename, username);
+      return 0;
+    }
+
+  quiet = 1;
+  failed = 0;
+  start = now ();
+  for (i = 0; i < count; i++)
+    if (!test_auth (servicename, username))
+      failed++;
+  elapsed = now () - start;
+
+  printf ("%lu authentications, %lu failed, %.3f s (%.2f ms per authentication)\n",
+	  count, failed, elapsed, elapsed * 1e3 / count);
+
+  return failed ? 1 : 0;
 }
 
 /* end */
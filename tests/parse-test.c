@@ -20,10 +20,15 @@
 /* For Poldi I wrote a minimalistic library for parsing configuration
    files and command-line arguments named "simpleparse".  This is a
    test program for simpleparse.  -mo */
+
+/* With --benchmark N, a configuration file of N lines is generated
+   and the time needed for parsing it is reported.  */
  
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
+#include <time.h>
 
 #include <gpg-error.h>
 
@@ -34,7 +39,8 @@ enum opt_ids
   {
     FOO = 1,
     BAR,
-    BAZ
+    BAZ,
+    BENCHMARK
   };
 
 static simpleparse_opt_spec_t opt_specs[] =
@@ -42,19 +48,111 @@ static simpleparse_opt_spec_t opt_specs[] =
     { FOO, "foo", 'f', SIMPLEPARSE_ARG_REQUIRED, 0, "the foo switch requires an argument" },
     { BAR, "bar", 'b', SIMPLEPARSE_ARG_OPTIONAL, 0, "the bar switch takes an optional argument" },
     { BAZ, "baz", 0, SIMPLEPARSE_ARG_NONE, 0, "the baz switch takes no argument" },
+    { BENCHMARK, "benchmark", 0, SIMPLEPARSE_ARG_REQUIRED, 0, "benchmark parsing of a generated file" },
     { 0 }
   };
 
+/* Number of lines for --benchmark.  */
+static unsigned long benchmark_lines;
+
+/* Number of options seen by countcb.  */
+static unsigned long options_seen;
+
 static gpg_error_t
 parsecb (void *cookie, simpleparse_opt_spec_t spec, const char *arg)
 {
   const char *prefix = cookie;
 
+  if (spec.id == BENCHMARK)
+    {
+      benchmark_lines = strtoul (arg, NULL, 10);
+      return 0;
+    }
+
   printf ("[%s] opt: '%s', argument: '%s'\n", prefix, spec.long_opt, arg);
 
   return 0;
 }
 
+static gpg_error_t
+countcb (void *cookie, simpleparse_opt_spec_t spec, const char *arg)
+{
+  options_seen++;
+
+  return 0;
+}
+
+static double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Write a configuration file of LINES lines to a temporary file and
+   report the time needed for parsing it through HANDLE.  */
+static gpg_error_t
+benchmark (simpleparse_handle_t handle, unsigned long lines)
+{
+  double start, elapsed;
+  gpg_error_t err;
+  unsigned long i;
+  int rounds;
+  long size;
+  FILE *fp;
+
+  fp = tmpfile ();
+  if (!fp)
+    return gpg_error_from_syserror ();
+
+  /* A mix of the things found in real configuration files.  */
+  for (i = 0; i < lines; i++)
+    switch (i % 5)
+      {
+      case 0:
+	fprintf (fp, "# Comment line %lu, describing the next option.\n", i);
+	break;
+      case 1:
+	fprintf (fp, "foo /some/file/name-%lu\n", i);
+	break;
+      case 2:
+	fprintf (fp, "  bar \"a quoted value %lu\"\n", i);
+	break;
+      case 3:
+	fprintf (fp, "baz\n");
+	break;
+      case 4:
+	fprintf (fp, "\n");
+	break;
+      }
+  size = ftell (fp);
+
+  simpleparse_set_parse_cb (handle, countcb, NULL);
+
+  rounds = 10;
+  err = 0;
+  start = now ();
+  for (i = 0; i < rounds && !err; i++)
+    {
+      rewind (fp);
+      err = simpleparse_parse_stream (handle, 0, fp);
+    }
+  elapsed = now () - start;
+  fclose (fp);
+  if (err)
+    return err;
+
+  printf ("parsed %lu lines (%ld bytes) %i times, %lu options\n",
+	  lines, size, rounds, options_seen);
+  printf ("  %.3f s, %.1f ns per line, %.1f MB/s\n",
+	  elapsed, elapsed * 1e9 / ((double) rounds * lines),
+	  rounds * size / elapsed / 1e6);
+
+  return 0;
+}
+
 int
 main (int argc, const char **argv)
 {
@@ -99,6 +197,14 @@ main (int argc, const char **argv)
     }
   printf ("\n");
 
+  if (benchmark_lines)
+    {
+      err = benchmark (handle, benchmark_lines);
+      if (err)
+	fprintf (stderr, "benchmark failed: %s\n", gpg_strerror (err));
+      goto out;
+    }
+
   /* Parse stdin as config file. */
   err = simpleparse_parse_stream (handle, 0, stdin);
   if (err)
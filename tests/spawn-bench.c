@@ -0,0 +1,161 @@
+/* spawn-bench.c - benchmark for spawning Assuan servers.
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+/* This program measures the cost of starting a trivial Assuan server
+   through assuan_pipe_connect() at different limits for the number
+   of open files.  It compares the default path, the fork based path
+   (which is used when an atfork callback is given) and the plain
+   fork/close loop/exec sequence assuan_pipe_connect() used to
+   perform.  The "server" is echo(1), printing the greeting.  */
+
+#include <assert.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "assuan.h"
+
+#define ECHO_PROGRAM "/bin/echo"
+
+static const char *echo_argv[] = { "echo", "OK", NULL };
+
+static double
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+atfork_cb (void *opaque, int reserved)
+{
+  (void) opaque;
+  (void) reserved;
+}
+
+/* Start the server through assuan_pipe_connect(), forcing the fork
+   based path if FORK is true.  */
+static void
+spawn_assuan (int fork)
+{
+  assuan_context_t ctx;
+  int no_close_list[] = { 2, -1 };
+  assuan_error_t err;
+
+  if (fork)
+    err = assuan_pipe_connect_ext (&ctx, ECHO_PROGRAM, echo_argv,
+				   no_close_list, atfork_cb, NULL, 0);
+  else
+    err = assuan_pipe_connect (&ctx, ECHO_PROGRAM, echo_argv,
+			       no_close_list);
+  assert (!err);
+  assuan_disconnect (ctx);
+}
+
+/* Start the server like assuan_pipe_connect() used to do: fork,
+   close every descriptor up to the limit and exec.  */
+static void
+spawn_loop (void)
+{
+  pid_t pid;
+  int i, n;
+
+  pid = fork ();
+  assert (pid >= 0);
+  if (!pid)
+    {
+      dup2 (open ("/dev/null", O_WRONLY), 1);
+      n = sysconf (_SC_OPEN_MAX);
+      for (i = 3; i < n; i++)
+	close (i);
+      execv (ECHO_PROGRAM, (char *const *) echo_argv);
+      _exit (4);
+    }
+  waitpid (pid, NULL, 0);
+}
+
+static void
+bench (const char *name, int method, int iterations)
+{
+  double start;
+  int i;
+
+  start = now ();
+  for (i = 0; i < iterations; i++)
+    {
+      if (method < 2)
+	spawn_assuan (method);
+      else
+	spawn_loop ();
+    }
+
+  printf ("  %-28s %10.1f us/spawn\n", name,
+	  (now () - start) * 1e6 / iterations);
+}
+
+int
+main (int argc, const char **argv)
+{
+  static const rlim_t limits[] = { 1024, 16384, 65536, 524288 };
+  struct rlimit rl;
+  int iterations;
+  unsigned int i;
+  int ret;
+
+  iterations = argc > 1 ? atoi (argv[1]) : 200;
+  assert (iterations > 0);
+
+  /* The server exits right after the greeting.  */
+  signal (SIGPIPE, SIG_IGN);
+
+  ret = getrlimit (RLIMIT_NOFILE, &rl);
+  assert (!ret);
+
+  for (i = 0; i < sizeof (limits) / sizeof (*limits); i++)
+    {
+      /* Raising the hard limit requires privileges.  */
+      rl.rlim_cur = limits[i];
+      if (rl.rlim_max != RLIM_INFINITY && rl.rlim_max < limits[i])
+	rl.rlim_max = limits[i];
+      if (setrlimit (RLIMIT_NOFILE, &rl))
+	{
+	  printf ("RLIMIT_NOFILE %lu: cannot set limit, skipped\n",
+		  (unsigned long) limits[i]);
+	  ret = getrlimit (RLIMIT_NOFILE, &rl);
+	  assert (!ret);
+	  continue;
+	}
+
+      printf ("RLIMIT_NOFILE %lu, %i spawns:\n",
+	      (unsigned long) limits[i], iterations);
+      bench ("assuan_pipe_connect", 0, iterations);
+      bench ("assuan_pipe_connect (fork)", 1, iterations);
+      bench ("fork, close loop, exec", 2, iterations);
+    }
+
+  return 0;
+}
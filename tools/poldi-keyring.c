@@ -0,0 +1,408 @@
+/* poldi-keyring.c - convert the Poldi key directory into a keyring
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+/* This program converts the key directory of the local-database
+   authentication method, which contains one key file per card serial
+   number, into a single keyring file.  The keyring is indexed by
+   serial number and keygrip and stores the keys in canonical
+   S-Expression format; if present, Poldi looks up keys in the keyring
+   before consulting the key directory.
+
+   Alternatively, it rewrites the key files in the key directory in
+   canonical S-Expression format, which is cheaper to load than the
+   advanced format.  */
+
+#include <poldi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "util/support.h"
+#include "util/filenames.h"
+#include "util/util.h"
+#include "util/cdb.h"
+#include "defs-localdb.h"
+
+#define PROGRAM_NAME    "poldi-keyring"
+#define PROGRAM_VERSION PACKAGE_VERSION
+
+static void
+print_help (void)
+{
+  printf ("\
+Usage: %s [options] [<key directory> [<keyring file>]]\n\
+       %s --canonical [<key directory>]\n\
+Convert the Poldi key directory into a keyring.\n\
+\n\
+The key directory defaults to %s,\n\
+the keyring file defaults to %s.\n\
+\n\
+Options:\n\
+ -h, --help      print help information\n\
+ -v, --version   print version information\n\
+ -c, --canonical rewrite the key files in canonical format\n\
+                 instead of creating a keyring\n\
+\n\
+Report bugs to <" PACKAGE_BUGREPORT ">.\n",
+	  PROGRAM_NAME, PROGRAM_NAME, POLDI_KEY_DIRECTORY, POLDI_KEYRING_FILE);
+}
+
+static void
+print_version (void)
+{
+  printf (PROGRAM_NAME " " PROGRAM_VERSION "\n");
+}
+
+/* Convert KEY into canonical format, stored in newly allocated memory
+   in *CANON and *CANON_N.  Returns proper error code.  */
+static gpg_error_t
+sexp_to_canon (gcry_sexp_t key, char **canon, size_t *canon_n)
+{
+  size_t n;
+  char *buf;
+
+  n = gcry_sexp_sprint (key, GCRYSEXP_FMT_CANON, NULL, 0);
+  buf = xtrymalloc (n);
+  if (! buf)
+    return gpg_error_from_syserror ();
+  *canon_n = gcry_sexp_sprint (key, GCRYSEXP_FMT_CANON, buf, n);
+  *canon = buf;
+
+  return 0;
+}
+
+/* Read the key contained in the file KEY_PATH into *KEY, also
+   computing its keygrip as hex string in GRIP_HEX.  Returns proper
+   error code.  */
+static gpg_error_t
+read_key_file (const char *key_path, gcry_sexp_t *key, char grip_hex[41])
+{
+  unsigned char grip[20];
+  gpg_error_t err;
+
+  err = file_to_sexp (key_path, key);
+  if (gpg_err_code (err) == GPG_ERR_NO_DATA)
+    err = gpg_error (GPG_ERR_NO_PUBKEY);
+  if (err)
+    return err;
+
+  if (! gcry_pk_get_keygrip (*key, grip))
+    {
+      gcry_sexp_release (*key);
+      *key = NULL;
+      return gpg_error (GPG_ERR_NO_PUBKEY);
+    }
+  bin2hex (grip, sizeof (grip), grip_hex);
+
+  return 0;
+}
+
+/* Add the key KEY with keygrip GRIP_HEX for the card serial number
+   SERIALNO to the keyring under construction MAKE.  Returns proper
+   error code.  */
+static gpg_error_t
+add_key (cdb_make_t make, const char *serialno,
+	 gcry_sexp_t key, const char *grip_hex)
+{
+  gpg_error_t err;
+  size_t canon_n;
+  char *canon;
+
+  err = sexp_to_canon (key, &canon, &canon_n);
+  if (err)
+    return err;
+
+  err = cdb_make_add (make, KEYRING_TABLE_SERIALNO,
+		      serialno, strlen (serialno), canon, canon_n);
+  if (! err)
+    err = cdb_make_add (make, KEYRING_TABLE_KEYGRIP,
+			grip_hex, strlen (grip_hex), canon, canon_n);
+
+  xfree (canon);
+
+  return err;
+}
+
+/* Atomically replace the key file KEY_PATH with the key KEY in
+   canonical format, preserving the file's mode and ownership.
+   Returns proper error code.  */
+static gpg_error_t
+rewrite_key_file (const char *key_path, gcry_sexp_t key)
+{
+  struct stat statbuf;
+  char *tmp_path;
+  gpg_error_t err;
+  size_t canon_n;
+  char *canon;
+  FILE *fp;
+  int fd;
+
+  canon = NULL;
+  fd = -1;
+  fp = NULL;
+
+  tmp_path = xtrymalloc (strlen (key_path) + 8);
+  if (! tmp_path)
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+  strcpy (stpcpy (tmp_path, key_path), ".XXXXXX");
+
+  err = sexp_to_canon (key, &canon, &canon_n);
+  if (err)
+    goto out;
+
+  if (stat (key_path, &statbuf))
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+
+  fd = mkstemp (tmp_path);
+  if (fd == -1)
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+  fp = fdopen (fd, "w");
+  if (! fp)
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+
+  if (fwrite (canon, canon_n, 1, fp) != 1 || fflush (fp)
+      || fchmod (fd, statbuf.st_mode & 07777)
+      || (fchown (fd, statbuf.st_uid, statbuf.st_gid) && errno != EPERM)
+      || fsync (fd))
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+
+  if (fclose (fp))
+    {
+      fp = NULL;
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+  fp = NULL;
+  fd = -1;
+
+  if (rename (tmp_path, key_path))
+    err = gpg_error_from_syserror ();
+
+ out:
+
+  if (fp)
+    fclose (fp);
+  else if (fd != -1)
+    close (fd);
+  if (err && tmp_path)
+    remove (tmp_path);
+  xfree (tmp_path);
+  xfree (canon);
+
+  return err;
+}
+
+/* Process the key file NAME in the directory DIRECTORY: either add it
+   to the keyring under construction MAKE or, if MAKE is NULL, rewrite
+   it in canonical format.  Files not containing a key are skipped
+   with a warning.  Returns proper error code.  */
+static gpg_error_t
+process_key_file (cdb_make_t make, const char *directory, const char *name)
+{
+  char grip_hex[41];
+  gcry_sexp_t key;
+  char *key_path;
+  gpg_error_t err;
+
+  key = NULL;
+  key_path = NULL;
+
+  err = make_filename (&key_path, directory, name, NULL);
+  if (err)
+    goto out;
+
+  err = read_key_file (key_path, &key, grip_hex);
+  if (err)
+    {
+      fprintf (stderr, "%s: skipping `%s': %s\n",
+	       PROGRAM_NAME, key_path, gpg_strerror (err));
+      err = 0;
+      goto out;
+    }
+
+  if (make)
+    err = add_key (make, name, key, grip_hex);
+  else
+    err = rewrite_key_file (key_path, key);
+
+ out:
+
+  gcry_sexp_release (key);
+  xfree (key_path);
+
+  return err;
+}
+
+int
+main (int argc, char **argv)
+{
+  const char *directory;
+  const char *keyring_file;
+  struct dirent *entry;
+  cdb_make_t make;
+  gpg_error_t err;
+  int canonical;
+  DIR *dir;
+  int c;
+
+  directory = POLDI_KEY_DIRECTORY;
+  keyring_file = POLDI_KEYRING_FILE;
+  canonical = 0;
+  make = NULL;
+  dir = NULL;
+
+  while (1)
+    {
+      static struct option long_options[] =
+	{
+	  { "version", no_argument, 0, 'v' },
+	  { "help", no_argument, 0, 'h' },
+	  { "canonical", no_argument, 0, 'c' },
+	  { 0, 0, 0, 0 }
+	};
+      int option_index = 0;
+
+      c = getopt_long (argc, argv, "vhc", long_options, &option_index);
+
+      /* Detect the end of the options. */
+      if (c == -1)
+	break;
+
+      switch (c)
+	{
+	case 'h':
+	  print_help ();
+	  exit (0);
+	  break;
+
+	case 'v':
+	  print_version ();
+	  exit (0);
+	  break;
+
+	case 'c':
+	  canonical = 1;
+	  break;
+
+	case '?':
+	  /* `getopt_long' already printed an error message. */
+	  exit (1);
+	  break;
+
+	default:
+	  abort ();
+	}
+    }
+
+  if (argc - optind > (canonical ? 1 : 2))
+    {
+      print_help ();
+      exit (1);
+    }
+
+  if (!gcry_check_version (NULL))
+    {
+      fprintf (stderr, "%s: failed to initialize libgcrypt\n", PROGRAM_NAME);
+      exit (1);
+    }
+  gcry_control (GCRYCTL_INITIALIZATION_FINISHED, 0);
+
+  if (argc - optind > 0)
+    directory = argv[optind];
+  if (argc - optind > 1)
+    keyring_file = argv[optind + 1];
+
+  dir = opendir (directory);
+  if (! dir)
+    {
+      err = gpg_error_from_syserror ();
+      fprintf (stderr, "%s: failed to open key directory `%s': %s\n",
+	       PROGRAM_NAME, directory, gpg_strerror (err));
+      goto out;
+    }
+
+  if (! canonical)
+    {
+      err = cdb_make_start (&make, keyring_file, KEYRING_TABLES);
+      if (err)
+	{
+	  fprintf (stderr, "%s: failed to create keyring `%s': %s\n",
+		   PROGRAM_NAME, keyring_file, gpg_strerror (err));
+	  goto out;
+	}
+    }
+
+  while ((entry = readdir (dir)))
+    {
+      /* Skip hidden files (including "." and "..") and the README
+	 installed into the key directory.  */
+      if (entry->d_name[0] == '.' || ! strcmp (entry->d_name, "README"))
+	continue;
+
+      err = process_key_file (make, directory, entry->d_name);
+      if (err)
+	{
+	  fprintf (stderr, "%s: failed to %s key `%s': %s\n",
+		   PROGRAM_NAME, canonical ? "rewrite" : "add",
+		   entry->d_name, gpg_strerror (err));
+	  goto out;
+	}
+    }
+
+  if (canonical)
+    goto out;
+
+  err = cdb_make_finish (make);
+  make = NULL;
+  if (err)
+    fprintf (stderr, "%s: failed to write keyring `%s': %s\n",
+	     PROGRAM_NAME, keyring_file, gpg_strerror (err));
+
+ out:
+
+  if (make)
+    cdb_make_abort (make);
+  if (dir)
+    closedir (dir);
+
+  return !!err;
+}
+
+/* end */
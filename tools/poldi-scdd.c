@@ -0,0 +1,734 @@
+/* poldi-scdd.c - scdaemon broker for Poldi
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+/* Without gpg-agent, Poldi spawns a new scdaemon for every
+   authentication, which means paying for scdaemon's startup, reader
+   enumeration and card reset every time.  poldi-scdd keeps a single
+   scdaemon running and serves Poldi instances over a Unix domain
+   socket, one at a time; Poldi uses it automatically if the socket
+   exists.  Connections arriving while a client is being served are
+   queued by the kernel and accepted once that client is done; Poldi
+   must not start its own scdaemon meanwhile, as it would compete with
+   ours for the reader.
+
+   The protocol spoken on the socket is scdaemon's Assuan protocol:
+   poldi-scdd greets the client itself and then relays lines between
+   client and scdaemon verbatim, including inquiries.  A BYE from the
+   client is answered by poldi-scdd, since scdaemon would terminate
+   otherwise.  After the client is gone, the scdaemon connection is
+   reset with RESET; unlike RESTART, this makes scdaemon reset the
+   card as well, so that a PIN verified by one client is not available
+   to the next one.  scdaemon is terminated if the reset fails.  Only
+   root and the user running poldi-scdd may connect.  */
+
+#include <poldi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "assuan.h"
+#include "util/util.h"
+#include "util/simplelog.h"
+#include "util/defs.h"
+
+#define PROGRAM_NAME    "poldi-scdd"
+#define PROGRAM_VERSION PACKAGE_VERSION
+
+/* Clients idle for more than this number of seconds are
+   disconnected by default.  */
+#define DEFAULT_CLIENT_TIMEOUT 300
+
+static struct
+{
+  const char *socket_name;
+  const char *scd_path;
+  const char *scd_options;
+  int debug;
+  int use_syslog;
+  int timeout;
+} opt;
+
+static log_handle_t loghandle;
+
+/* Connection to scdaemon, NULL if not running.  */
+static assuan_context_t scd_ctx;
+
+/* Set by the signal handler for termination signals.  */
+static volatile sig_atomic_t terminate;
+
+/* State of a client connection.  */
+struct client_s
+{
+  int fd;			/* -1 if there is no client.  */
+
+  /* Buffer for lines received from the client.  */
+  char buffer[ASSUAN_LINELENGTH];
+  size_t buflen;
+
+  /* Number of commands of the client forwarded to scdaemon, but not
+     completed yet.  Clients may send several commands before reading
+     the responses.  */
+  unsigned int commands_pending;
+
+  /* True while scdaemon waits for the client to answer an
+     inquiry.  */
+  int inquire_pending;
+};
+
+static void
+print_help (void)
+{
+  printf ("\
+Usage: %s [options]\n\
+Keep scdaemon running for use by Poldi.\n\
+\n\
+Options:\n\
+ -h, --help                  print help information\n\
+ -v, --version               print version information\n\
+ -d, --debug                 enable debugging output\n\
+ -l, --syslog                log to syslog instead of stderr\n\
+ -s, --socket NAME           listen on socket NAME\n\
+                             (default: %s)\n\
+ -S, --scdaemon-program FILE use FILE as scdaemon\n\
+ -o, --scdaemon-options FILE use FILE as scdaemon configuration file\n\
+ -t, --timeout N             disconnect clients idle for N seconds\n\
+\n\
+Report bugs to <" PACKAGE_BUGREPORT ">.\n",
+	  PROGRAM_NAME, POLDI_SCDD_SOCKET);
+}
+
+static void
+print_version (void)
+{
+  printf (PROGRAM_NAME " " PROGRAM_VERSION "\n");
+}
+
+static void
+terminate_handler (int signo)
+{
+  terminate = 1;
+}
+
+
+
+/*
+ * scdaemon connection.
+ */
+
+/* Spawn scdaemon.  Returns proper error code.  */
+static gpg_error_t
+scd_start (void)
+{
+  const char *scd_path;
+  const char *pgmname;
+  const char *argv[5];
+  int no_close_list[2];
+  gpg_error_t err;
+  int i;
+
+  scd_path = opt.scd_path;
+  if (!scd_path || !*scd_path)
+    scd_path = GNUPG_DEFAULT_SCD;
+  if (!(pgmname = strrchr (scd_path, '/')))
+    pgmname = scd_path;
+  else
+    pgmname++;
+
+  i = 0;
+  argv[i++] = pgmname;
+  argv[i++] = "--server";
+  if (opt.scd_options)
+    {
+      argv[i++] = "--options";
+      argv[i++] = opt.scd_options;
+    }
+  argv[i++] = NULL;
+
+  no_close_list[0] = fileno (stderr);
+  no_close_list[1] = -1;
+
+  err = assuan_pipe_connect (&scd_ctx, scd_path, argv, no_close_list);
+  if (err)
+    {
+      log_msg_error (loghandle, "could not spawn scdaemon: %s",
+		     gpg_strerror (err));
+      scd_ctx = NULL;
+    }
+  else
+    log_msg_info (loghandle, "spawned scdaemon (path: '%s', pid: %lu)",
+		  scd_path, (unsigned long) assuan_get_pid (scd_ctx));
+
+  return err;
+}
+
+/* Terminate scdaemon.  */
+static void
+scd_stop (void)
+{
+  if (scd_ctx)
+    {
+      assuan_disconnect (scd_ctx);
+      scd_ctx = NULL;
+    }
+}
+
+/* Return the file descriptor for reading from scdaemon.  */
+static int
+scd_fd (void)
+{
+  assuan_fd_t fds[2];
+
+  if (assuan_get_active_fds (scd_ctx, 0, fds, DIM (fds)) < 1)
+    return -1;
+
+  return fds[0];
+}
+
+/* Return true if LINE begins with the Assuan keyword KEYWORD.  */
+static int
+has_keyword (const char *line, const char *keyword)
+{
+  size_t n = strlen (keyword);
+
+  return (!strncmp (line, keyword, n) && (!line[n] || line[n] == ' '));
+}
+
+/* Bring scdaemon and the card into their initial state after CLIENT
+   has gone, by cancelling pending inquiries, draining pending
+   responses and resetting the connection and the card.  scdaemon is
+   terminated in case this fails.  */
+static void
+scd_reset (struct client_s *client)
+{
+  gpg_error_t err;
+  size_t linelen;
+  char *line;
+
+  err = 0;
+
+  if (client->inquire_pending)
+    err = assuan_write_line (scd_ctx, "CAN");
+
+  while (!err && client->commands_pending)
+    {
+      err = assuan_read_line (scd_ctx, &line, &linelen);
+      if (!err && (has_keyword (line, "OK") || has_keyword (line, "ERR")))
+	client->commands_pending--;
+      else if (!err && has_keyword (line, "INQUIRE"))
+	err = assuan_write_line (scd_ctx, "CAN");
+    }
+
+  if (!err)
+    err = assuan_transact (scd_ctx, "RESET",
+			   NULL, NULL, NULL, NULL, NULL, NULL);
+  if (err)
+    {
+      log_msg_error (loghandle, "failed to reset scdaemon: %s",
+		     gpg_strerror (err));
+      scd_stop ();
+    }
+}
+
+
+
+/*
+ * Client connections.
+ */
+
+/* Write the LEN bytes in BUFFER to the file descriptor FD.  Returns
+   proper error code.  */
+static gpg_error_t
+write_all (int fd, const char *buffer, size_t len)
+{
+  ssize_t n;
+
+  while (len)
+    {
+      n = write (fd, buffer, len);
+      if (n == -1 && errno == EINTR)
+	continue;
+      if (n == -1)
+	return gpg_error_from_syserror ();
+      buffer += n;
+      len -= n;
+    }
+
+  return 0;
+}
+
+/* Check that the peer of the socket FD is allowed to connect.  */
+static int
+client_allowed (int fd)
+{
+  struct ucred cred;
+  socklen_t len;
+
+  len = sizeof (cred);
+  if (getsockopt (fd, SOL_SOCKET, SO_PEERCRED, &cred, &len))
+    {
+      log_msg_error (loghandle, "failed to retrieve peer credentials: %s",
+		     strerror (errno));
+      return 0;
+    }
+
+  if (cred.uid != 0 && cred.uid != geteuid ())
+    {
+      log_msg_error (loghandle, "rejecting connection from pid %lu, uid %lu",
+		     (unsigned long) cred.pid, (unsigned long) cred.uid);
+      return 0;
+    }
+
+  if (opt.debug)
+    log_msg_debug (loghandle, "accepted connection from pid %lu, uid %lu",
+		   (unsigned long) cred.pid, (unsigned long) cred.uid);
+
+  return 1;
+}
+
+/* Process the line LINE received from CLIENT.  Returns GPG_ERR_EOF in
+   case the client said BYE, other error codes on failure.  */
+static gpg_error_t
+client_line (struct client_s *client, const char *line)
+{
+  if (client->inquire_pending)
+    {
+      if (has_keyword (line, "END") || has_keyword (line, "CAN"))
+	client->inquire_pending = 0;
+    }
+  else if (has_keyword (line, "BYE"))
+    {
+      /* Do not let the client terminate scdaemon.  */
+      write_all (client->fd, "OK closing connection\n", 22);
+      return gpg_error (GPG_ERR_EOF);
+    }
+  else
+    client->commands_pending++;
+
+  return assuan_write_line (scd_ctx, line);
+}
+
+/* Read data from CLIENT and process complete lines.  Returns
+   GPG_ERR_EOF in case the client is done, other error codes on
+   failure.  */
+static gpg_error_t
+client_read (struct client_s *client)
+{
+  gpg_error_t err;
+  ssize_t n;
+  char *eol;
+  size_t len;
+
+  do
+    n = read (client->fd, client->buffer + client->buflen,
+	      sizeof (client->buffer) - client->buflen);
+  while (n == -1 && errno == EINTR);
+  if (n == -1)
+    return gpg_error_from_syserror ();
+  if (!n)
+    return gpg_error (GPG_ERR_EOF);
+  client->buflen += n;
+
+  while ((eol = memchr (client->buffer, '\n', client->buflen)))
+    {
+      *eol = 0;
+      if (eol > client->buffer && eol[-1] == '\r')
+	eol[-1] = 0;
+      err = client_line (client, client->buffer);
+      if (err)
+	return err;
+      len = eol + 1 - client->buffer;
+      memmove (client->buffer, eol + 1, client->buflen - len);
+      client->buflen -= len;
+    }
+
+  if (client->buflen == sizeof (client->buffer))
+    {
+      log_msg_error (loghandle, "line from client too long");
+      return gpg_error (GPG_ERR_TOO_LARGE);
+    }
+
+  return 0;
+}
+
+/* Read a line from scdaemon and forward it to CLIENT.  Returns proper
+   error code.  */
+static gpg_error_t
+scd_read (struct client_s *client)
+{
+  gpg_error_t err;
+  size_t linelen;
+  char *line;
+
+  err = assuan_read_line (scd_ctx, &line, &linelen);
+  if (err)
+    {
+      log_msg_error (loghandle, "failed to read from scdaemon: %s",
+		     gpg_strerror (err));
+      scd_stop ();
+      return err;
+    }
+
+  if ((has_keyword (line, "OK") || has_keyword (line, "ERR"))
+      && client->commands_pending)
+    {
+      client->commands_pending--;
+      client->inquire_pending = 0;
+    }
+  else if (has_keyword (line, "INQUIRE"))
+    client->inquire_pending = 1;
+
+  /* The line is terminated by the NUL replacing the LF.  */
+  line[linelen] = '\n';
+  err = write_all (client->fd, line, linelen + 1);
+  line[linelen] = 0;
+
+  return err;
+}
+
+/* Finish serving CLIENT, whose connection failed with ERR, and reset
+   scdaemon for the next client.  */
+static void
+client_done (struct client_s *client, gpg_error_t err)
+{
+  if (err && gpg_err_code (err) != GPG_ERR_EOF)
+    log_msg_error (loghandle, "client connection failed: %s",
+		   gpg_strerror (err));
+
+  close (client->fd);
+  client->fd = -1;
+
+  if (scd_ctx)
+    scd_reset (client);
+}
+
+/* Accept a connection on the socket LISTEN_FD and start serving it as
+   CLIENT.  */
+static void
+client_accept (struct client_s *client, int listen_fd)
+{
+  static const char greeting[] = "OK Poldi scdaemon broker ready\n";
+  gpg_error_t err;
+  int fd;
+
+  fd = accept (listen_fd, NULL, NULL);
+  if (fd == -1)
+    {
+      if (errno != EINTR)
+	log_msg_error (loghandle, "accept failed: %s", strerror (errno));
+      return;
+    }
+
+  if (!client_allowed (fd))
+    {
+      close (fd);
+      return;
+    }
+
+  if (!scd_ctx && scd_start ())
+    {
+      close (fd);
+      return;
+    }
+
+  memset (client, 0, sizeof (*client));
+  client->fd = fd;
+
+  err = write_all (fd, greeting, sizeof (greeting) - 1);
+  if (err)
+    client_done (client, err);
+}
+
+
+
+/* Create the listening socket.  Returns the socket or -1 on
+   failure.  */
+static int
+create_socket (const char *name)
+{
+  struct sockaddr_un addr;
+  char *dir, *p;
+  int fd;
+
+  if (strlen (name) >= sizeof (addr.sun_path))
+    {
+      log_msg_error (loghandle, "socket name `%s' too long", name);
+      return -1;
+    }
+
+  /* Create the directories leading to the socket, if needed.  Poldi
+     only uses sockets in directories owned by root, thus other users
+     have to provide the directory themselves.  */
+  if (!geteuid ())
+    {
+      dir = xtrystrdup (name);
+      if (!dir)
+	return -1;
+      for (p = strchr (dir + 1, '/'); p; p = strchr (p + 1, '/'))
+	{
+	  *p = 0;
+	  if (mkdir (dir, 0755) && errno != EEXIST)
+	    log_msg_error (loghandle, "failed to create directory `%s': %s",
+			   dir, strerror (errno));
+	  *p = '/';
+	}
+      xfree (dir);
+    }
+
+  fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1)
+    {
+      log_msg_error (loghandle, "failed to create socket: %s",
+		     strerror (errno));
+      return -1;
+    }
+
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, name);
+
+  /* Remove a stale socket.  */
+  unlink (name);
+  if (bind (fd, (struct sockaddr *) &addr, sizeof (addr))
+      || chmod (name, 0600)
+      || listen (fd, 16))
+    {
+      log_msg_error (loghandle, "failed to listen on socket `%s': %s",
+		     name, strerror (errno));
+      close (fd);
+      return -1;
+    }
+
+  return fd;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct client_s client;
+  struct sigaction sa;
+  struct pollfd pfd[3];
+  gpg_error_t err;
+  int listen_fd;
+  int ret;
+  int c;
+
+  opt.socket_name = POLDI_SCDD_SOCKET;
+  opt.timeout = DEFAULT_CLIENT_TIMEOUT;
+
+  while (1)
+    {
+      static struct option long_options[] =
+	{
+	  { "version", no_argument, 0, 'v' },
+	  { "help", no_argument, 0, 'h' },
+	  { "debug", no_argument, 0, 'd' },
+	  { "syslog", no_argument, 0, 'l' },
+	  { "socket", required_argument, 0, 's' },
+	  { "scdaemon-program", required_argument, 0, 'S' },
+	  { "scdaemon-options", required_argument, 0, 'o' },
+	  { "timeout", required_argument, 0, 't' },
+	  { 0, 0, 0, 0 }
+	};
+      int option_index = 0;
+
+      c = getopt_long (argc, argv, "vhdls:S:o:t:",
+		       long_options, &option_index);
+
+      /* Detect the end of the options. */
+      if (c == -1)
+	break;
+
+      switch (c)
+	{
+	case 'h':
+	  print_help ();
+	  exit (0);
+	  break;
+
+	case 'v':
+	  print_version ();
+	  exit (0);
+	  break;
+
+	case 'd':
+	  opt.debug = 1;
+	  break;
+
+	case 'l':
+	  opt.use_syslog = 1;
+	  break;
+
+	case 's':
+	  opt.socket_name = optarg;
+	  break;
+
+	case 'S':
+	  opt.scd_path = optarg;
+	  break;
+
+	case 'o':
+	  opt.scd_options = optarg;
+	  break;
+
+	case 't':
+	  opt.timeout = atoi (optarg);
+	  if (opt.timeout <= 0)
+	    {
+	      fprintf (stderr, "%s: invalid timeout `%s'\n",
+		       PROGRAM_NAME, optarg);
+	      exit (1);
+	    }
+	  break;
+
+	case '?':
+	  /* `getopt_long' already printed an error message. */
+	  exit (1);
+	  break;
+
+	default:
+	  abort ();
+	}
+    }
+
+  if (argc != optind)
+    {
+      print_help ();
+      exit (1);
+    }
+
+  /* Init.  */
+  err = log_create (&loghandle);
+  if (!err)
+    err = (opt.use_syslog
+	   ? log_set_backend_syslog (loghandle)
+	   : log_set_backend_stream (loghandle, stderr));
+  if (err)
+    {
+      fprintf (stderr, "%s: failed to set up logging: %s\n",
+	       PROGRAM_NAME, gpg_strerror (err));
+      exit (1);
+    }
+  log_set_prefix (loghandle, PROGRAM_NAME);
+  log_set_flags (loghandle, LOG_FLAG_WITH_PREFIX);
+  if (opt.debug)
+    log_set_min_level (loghandle, LOG_LEVEL_DEBUG);
+  else
+    log_set_min_level (loghandle, LOG_LEVEL_INFO);
+
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = SIG_IGN;
+  sigaction (SIGPIPE, &sa, NULL);
+  /* scdaemon signals its peer - that is us - about card status
+     changes if a client asks for it with OPTION event-signal.  */
+  sigaction (SIGUSR1, &sa, NULL);
+  sigaction (SIGUSR2, &sa, NULL);
+  sa.sa_handler = terminate_handler;
+  sigaction (SIGTERM, &sa, NULL);
+  sigaction (SIGINT, &sa, NULL);
+  sigaction (SIGHUP, &sa, NULL);
+
+  listen_fd = create_socket (opt.socket_name);
+  if (listen_fd == -1)
+    exit (1);
+
+  /* Start scdaemon right away, so that it is warm when the first
+     client connects.  */
+  scd_start ();
+
+  client.fd = -1;
+  while (!terminate)
+    {
+      if (client.fd != -1 && scd_ctx && assuan_pending_line (scd_ctx))
+	{
+	  err = scd_read (&client);
+	  if (err)
+	    client_done (&client, err);
+	  continue;
+	}
+
+      /* Watch scdaemon even without a client, so that we notice it
+	 terminating.  Further connections are accepted only after the
+	 current client is done, until then they wait in the listen
+	 queue.  */
+      pfd[0].fd = client.fd == -1 ? listen_fd : -1;
+      pfd[0].events = POLLIN;
+      pfd[1].fd = scd_ctx ? scd_fd () : -1;
+      pfd[1].events = POLLIN;
+      pfd[2].fd = client.fd;
+      pfd[2].events = POLLIN;
+      ret = poll (pfd, 3, client.fd != -1 ? opt.timeout * 1000 : -1);
+      if (ret == -1)
+	{
+	  if (errno != EINTR)
+	    log_msg_error (loghandle, "poll failed: %s", strerror (errno));
+	  continue;
+	}
+
+      if (!ret)
+	{
+	  log_msg_info (loghandle, "disconnecting idle client");
+	  client_done (&client, gpg_error (GPG_ERR_TIMEOUT));
+	  continue;
+	}
+
+      if (pfd[1].revents && client.fd == -1)
+	{
+	  /* scdaemon is not supposed to talk to us unasked.  */
+	  log_msg_info (loghandle, "scdaemon terminated");
+	  scd_stop ();
+	}
+      else if (pfd[1].revents)
+	{
+	  err = scd_read (&client);
+	  if (err)
+	    client_done (&client, err);
+	}
+      else if (pfd[2].revents)
+	{
+	  err = client_read (&client);
+	  if (err)
+	    client_done (&client, err);
+	}
+
+      if (pfd[0].revents)
+	client_accept (&client, listen_fd);
+    }
+
+  if (client.fd != -1)
+    close (client.fd);
+  log_msg_info (loghandle, "terminating");
+  unlink (opt.socket_name);
+  close (listen_fd);
+  scd_stop ();
+  log_destroy (loghandle);
+
+  return 0;
+}
+
+/* end */
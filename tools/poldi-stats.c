@@ -0,0 +1,260 @@
+/* poldi-stats.c - Print Poldi's authentication statistics
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+/* This program prints the authentication latency statistics recorded
+   by Poldi: counters, and for every phase of an authentication the
+   number of runs, mean and maximum duration as well as percentiles
+   estimated from the histogram.  */
+
+#include <poldi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "util/defs.h"
+#include "util/stats.h"
+
+#define PROGRAM_NAME    "poldi-stats"
+#define PROGRAM_VERSION PACKAGE_VERSION
+
+static void
+print_help (void)
+{
+  printf ("\
+Usage: %s [options] [<stats file>]\n\
+Print Poldi's authentication statistics.\n\
+\n\
+The stats file defaults to %s.\n\
+\n\
+Options:\n\
+ -H, --histogram print the histograms\n\
+ -r, --reset     reset the statistics after printing them\n\
+ -h, --help      print help information\n\
+ -v, --version   print version information\n\
+\n\
+Report bugs to <" PACKAGE_BUGREPORT ">.\n",
+	  PROGRAM_NAME, POLDI_STATS_FILE);
+}
+
+static void
+print_version (void)
+{
+  printf (PROGRAM_NAME " " PROGRAM_VERSION "\n");
+}
+
+/* Print the upper bound of histogram bucket BUCKET in milliseconds
+   into BUFFER of size SIZE.  */
+static void
+format_bucket (char *buffer, size_t size, unsigned int bucket)
+{
+  if (bucket == STATS_BUCKETS - 1)
+    snprintf (buffer, size, ">%u", 1U << (bucket - 1));
+  else
+    snprintf (buffer, size, "<%u", 1U << bucket);
+}
+
+/* Print the bucket containing the percentile PERCENT of the phase
+   P.  */
+static void
+print_percentile (const struct stats_phase_data *p, unsigned int percent)
+{
+  uint64_t rank, seen;
+  unsigned int bucket;
+  char buffer[16];
+
+  rank = (p->count * percent + 99) / 100;
+  seen = 0;
+  for (bucket = 0; bucket < STATS_BUCKETS - 1; bucket++)
+    {
+      seen += p->buckets[bucket];
+      if (seen >= rank)
+	break;
+    }
+
+  format_bucket (buffer, sizeof (buffer), bucket);
+  printf (" %8s", buffer);
+}
+
+/* Print the histogram of the phase P.  */
+static void
+print_histogram (const struct stats_phase_data *p)
+{
+  uint64_t max;
+  unsigned int bucket, width;
+  char buffer[16];
+
+  max = 0;
+  for (bucket = 0; bucket < STATS_BUCKETS; bucket++)
+    if (p->buckets[bucket] > max)
+      max = p->buckets[bucket];
+
+  for (bucket = 0; bucket < STATS_BUCKETS; bucket++)
+    {
+      if (!p->buckets[bucket])
+	continue;
+      width = (unsigned int) (p->buckets[bucket] * 50 / max);
+      if (!width)
+	width = 1;
+      format_bucket (buffer, sizeof (buffer), bucket);
+      printf ("  %8s ms %10llu %.*s\n", buffer,
+	      (unsigned long long) p->buckets[bucket], (int) width,
+	      "##################################################");
+    }
+}
+
+static void
+print_stats (const struct stats_data *data, int histogram)
+{
+  const struct stats_phase_data *p;
+  char timebuf[64];
+  time_t reset_time;
+  unsigned int i;
+
+  reset_time = data->reset_time;
+  strftime (timebuf, sizeof (timebuf), "%Y-%m-%d %H:%M:%S",
+	    localtime (&reset_time));
+  printf ("statistics since %s\n\n", timebuf);
+
+  for (i = 0; i < STATS_COUNTERS; i++)
+    printf ("%-16s %10llu\n", stats_counter_name (i),
+	    (unsigned long long) data->counters[i]);
+
+  printf ("\n%-16s %10s %10s %10s %8s %8s %8s\n",
+	  "phase", "count", "mean ms", "max ms", "p50", "p90", "p99");
+  for (i = 0; i < STATS_PHASES; i++)
+    {
+      p = &data->phases[i];
+      printf ("%-16s %10llu", stats_phase_name (i),
+	      (unsigned long long) p->count);
+      if (!p->count)
+	{
+	  putchar ('\n');
+	  continue;
+	}
+      printf (" %10.1f %10.1f", p->sum_us / 1000.0 / p->count,
+	      p->max_us / 1000.0);
+      print_percentile (p, 50);
+      print_percentile (p, 90);
+      print_percentile (p, 99);
+      putchar ('\n');
+
+      if (histogram)
+	print_histogram (p);
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+  const char *stats_file;
+  struct stats_data data;
+  stats_t stats;
+  gpg_error_t err;
+  int histogram;
+  int reset;
+  int c;
+
+  stats_file = POLDI_STATS_FILE;
+  histogram = 0;
+  reset = 0;
+
+  while (1)
+    {
+      static struct option long_options[] =
+	{
+	  { "histogram", no_argument, 0, 'H' },
+	  { "reset", no_argument, 0, 'r' },
+	  { "version", no_argument, 0, 'v' },
+	  { "help", no_argument, 0, 'h' },
+	  { 0, 0, 0, 0 }
+	};
+      int option_index = 0;
+
+      c = getopt_long (argc, argv, "Hrvh", long_options, &option_index);
+
+      /* Detect the end of the options. */
+      if (c == -1)
+	break;
+
+      switch (c)
+	{
+	case 'H':
+	  histogram = 1;
+	  break;
+
+	case 'r':
+	  reset = 1;
+	  break;
+
+	case 'h':
+	  print_help ();
+	  exit (0);
+	  break;
+
+	case 'v':
+	  print_version ();
+	  exit (0);
+	  break;
+
+	case '?':
+	  /* `getopt_long' already printed an error message. */
+	  exit (1);
+	  break;
+
+	default:
+	  abort ();
+	}
+    }
+
+  if (argc - optind > 1)
+    {
+      print_help ();
+      exit (1);
+    }
+
+  if (argc - optind > 0)
+    stats_file = argv[optind];
+
+  if (reset)
+    err = stats_open (stats_file, &stats);
+  else
+    err = stats_open_readonly (stats_file, &stats);
+  if (err)
+    {
+      fprintf (stderr, "%s: failed to open `%s': %s\n",
+	       PROGRAM_NAME, stats_file, gpg_strerror (err));
+      exit (1);
+    }
+
+  /* Work on a snapshot, the file may change while printing.  */
+  memcpy (&data, stats_get (stats), sizeof (data));
+  print_stats (&data, histogram);
+
+  if (reset)
+    stats_reset (stats);
+
+  stats_close (stats);
+
+  return 0;
+}
+
+/* end */
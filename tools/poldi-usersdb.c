@@ -0,0 +1,133 @@
+/* poldi-usersdb.c - compile the Poldi users database
+   Copyright (C) 2026 g10 Code GmbH
+
+   This file is part of Poldi.
+
+   Poldi is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   Poldi is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see
+   <http://www.gnu.org/licenses/>.  */
+
+/* This program compiles the plain text users database of the
+   local-database authentication method into a constant database,
+   which Poldi prefers over the text file as long as the latter has
+   not been modified after the database.  This allows for distributing precompiled
+   databases to many hosts.  */
+
+#include <poldi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include "usersdb.h"
+#include "defs-localdb.h"
+
+#define PROGRAM_NAME    "poldi-usersdb"
+#define PROGRAM_VERSION PACKAGE_VERSION
+
+static void
+print_help (void)
+{
+  printf ("\
+Usage: %s [options] [<users file> [<database file>]]\n\
+Compile the Poldi users database.\n\
+\n\
+The users file defaults to %s,\n\
+the database file defaults to %s.\n\
+\n\
+Options:\n\
+ -h, --help      print help information\n\
+ -v, --version   print version information\n\
+\n\
+Report bugs to <" PACKAGE_BUGREPORT ">.\n",
+	  PROGRAM_NAME, POLDI_USERS_DB_FILE, POLDI_USERS_INDEX_FILE);
+}
+
+static void
+print_version (void)
+{
+  printf (PROGRAM_NAME " " PROGRAM_VERSION "\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  const char *users_file;
+  const char *db_file;
+  gpg_error_t err;
+  int c;
+
+  users_file = POLDI_USERS_DB_FILE;
+  db_file = POLDI_USERS_INDEX_FILE;
+
+  while (1)
+    {
+      static struct option long_options[] =
+	{
+	  { "version", no_argument, 0, 'v' },
+	  { "help", no_argument, 0, 'h' },
+	  { 0, 0, 0, 0 }
+	};
+      int option_index = 0;
+
+      c = getopt_long (argc, argv, "vh", long_options, &option_index);
+
+      /* Detect the end of the options. */
+      if (c == -1)
+	break;
+
+      switch (c)
+	{
+	case 'h':
+	  print_help ();
+	  exit (0);
+	  break;
+
+	case 'v':
+	  print_version ();
+	  exit (0);
+	  break;
+
+	case '?':
+	  /* `getopt_long' already printed an error message. */
+	  exit (1);
+	  break;
+
+	default:
+	  abort ();
+	}
+    }
+
+  if (argc - optind > 2)
+    {
+      print_help ();
+      exit (1);
+    }
+
+  if (argc - optind > 0)
+    users_file = argv[optind];
+  if (argc - optind > 1)
+    db_file = argv[optind + 1];
+
+  err = usersdb_compile (users_file, db_file, USERSDB_COMPILED);
+  if (err)
+    {
+      fprintf (stderr, "%s: failed to compile `%s' into `%s': %s\n",
+	       PROGRAM_NAME, users_file, db_file, gpg_strerror (err));
+      exit (1);
+    }
+
+  return 0;
+}
+
+/* end */